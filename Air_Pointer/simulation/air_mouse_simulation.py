@@ -3,11 +3,20 @@
 Air Mouse Pointer Simulation
 Reads pitch/roll data from ESP32-S3 via serial and moves an arrow pointer on screen.
 Uses tkinter (built-in) for graphics.
+
+The reader thread only decodes: every sample goes into a preallocated ring
+(SAMPLE_RING) as it arrives. Once per display frame the UI takes the newest
+samples from it, steps the pointer and moves canvas items that already exist
+(the trail is a fixed ring of TRAIL_LENGTH line segments), so the frame cost
+does not grow with the input rate.
 """
 
+import os
 import sys
 import re
 import math
+import argparse
+from array import array
 import tkinter as tk
 from tkinter import ttk, messagebox
 from collections import deque
@@ -23,6 +32,20 @@ except ImportError:
     print("Or run: source venv/bin/activate && pip install pyserial")
     sys.exit(1)
 
+# Binary telemetry decoder shared with the Gyrometer viewer
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                '..', '..', 'Gyrometer', 'viewer'))
+import capture
+import latency
+import pointer_model
+import telemetry
+
+# Host fusion for OUTPUT_RAW Gyrometer firmware (needs NumPy)
+try:
+    import host_fusion
+except ImportError:
+    host_fusion = None
+
 
 # ═══════════════════════════════════════════════════════════════════════════════
 # CONFIGURATION
@@ -36,7 +59,13 @@ SENSITIVITY_X = 10.0  # Roll affects X axis
 SENSITIVITY_Y = 10.0  # Pitch affects Y axis
 
 # Smoothing - number of samples to average
-SMOOTHING_SAMPLES = 5
+SMOOTHING_SAMPLES = pointer_model.SMOOTHING_SAMPLES
+
+# Display loop
+FRAME_S = 1 / 60
+SAMPLE_RING = 1024        # samples the reader may get ahead of the UI
+TRAIL_LENGTH = 30         # trail points (TRAIL_LENGTH - 1 segments)
+LATENCY_REFRESH_S = 0.25  # the latency label sorts its window, so not every frame
 
 # Colors (Dark theme)
 BG_COLOR = "#0f0f19"
@@ -72,9 +101,34 @@ def find_esp32_port():
 def parse_sensor_data(line):
     """
     Parse the serial output from ESP32.
-    Expected format: "Pitch: 12.34  | Roll: 56.78    (Accel Z: 0.99)"
+    Accepted formats:
+      - Air_Pointer text:  "Pitch: 12.34  | Roll: 56.78    (Accel Z: 0.99)"
+      - Gyrometer text:    "EULER,roll,pitch,yaw" or "QUAT,w,x,y,z"
+      - Gyrometer binary:  telemetry.Frame, or the raw frame bytes
     """
+    if isinstance(line, (bytes, bytearray)):
+        line = telemetry.decode_frame(line)
+        if line is None:
+            return None, None
+    if isinstance(line, telemetry.Frame):
+        if line.type == telemetry.FRAME_EULER:
+            return line.pitch, line.roll
+        if line.type == telemetry.FRAME_QUAT:
+            roll, pitch, _ = telemetry.quat_to_euler(line.quat)
+            return pitch, roll
+        return None, None
     try:
+        if line.startswith('EULER,'):
+            parts = line.split(',')
+            if len(parts) == 4:
+                return float(parts[2]), float(parts[1])
+            return None, None
+        if line.startswith('QUAT,'):
+            parts = line.split(',')
+            if len(parts) == 5:
+                roll, pitch, _ = telemetry.quat_to_euler([float(p) for p in parts[1:]])
+                return pitch, roll
+            return None, None
         match = re.search(r'Pitch:\s*([-\d.]+).*Roll:\s*([-\d.]+)', line)
         if match:
             pitch = float(match.group(1))
@@ -89,7 +143,7 @@ def parse_sensor_data(line):
 # MAIN APPLICATION
 # ═══════════════════════════════════════════════════════════════════════════════
 class AirMouseSimulation:
-    def __init__(self):
+    def __init__(self, replay=None, replay_speed=1.0):
         self.root = tk.Tk()
         self.root.title("🎮 Air Mouse Simulation")
         self.root.configure(bg=BG_COLOR)
@@ -100,21 +154,39 @@ class AirMouseSimulation:
         self.connected = False
         self.running = True
         
-        # Pointer state
-        self.pointer_x = WINDOW_WIDTH // 2
-        self.pointer_y = WINDOW_HEIGHT // 2
-        self.target_x = self.pointer_x
-        self.target_y = self.pointer_y
+        # Pointer state and tilt mapping (shared with replay.py)
+        self.pointer = pointer_model.PointerModel(
+            WINDOW_WIDTH, WINDOW_HEIGHT, SENSITIVITY_X, SENSITIVITY_Y,
+            SMOOTHING_SAMPLES)
         self.pointer_angle = -45  # degrees
-        
-        # Sensor data
-        self.last_pitch = 0.0
-        self.last_roll = 0.0
-        self.pitch_buffer = deque(maxlen=SMOOTHING_SAMPLES)
-        self.roll_buffer = deque(maxlen=SMOOTHING_SAMPLES)
-        
-        # Trail
-        self.trail = deque(maxlen=30)
+        self.host_filter = host_fusion.MadgwickBatch() if host_fusion else None
+
+        # Samples from the reader thread: (pitch, roll) pairs, written before
+        # sample_head moves on, so the UI never sees a half-written one
+        self.samples = array('d', bytes(16 * SAMPLE_RING))
+        self.sample_head = 0      # samples written (reader thread)
+        self.sample_tail = 0      # samples taken (UI)
+
+        # Trail: the last TRAIL_LENGTH pointer positions, oldest first from
+        # trail_head
+        self.trail_x = [0.0] * TRAIL_LENGTH
+        self.trail_y = [0.0] * TRAIL_LENGTH
+        self.trail_head = 0
+        self.trail_count = 0
+        self.trail_shown = 0      # segments visible, newest first
+
+        # Latency (Gyrometer binary frames only; see viewer/latency.py)
+        self.clock_sync = latency.ClockSync()
+        self.link_stats = latency.LinkStats()
+        self.latest_sample = None          # (t_recv_us, sample→receive µs)
+        self.draw_latency = deque(maxlen=300)
+
+        # UI cost per frame, reported when a replay ends
+        self.update_times = deque(maxlen=3600)
+        self.item_text = {}       # canvas text item -> text shown
+        self.pointer_drawn = None # (x, y, angle) last drawn
+        self.latency_at = 0.0
+        self.next_frame = time.perf_counter()
         
         # Demo mode
         self.demo_mode = tk.BooleanVar(value=False)
@@ -123,8 +195,11 @@ class AirMouseSimulation:
         # Setup UI
         self._setup_ui()
         
-        # Try auto-connect
-        self._try_auto_connect()
+        # Replay a capture, or try auto-connect
+        if replay:
+            self._start_replay(replay, replay_speed)
+        else:
+            self._try_auto_connect()
         
         # Start update loop
         self._update()
@@ -147,10 +222,10 @@ class AirMouseSimulation:
         # Draw grid
         self._draw_grid()
         
-        # Create pointer
-        self.pointer_items = []
+        # Create trail and pointer
         self.trail_items = []
         self.glow_items = []
+        self._create_trail()
         self._create_pointer()
         
         # Info panel
@@ -181,6 +256,18 @@ class AirMouseSimulation:
         self.canvas.create_line(cx, cy - 40, cx, cy + 40, fill=ACCENT_COLOR, width=2, dash=(5, 3))
         self.canvas.create_oval(cx - 5, cy - 5, cx + 5, cy + 5, outline=ACCENT_COLOR, width=2)
     
+    def _create_trail(self):
+        """
+        One line per trail segment, oldest first, styled once: segment i
+        always shows the i-th oldest step, only its coordinates change.
+        """
+        for i in range(1, TRAIL_LENGTH):
+            f = i / TRAIL_LENGTH
+            color = f"#{int(255 * f * 0.5):02x}{int(200 * f):02x}{int(255 * f):02x}"
+            self.trail_items.append(self.canvas.create_line(
+                0, 0, 0, 0, fill=color, width=1 + f * 4, capstyle=tk.ROUND,
+                state=tk.HIDDEN))
+
     def _create_pointer(self):
         """Create the arrow pointer."""
         # Glow circles
@@ -245,11 +332,18 @@ class AirMouseSimulation:
         )
         self.pos_label = self.canvas.create_text(
             30, panel_y + 70,
-            text=f"Pointer: ({self.pointer_x}, {self.pointer_y})",
+            text=f"Pointer: ({self.pointer.x}, {self.pointer.y})",
             font=("Menlo", 14),
             fill=TEXT_COLOR,
             anchor="w"
         )
+        self.latency_label = self.canvas.create_text(
+            30, panel_y + 95,
+            text="Latency: —",
+            font=("Menlo", 11),
+            fill="#646478",
+            anchor="w"
+        )
         
         # Instructions
         instructions = [
@@ -282,6 +376,7 @@ class AirMouseSimulation:
         try:
             if self.serial_port:
                 self.serial_port.close()
+            # The read timeout bounds how late a clock-sync probe goes out
             self.serial_port = serial.Serial(port, SERIAL_BAUDRATE, timeout=0.05)
             self.connected = True
             self.demo_mode.set(False)
@@ -299,20 +394,104 @@ class AirMouseSimulation:
     
     def _read_serial_loop(self):
         """Background thread to read serial data."""
+        decoder = telemetry.StreamDecoder()
+        last_probe = 0.0
         while self.running and self.connected:
             try:
-                if self.serial_port and self.serial_port.in_waiting:
-                    line = self.serial_port.readline().decode('utf-8', errors='ignore').strip()
-                    if line:
-                        pitch, roll = parse_sensor_data(line)
-                        if pitch is not None:
-                            self.pitch_buffer.append(pitch)
-                            self.roll_buffer.append(roll)
+                # Clock-sync probe once a second (answered by the Gyrometer
+                # firmware; other devices just ignore it)
+                if time.time() - last_probe >= 1.0:
+                    last_probe = time.time()
+                    self.serial_port.write((self.clock_sync.make_probe() + '\n').encode())
+                # Everything pending, or wait (up to the timeout) for the
+                # next byte: no polling delay on top of the link's own
+                data = self.serial_port.read(max(1, self.serial_port.in_waiting))
+                if data:
+                    self._handle_items(decoder.feed(data), latency.now_us())
             except:
                 self.connected = False
                 break
-            time.sleep(0.01)
+
+    def _push_sample(self, pitch, roll):
+        """Reader side of the sample ring."""
+        i = 2 * (self.sample_head % SAMPLE_RING)
+        self.samples[i] = pitch
+        self.samples[i + 1] = roll
+        self.sample_head += 1
+
+    def _take_samples(self):
+        """
+        UI side, once per frame: only the newest SMOOTHING_SAMPLES can still
+        reach the pointer's moving average, so older ones are skipped.
+        """
+        head = self.sample_head
+        for k in range(max(self.sample_tail, head - SMOOTHING_SAMPLES), head):
+            i = 2 * (k % SAMPLE_RING)
+            self.pointer.add(self.samples[i], self.samples[i + 1])
+        self.sample_tail = head
     
+    def _handle_items(self, items, t_recv):
+        """Decoded lines and frames → clock sync, link stats and the pointer."""
+        raw = []
+        for item in items:
+            if isinstance(item, str) and item.startswith('SYNC'):
+                self.clock_sync.on_reply(item.split(','), t_recv)
+                continue
+            if isinstance(item, telemetry.Frame):
+                lat = self.clock_sync.latency_us(item.t_us, t_recv)
+                self.link_stats.add(item.seq, lat)
+                if lat is not None:
+                    self.latest_sample = (t_recv, lat)
+                if item.type == telemetry.FRAME_RAW:
+                    raw.append(item)
+                    continue
+            pitch, roll = parse_sensor_data(item)
+            if pitch is not None:
+                self._push_sample(pitch, roll)
+        if raw and self.host_filter:
+            quats = self.host_filter.update(*host_fusion.raw_arrays(raw))
+            for q in quats.tolist():
+                roll, pitch, _ = telemetry.quat_to_euler(q)
+                self._push_sample(pitch, roll)
+
+    def _start_replay(self, path, speed):
+        """Feed a server.py --record capture through the live input path."""
+        self.connected = True
+        self.demo_mode.set(False)
+        self._update_status(f"Replay: {os.path.basename(path)} ×{speed:g}", WARNING_COLOR)
+        print(f"Replaying {path} at ×{speed:g}")
+        self.replay_thread = threading.Thread(
+            target=self._replay_loop, args=(path, speed), daemon=True)
+        self.replay_thread.start()
+
+    def _replay_loop(self, path, speed):
+        decoder = telemetry.StreamDecoder()
+        records = 0
+        self.update_times.clear()
+        t_start = time.monotonic()
+        try:
+            for _, source, data in capture.paced(capture.read_capture(path), speed):
+                if not self.running:
+                    return
+                if source == capture.SOURCE_SERIAL:
+                    items = decoder.feed(data)
+                elif data and data[0] == telemetry.MAGIC:
+                    items = telemetry.decode_frames(data) or []
+                else:
+                    items = [data.decode('utf-8', errors='ignore').strip()]
+                self._handle_items(items, latency.now_us())
+                records += 1
+        except (OSError, ValueError) as e:
+            print(f"✗ Replay failed: {e}")
+        self.connected = False
+        elapsed = time.monotonic() - t_start
+        ms = sorted(self.update_times)
+        if ms:
+            print(f"Replay done: {records} records in {elapsed:.1f} s, "
+                  f"{len(ms) / elapsed:.1f} fps, update p50 {ms[len(ms) // 2]:.2f} ms"
+                  f" / p95 {ms[min(len(ms) - 1, int(0.95 * len(ms)))]:.2f} ms")
+        self.root.after(0, lambda: self._update_status("Replay finished", ACCENT_COLOR))
+
     def _show_port_dialog(self):
         """Show port selection dialog."""
         ports = list_serial_ports()
@@ -352,77 +531,85 @@ class AirMouseSimulation:
     
     def _update_status(self, text, color):
         """Update connection status display."""
+        if self.item_text.get(self.status_text) == text:
+            return
         self.canvas.itemconfig(self.status_dot, fill=color)
-        self.canvas.itemconfig(self.status_text, text=text)
+        self._set_text(self.status_text, text)
+
+    def _set_text(self, item, text):
+        """itemconfig only on a change (each one is a Tk round trip)."""
+        if self.item_text.get(item) != text:
+            self.item_text[item] = text
+            self.canvas.itemconfig(item, text=text)
     
     def _recenter(self):
         """Recenter the pointer."""
-        self.pointer_x = WINDOW_WIDTH // 2
-        self.pointer_y = WINDOW_HEIGHT // 2
-        self.target_x = self.pointer_x
-        self.target_y = self.pointer_y
-        self.trail.clear()
+        self.pointer.recenter()
+        self.trail_count = self.trail_shown = 0
         for item in self.trail_items:
-            self.canvas.delete(item)
-        self.trail_items.clear()
+            self.canvas.itemconfig(item, state=tk.HIDDEN)
     
     def _update(self):
         """Main update loop."""
         if not self.running:
             return
+        t_frame = time.perf_counter()
         
         # Get sensor data
         dx, dy = 0, 0
         
-        if self.connected and self.pitch_buffer:
-            # Calculate smoothed values
-            self.last_pitch = sum(self.pitch_buffer) / len(self.pitch_buffer)
-            self.last_roll = sum(self.roll_buffer) / len(self.roll_buffer)
-            
-            # Convert to movement
-            dx = self.last_roll * SENSITIVITY_X * 0.1
-            dy = -self.last_pitch * SENSITIVITY_Y * 0.1
+        if self.connected and self.latest_sample:
+            # Motion → draw: sample age at receive plus the wait for this frame
+            t_recv, lat = self.latest_sample
+            self.latest_sample = None
+            self.draw_latency.append(lat + latency.now_us() - t_recv)
+
+        self._take_samples()
+        if self.connected and self.pointer.has_data:
+            # Smoothed tilt → movement, clamp, ease (see pointer_model.py)
+            dx, dy = self.pointer.step()
         
         elif self.demo_mode.get():
             # Demo mode - figure-8 motion
             self.demo_time += 0.03
-            self.last_pitch = 20 * math.sin(self.demo_time)
-            self.last_roll = 20 * math.sin(self.demo_time * 0.5)
-            dx = self.last_roll * SENSITIVITY_X * 0.08
-            dy = -self.last_pitch * SENSITIVITY_Y * 0.08
+            self.pointer.pitch = 20 * math.sin(self.demo_time)
+            self.pointer.roll = 20 * math.sin(self.demo_time * 0.5)
+            dx, dy = self.pointer.move(self.pointer.roll * SENSITIVITY_X * 0.08,
+                                       -self.pointer.pitch * SENSITIVITY_Y * 0.08)
             self._update_status("Demo Mode", WARNING_COLOR)
         
-        # Update target position
-        self.target_x += dx
-        self.target_y += dy
-        
-        # Clamp to bounds
-        margin = 50
-        self.target_x = max(margin, min(WINDOW_WIDTH - margin, self.target_x))
-        self.target_y = max(margin, min(WINDOW_HEIGHT - margin, self.target_y))
-        
-        # Smooth movement (lerp)
-        self.pointer_x += (self.target_x - self.pointer_x) * 0.2
-        self.pointer_y += (self.target_y - self.pointer_y) * 0.2
+        else:
+            self.pointer.move(0, 0)
         
         # Update pointer angle based on movement
         if abs(dx) > 0.5 or abs(dy) > 0.5:
             self.pointer_angle = math.degrees(math.atan2(dy, dx)) - 45
         
         # Add to trail
-        self.trail.append((self.pointer_x, self.pointer_y))
+        self.trail_x[self.trail_head] = self.pointer.x
+        self.trail_y[self.trail_head] = self.pointer.y
+        self.trail_head = (self.trail_head + 1) % TRAIL_LENGTH
+        self.trail_count = min(self.trail_count + 1, TRAIL_LENGTH)
         
         # Update visuals
         self._update_pointer()
         self._update_trail()
         self._update_labels()
-        
-        # Schedule next update (60 FPS)
-        self.root.after(16, self._update)
+        self.update_times.append((time.perf_counter() - t_frame) * 1000.0)
+        
+        # Schedule next update (60 FPS) against a fixed frame clock, so the
+        # frame's own cost does not stretch the period; after a stall, skip
+        # ahead instead of running late frames back to back
+        now = time.perf_counter()
+        self.next_frame = max(self.next_frame + FRAME_S, now)
+        self.root.after(max(1, int((self.next_frame - now) * 1000)), self._update)
     
     def _update_pointer(self):
         """Update pointer position and rotation."""
-        x, y = self.pointer_x, self.pointer_y
+        x, y = self.pointer.x, self.pointer.y
+        if self.pointer_drawn == (x, y, self.pointer_angle):
+            return
+        self.pointer_drawn = (x, y, self.pointer_angle)
         size = 35
         
         # Arrow points (pointing right, then rotated)
@@ -450,35 +637,32 @@ class AirMouseSimulation:
             self.canvas.coords(glow, x - r, y - r, x + r, y + r)
     
     def _update_trail(self):
-        """Update the motion trail."""
-        # Remove old trail items
-        for item in self.trail_items:
-            self.canvas.delete(item)
-        self.trail_items.clear()
-        
-        # Draw new trail
-        if len(self.trail) > 1:
-            points = list(self.trail)
-            for i in range(1, len(points)):
-                alpha = int(255 * (i / len(points)) * 0.5)
-                # Convert alpha to hex color with transparency simulation
-                color = f"#{alpha:02x}{int(200*i/len(points)):02x}{int(255*i/len(points)):02x}"
-                width = 1 + (i / len(points)) * 4
-                
-                line = self.canvas.create_line(
-                    points[i-1][0], points[i-1][1],
-                    points[i][0], points[i][1],
-                    fill=color, width=width, capstyle=tk.ROUND
-                )
-                self.trail_items.append(line)
-                self.canvas.tag_lower(line)
+        """Move the trail segments onto the last TRAIL_LENGTH positions."""
+        n = TRAIL_LENGTH
+        first = n - self.trail_count      # segments before this have no points yet
+        for i in range(max(1, first + 1), n):
+            a = (self.trail_head + i - 1) % n
+            b = (self.trail_head + i) % n
+            self.canvas.coords(self.trail_items[i - 1], self.trail_x[a], self.trail_y[a],
+                               self.trail_x[b], self.trail_y[b])
+        while self.trail_shown < self.trail_count - 1:
+            self.trail_shown += 1
+            self.canvas.itemconfig(self.trail_items[-self.trail_shown], state=tk.NORMAL)
     
     def _update_labels(self):
         """Update sensor value labels."""
-        self.canvas.itemconfig(self.pitch_label, text=f"Pitch: {self.last_pitch:>7.2f}°")
-        self.canvas.itemconfig(self.roll_label, text=f"Roll:  {self.last_roll:>7.2f}°")
-        self.canvas.itemconfig(self.pos_label, 
-            text=f"Pointer: ({int(self.pointer_x)}, {int(self.pointer_y)})")
+        self._set_text(self.pitch_label, f"Pitch: {self.pointer.pitch:>7.2f}°")
+        self._set_text(self.roll_label, f"Roll:  {self.pointer.roll:>7.2f}°")
+        self._set_text(self.pos_label,
+                       f"Pointer: ({int(self.pointer.x)}, {int(self.pointer.y)})")
+        now = time.perf_counter()
+        if self.draw_latency and now - self.latency_at >= LATENCY_REFRESH_S:
+            self.latency_at = now
+            lat = sorted(self.draw_latency)
+            p50 = lat[len(lat) // 2] / 1000.0
+            p95 = lat[min(len(lat) - 1, int(0.95 * len(lat)))] / 1000.0
+            self._set_text(self.latency_label,
+                f"Latency: {p50:.1f} / {p95:.1f} ms · drops {self.link_stats.drops}")
     
     def _on_close(self):
         """Handle window close."""
@@ -506,5 +690,11 @@ class AirMouseSimulation:
 # ENTRY POINT
 # ═══════════════════════════════════════════════════════════════════════════════
 if __name__ == "__main__":
-    app = AirMouseSimulation()
+    parser = argparse.ArgumentParser(description='Air Mouse pointer simulation')
+    parser.add_argument('--replay', metavar='FILE',
+                        help='Play a Gyrometer server.py --record capture instead of a device')
+    parser.add_argument('--speed', type=float, default=1.0,
+                        help='Replay speed (1 = recorded timing, 0 = as fast as possible)')
+    args = parser.parse_args()
+    app = AirMouseSimulation(replay=args.replay, replay_speed=args.speed)
     app.run()
@@ -1,18 +1,73 @@
 #include <Arduino.h>
 #include <Wire.h>
 #include <MPU6500_WE.h>
+#include <USB.h>
+#include <USBHIDMouse.h>
+#include "calib_store.h"    // shared with Gyrometer (see platformio.ini)
+#include "pointer_engine.h" // shared with Gyrometer
 
 #define I2C_SDA_PIN 1
 #define I2C_SCL_PIN 2
+#define I2C_CLOCK_HZ 400000
+#define CALIB_MAX_TEMP_DELTA_C 10.0f
+
+// ── Pointer ──
+// The gyro is read at POINTER_RATE_HZ and every sample feeds the pointer
+// engine; a HID report goes out whenever the endpoint is free (1 ms polling
+// on full-speed USB), so cursor latency is about one sample + one poll.
+#define POINTER_RATE_HZ 1000
+#define POINTER_PERIOD_US (1000000UL / POINTER_RATE_HZ)
+// Acceleration curve, dead zone and tremor filter (include/pointer_engine.h)
+#define POINTER_GAIN_LOW 8.0f   // counts per degree, slow precise turns
+#define POINTER_GAIN_HIGH 30.0f // counts per degree, fast turns
+#define POINTER_GAIN_KNEE_DPS 60.0f
+#define POINTER_CURVE_EXPONENT 2.0f
+#define POINTER_DEAD_ZONE_DPS 1.0f
+#define POINTER_TREMOR_MIN_HZ 5.0f // 0 = no tremor filter
+#define POINTER_TREMOR_HZ_PER_DPS 0.2f
+// Gyro axis (0 = x, 1 = y, 2 = z) and sign for cursor right / down. Default:
+// board flat, x forward — turn right (yaw) moves right, nose down moves down.
+#define POINTER_AXIS_X 2
+#define POINTER_SIGN_X -1.0f
+#define POINTER_AXIS_Y 1
+#define POINTER_SIGN_Y 1.0f
+// Longest gap one sample may cover (a stall is not a fast turn)
+#define POINTER_MAX_DT_US 20000
+
+// Human-readable pitch/roll on the CDC serial for the simulation (0 = off)
+#define DEBUG_PRINT_MS 100
 
 // Setup for MPU6500 at address 0x68
 MPU6500_WE myMPU = MPU6500_WE(0x68);
 
+USBHIDMouse Mouse;
+USBHID HID;
+PointerConfig pointerConfig() {
+  PointerConfig c = defaultPointerConfig();
+  c.lowGain = POINTER_GAIN_LOW;
+  c.highGain = POINTER_GAIN_HIGH;
+  c.kneeDps = POINTER_GAIN_KNEE_DPS;
+  c.curveExponent = POINTER_CURVE_EXPONENT;
+  c.deadZoneDps = POINTER_DEAD_ZONE_DPS;
+  c.tremorMinHz = POINTER_TREMOR_MIN_HZ;
+  c.tremorHzPerDps = POINTER_TREMOR_HZ_PER_DPS;
+  return c;
+}
+PointerEngine pointer(pointerConfig());
+
+float gyroAxis(const xyzFloat &g, int axis) {
+  return axis == 0 ? g.x : (axis == 1 ? g.y : g.z);
+}
+
 void setup() {
+  // HID first: the composite USB device (CDC + mouse) enumerates on begin()
+  Mouse.begin();
+  USB.begin();
   Serial.begin(115200);
   // Remove the "while(!Serial)" line so the board starts even without the monitor open
   
   Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);
+  Wire.setClock(I2C_CLOCK_HZ);
   delay(100);
 
   Serial.println("Initializing MPU-6500...");
@@ -26,34 +81,81 @@ void setup() {
   Serial.println("MPU-6500 connected!");
 
   // --- CALIBRATION ---
-  Serial.println("Position sensor flat and do not move it!");
-  delay(1000);
-  
-  Serial.println("Calibrating...");
-  myMPU.autoOffsets(); // Auto-calibrates gyro and accel
-  Serial.println("Done!");
+  // Offsets stored in NVS at a similar temperature: start right away, in hand
+  CalibrationData calib;
+  float tempC = myMPU.getTemperature();
+  if (calibLoad(calib) && (calib.flags & CALIB_HAS_IMU) &&
+      fabsf(tempC - calib.imuTempC) <= CALIB_MAX_TEMP_DELTA_C) {
+    myMPU.setAccOffsets(xyzFloat(calib.accOffset[0], calib.accOffset[1], calib.accOffset[2]));
+    myMPU.setGyrOffsets(xyzFloat(calib.gyrOffset[0], calib.gyrOffset[1], calib.gyrOffset[2]));
+    Serial.println("Offsets loaded from NVS.");
+  } else {
+    Serial.println("Position sensor flat and do not move it!");
+    delay(1000);
+
+    Serial.println("Calibrating...");
+    myMPU.autoOffsets(); // Auto-calibrates gyro and accel
+    Serial.println("Done!");
+
+    xyzFloat acc = myMPU.getAccOffsets(), gyr = myMPU.getGyrOffsets();
+    calib.accOffset[0] = acc.x; calib.accOffset[1] = acc.y; calib.accOffset[2] = acc.z;
+    calib.gyrOffset[0] = gyr.x; calib.gyrOffset[1] = gyr.y; calib.gyrOffset[2] = gyr.z;
+    calib.imuTempC = tempC;
+    calib.flags |= CALIB_HAS_IMU;
+    calibSave(calib);
+  }
   
-  // Optional: Set filters to smooth out the data
+  // 1 kHz output (the divider only applies with the DLPF on). DLPF_1 is
+  // ~184 Hz / 2.9 ms, the least delay that still takes the edge off the noise.
+  // 500 dps: a quick flick of the wrist goes past 250.
+  myMPU.enableGyrDLPF();
+  myMPU.setGyrDLPF(MPU6500_DLPF_1);
+  myMPU.setSampleRateDivider(1000 / POINTER_RATE_HZ - 1);
   myMPU.setAccRange(MPU6500_ACC_RANGE_2G);
-  myMPU.setGyrRange(MPU6500_GYRO_RANGE_250);
+  myMPU.setGyrRange(MPU6500_GYRO_RANGE_500);
 }
 
 void loop() {
-  // 1. Get raw G-force and Gyro data
-  xyzFloat gValue = myMPU.getGValues();
+  static uint32_t nextUs = micros();
+  static uint32_t lastUs = nextUs;
+  static uint32_t lastPrint = 0;
+
+  // Pace to the gyro's output rate; a late iteration resynchronises instead
+  // of bursting to catch up
+  while ((int32_t)(micros() - nextUs) < 0) {
+  }
+  const uint32_t now = micros();
+  nextUs += POINTER_PERIOD_US;
+  if ((int32_t)(now - nextUs) > (int32_t)POINTER_PERIOD_US)
+    nextUs = now + POINTER_PERIOD_US;
+
+  // 1. Gyro rate → pointer counts
   xyzFloat gyr = myMPU.getGyrValues();
-  
-  // 2. Get Calculated Angles (Pitch and Roll)
-  // This library does the math for you!
-  float pitch = myMPU.getPitch();
-  float roll  = myMPU.getRoll();
-
-  // 3. Print Data
-  Serial.print("Pitch: "); Serial.print(pitch);
-  Serial.print("  | Roll: "); Serial.print(roll);
-  
-  Serial.print("    (Accel Z: "); Serial.print(gValue.z); // Should be ~1.0 when flat
-  Serial.println(")");
+  uint32_t dtUs = now - lastUs;
+  lastUs = now;
+  if (dtUs > POINTER_MAX_DT_US)
+    dtUs = POINTER_MAX_DT_US;
+  pointer.addRate(POINTER_SIGN_X * gyroAxis(gyr, POINTER_AXIS_X),
+                  POINTER_SIGN_Y * gyroAxis(gyr, POINTER_AXIS_Y), dtUs * 1e-6f);
 
-  delay(100);
-}
\ No newline at end of file
+  // 2. One report when the endpoint is free; the rest waits in the engine
+  int8_t dx, dy;
+  if (HID.ready() && pointer.take(dx, dy))
+    Mouse.move(dx, dy);
+
+#if DEBUG_PRINT_MS > 0
+  // 3. Pitch / roll for the simulation and the serial monitor
+  if (millis() - lastPrint >= DEBUG_PRINT_MS) {
+    lastPrint = millis();
+    xyzFloat gValue = myMPU.getGValues();
+    float pitch = myMPU.getPitch();
+    float roll  = myMPU.getRoll();
+
+    Serial.print("Pitch: "); Serial.print(pitch);
+    Serial.print("  | Roll: "); Serial.print(roll);
+
+    Serial.print("    (Accel Z: "); Serial.print(gValue.z); // Should be ~1.0 when flat
+    Serial.println(")");
+  }
+#endif
+}
@@ -1,34 +1,44 @@
 /*
  * HMC5883L Magnetometer Calibration Tool
  * =======================================
- * Flash this firmware to collect min/max readings from the magnetometer.
+ * Flash this firmware to fit the magnetometer's hard-iron offset and full
+ * 3x3 soft-iron matrix (incremental ellipsoid fit, see include/mag_fit.h).
  *
  * Usage:
  *   1. Flash:   pio run -e calibration -t upload
  *   2. Monitor: pio device monitor
  *   3. Slowly rotate the sensor through ALL orientations for 30–60 seconds.
  *      (Think: tumble it gently in every direction — pitch, roll, yaw.)
- *   4. When you're happy with the coverage, type 's' and press Enter
- *      to stop and print the final calibration values.
- *   5. Paste the printed #define lines into src/main.cpp.
- *   6. Re-flash the main firmware: pio run -t upload
+ *   4. Once coverage is near 100% (every part of the sphere visited),
+ *      type 's' and press Enter
+ *      to stop, print the final calibration values and store them in NVS.
+ *   5. Re-flash the main firmware: pio run -t upload
+ *      It loads the stored values at boot (no #define lines to paste).
+ *
+ * Other commands: 'x' erases all stored calibration (IMU offsets included,
+ * so the main firmware runs autoOffsets() again on its next boot).
  */
 
 #include "HMC5883L.h"
+#include "calib_store.h"
+#include "mag_fit.h"
 #include <Arduino.h>
+#include <MPU6500_WE.h>
 #include <Wire.h>
 
 // ── Pin & address config (must match your main firmware) ──
 #define I2C_SDA_PIN 1
 #define I2C_SCL_PIN 2
 #define HMC5883L_ADDR 0x1E
+#define MPU6500_ADDR 0x68
 
 HMC5883L mag;
+MPU6500_WE imu = MPU6500_WE(MPU6500_ADDR); // temperature tag only
+bool imuPresent = false;
 
-// ── Min / Max trackers ──
-int16_t minX = 32767, maxX = -32768;
-int16_t minY = 32767, maxY = -32768;
-int16_t minZ = 32767, maxZ = -32768;
+// ── Running ellipsoid fit (O(1) memory) ──
+MagEllipsoidFit magFit;
+int16_t lastX = 0, lastY = 0, lastZ = 0;
 
 unsigned long sampleCount = 0;
 bool running = true;
@@ -48,37 +58,49 @@ void printCalibration()
   Serial.println();
 
   // Raw min/max
-  Serial.printf("  X: min = %6d,  max = %6d\n", minX, maxX);
-  Serial.printf("  Y: min = %6d,  max = %6d\n", minY, maxY);
-  Serial.printf("  Z: min = %6d,  max = %6d\n", minZ, maxZ);
+  Serial.printf("  X: min = %6d,  max = %6d\n", magFit.minRaw(0), magFit.maxRaw(0));
+  Serial.printf("  Y: min = %6d,  max = %6d\n", magFit.minRaw(1), magFit.maxRaw(1));
+  Serial.printf("  Z: min = %6d,  max = %6d\n", magFit.minRaw(2), magFit.maxRaw(2));
   Serial.println();
 
-  // Hard-iron offsets (center of the min/max envelope)
-  float offX = (maxX + minX) / 2.0f;
-  float offY = (maxY + minY) / 2.0f;
-  float offZ = (maxZ + minZ) / 2.0f;
-
-  // Axis ranges
-  float rangeX = (maxX - minX) / 2.0f;
-  float rangeY = (maxY - minY) / 2.0f;
-  float rangeZ = (maxZ - minZ) / 2.0f;
+  Serial.printf("  Samples collected: %lu, coverage %.0f%%\n", sampleCount,
+                100.0f * magFit.coverage());
+  Serial.println();
 
-  // Soft-iron scale (normalize to average range)
-  float avgRange = (rangeX + rangeY + rangeZ) / 3.0f;
-  float scaleX = (rangeX > 0) ? avgRange / rangeX : 1.0f;
-  float scaleY = (rangeY > 0) ? avgRange / rangeY : 1.0f;
-  float scaleZ = (rangeZ > 0) ? avgRange / rangeZ : 1.0f;
+  MagFitResult fit;
+  if (!magFit.fit(fit))
+  {
+    Serial.println("  ERROR: Ellipsoid fit failed — too few samples or too");
+    Serial.println("  little rotation. Nothing stored; reset and try again.");
+    Serial.println();
+    return;
+  }
 
-  Serial.printf("  Samples collected: %lu\n", sampleCount);
-  Serial.println();
-  Serial.println("  ── Copy these lines into src/main.cpp ──");
+  // Hard-iron offset (ellipsoid centre) and soft-iron matrix
+  const float *w = fit.softIron;
+  Serial.printf("  Offset:    %.1f, %.1f, %.1f\n", fit.offset[0], fit.offset[1], fit.offset[2]);
+  Serial.printf("  Soft iron: [%7.4f %7.4f %7.4f]\n", w[0], w[1], w[2]);
+  Serial.printf("             [%7.4f %7.4f %7.4f]\n", w[3], w[4], w[5]);
+  Serial.printf("             [%7.4f %7.4f %7.4f]\n", w[6], w[7], w[8]);
+  Serial.printf("  Field radius: %.1f LSB (%.1f uT), fit residual %.4f\n",
+                fit.radius, fit.radius * 100.0f / 1090.0f, fit.residual);
+  if (magFit.coverage() < 0.8f)
+    Serial.println("  WARNING: Low coverage — the fit may be poorly conditioned.");
   Serial.println();
-  Serial.printf("  #define MAG_OFFSET_X %.1ff\n", offX);
-  Serial.printf("  #define MAG_OFFSET_Y %.1ff\n", offY);
-  Serial.printf("  #define MAG_OFFSET_Z %.1ff\n", offZ);
-  Serial.printf("  #define MAG_SCALE_X  %.4ff\n", scaleX);
-  Serial.printf("  #define MAG_SCALE_Y  %.4ff\n", scaleY);
-  Serial.printf("  #define MAG_SCALE_Z  %.4ff\n", scaleZ);
+
+  // Keep the IMU half of whatever is stored, replace the mag half
+  CalibrationData calib;
+  calibLoad(calib);
+  for (int i = 0; i < 3; i++)
+    calib.magOffset[i] = fit.offset[i];
+  for (int i = 0; i < 9; i++)
+    calib.magSoftIron[i] = fit.softIron[i];
+  calib.magTempC = imuPresent ? imu.getTemperature() : 0.0f;
+  calib.flags |= CALIB_HAS_MAG;
+  if (calibSave(calib))
+    Serial.println("  ── Stored in NVS; the main firmware loads it at boot ──");
+  else
+    Serial.println("  ERROR: NVS write failed!");
   Serial.println();
   Serial.println("  ─────────────────────────────────────────");
   Serial.println();
@@ -106,18 +128,23 @@ void setup()
   }
 
   mag.initialize();
+  // Same output rate as the main firmware, continuous so every loop can read
+  mag.setDataRate(HMC5883L_RATE_75);
+  mag.setMode(HMC5883L_MODE_CONTINUOUS);
   Serial.println("HMC5883L: Connected and initialized.");
+  imuPresent = checkI2CDevice(MPU6500_ADDR) && imu.init();
   Serial.println();
   Serial.println("Instructions:");
   Serial.println("  - Slowly rotate the sensor through ALL orientations.");
   Serial.println("  - Cover every angle: pitch, roll, yaw, and combinations.");
   Serial.println("  - Continue for at least 30 seconds.");
-  Serial.println("  - Send 's' (then Enter) to stop and print results.");
+  Serial.println("  - Send 's' (then Enter) to stop, print and store results.");
+  Serial.println("  - Send 'x' to erase the stored calibration.");
   Serial.println();
   Serial.println("Collecting data...");
   Serial.println();
-  Serial.println("   Sample |      X |      Y |      Z | minX  maxX | minY  maxY | minZ  maxZ");
-  Serial.println("   -------+--------+--------+--------+------------+------------+-----------");
+  Serial.println("   Sample |      X |      Y |      Z | minX  maxX | minY  maxY | minZ  maxZ | Cover");
+  Serial.println("   -------+--------+--------+--------+------------+------------+------------+------");
 }
 
 void loop()
@@ -133,6 +160,11 @@ void loop()
       Serial.println("Calibration stopped. Reset or re-flash to run again.");
       while (true) { delay(1000); }
     }
+    if (c == 'x' || c == 'X')
+    {
+      Serial.println(calibClear() ? "Stored calibration erased."
+                                  : "Nothing stored.");
+    }
   }
 
   if (!running) return;
@@ -140,22 +172,29 @@ void loop()
   int16_t mx, my, mz;
   mag.getHeading(&mx, &my, &mz);
 
-  // Update min/max
-  if (mx < minX) minX = mx;
-  if (mx > maxX) maxX = mx;
-  if (my < minY) minY = my;
-  if (my > maxY) maxY = my;
-  if (mz < minZ) minZ = mz;
-  if (mz > maxZ) maxZ = mz;
+  // Skip repeats of the last output (the loop outruns the data rate) and
+  // saturated readings (-4096)
+  if ((mx == lastX && my == lastY && mz == lastZ) ||
+      mx == -4096 || my == -4096 || mz == -4096)
+  {
+    delay(10);
+    return;
+  }
+  lastX = mx;
+  lastY = my;
+  lastZ = mz;
 
+  magFit.add(mx, my, mz);
   sampleCount++;
 
   // Print every 20th sample (~5 Hz at 100Hz read rate) to avoid flooding
   if (sampleCount % 20 == 0)
   {
-    Serial.printf("   %6lu | %6d | %6d | %6d | %5d %5d | %5d %5d | %5d %5d\n",
+    Serial.printf("   %6lu | %6d | %6d | %6d | %5d %5d | %5d %5d | %5d %5d | %4.0f%%\n",
                   sampleCount, mx, my, mz,
-                  minX, maxX, minY, maxY, minZ, maxZ);
+                  magFit.minRaw(0), magFit.maxRaw(0), magFit.minRaw(1),
+                  magFit.maxRaw(1), magFit.minRaw(2), magFit.maxRaw(2),
+                  100.0f * magFit.coverage());
   }
 
   delay(10); // ~100 Hz sampling
@@ -0,0 +1,140 @@
+/*
+ * MPU6500 Noise Characterization Stream
+ * ======================================
+ * Flash this firmware to record the IMU's noise for hours: it does nothing
+ * but stream every accel/gyro sample as a binary FRAME_RAW telemetry frame
+ * (include/telemetry.h) at the FIFO rate, uncalibrated and unfiltered
+ * beyond the MPU6500's own DLPF. viewer/allan.py turns the stream into
+ * Allan deviation, noise density and bias instability.
+ *
+ * Needs the MPU6500 INT pin wired to IMU_INT_PIN (as for IMU_USE_FIFO in the
+ * main firmware): the FIFO paces the samples, so a slow serial write delays a
+ * batch but never drops or skews one.
+ *
+ * Usage:
+ *   1. Pick the setting under test (default: 1 kHz, DLPF 3), e.g.
+ *        PLATFORMIO_BUILD_FLAGS="-DCHAR_DLPF=6 -DCHAR_RATE_DIVIDER=9" \
+ *          pio run -e characterize -t upload
+ *   2. Leave the board still (and at a steady temperature) and record:
+ *        python viewer/allan.py --port /dev/ttyUSB0 --record still.gycap
+ *   3. Stop with Ctrl-C after a few hours; re-analyse any time with
+ *        python viewer/allan.py still.gycap
+ *   4. Re-flash the main firmware: pio run -t upload
+ *
+ * Besides the frames it sends, as text lines,
+ *   CHAR,<rate Hz>,<dlpf>,<acc range g>,<gyro range dps>   every 10 s
+ *   TEMP,<°C>                                              every second
+ *   STAT,<FIFO overflows>,<I2C errors>                     every 10 s
+ */
+
+#include "imu_fifo.h"
+#include "telemetry.h"
+#include <Arduino.h>
+#include <MPU6500_WE.h>
+#include <Wire.h>
+
+// ── Pin & address config (must match your main firmware) ──
+#define I2C_SDA_PIN 1
+#define I2C_SCL_PIN 2
+#define I2C_CLOCK_HZ 400000
+#define IMU_INT_PIN 4
+#define MPU6500_ADDR 0x68
+
+// ── Setting under test ──
+#ifndef CHAR_RATE_DIVIDER
+#define CHAR_RATE_DIVIDER 0 // 1 kHz / (1 + divider)
+#endif
+#ifndef CHAR_DLPF
+#define CHAR_DLPF 3 // MPU6500_DLPF_0..7, accel and gyro
+#endif
+// The FRAME_RAW scales cover ±4 g and ±512 °/s
+#define CHAR_ACC_RANGE MPU6500_ACC_RANGE_4G
+#define CHAR_GYRO_RANGE MPU6500_GYRO_RANGE_500
+
+#define CHAR_INFO_MS 10000
+#define CHAR_TEMP_MS 1000
+#define CHAR_BATCH 40 // samples per drain (stack buffer)
+
+MPU6500_WE imu = MPU6500_WE(MPU6500_ADDR);
+ImuFifo imuFifo(MPU6500_ADDR);
+uint16_t deviceId = 0;
+uint16_t sampleSeq = 0;
+unsigned long lastInfo = 0, lastTemp = 0;
+
+void sendInfo()
+{
+  Serial.printf("CHAR,%lu,%d,4,500\r\n",
+                (unsigned long)(1000 / (1 + CHAR_RATE_DIVIDER)), CHAR_DLPF);
+  Serial.printf("STAT,%lu,%lu\r\n", (unsigned long)imuFifo.overflowCount(),
+                (unsigned long)imuFifo.busErrorCount());
+}
+
+void setup()
+{
+  Serial.setTxBufferSize(4096); // a few ms of frames while loop() reads I2C
+  Serial.begin(921600);
+  delay(500);
+
+  const uint64_t mac = ESP.getEfuseMac();
+  deviceId = (uint16_t)((((mac >> 32) & 0xFF) << 8) | ((mac >> 40) & 0xFF));
+  Serial.println();
+  Serial.println("MPU6500 noise characterization stream");
+  Serial.printf("DEVICE: id %04x\n", deviceId);
+
+  Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);
+  Wire.setClock(I2C_CLOCK_HZ);
+
+  if (!imu.init())
+  {
+    Serial.println("ERROR: MPU6500 not found at 0x68! Halting.");
+    while (true) { delay(1000); }
+  }
+  // No autoOffsets(): the bias and its drift are what is being measured
+  imu.enableGyrDLPF();
+  imu.setGyrDLPF((MPU6500_dlpf)CHAR_DLPF);
+  imu.enableAccDLPF(true);
+  imu.setAccDLPF((MPU6500_dlpf)CHAR_DLPF);
+  imu.setSampleRateDivider(CHAR_RATE_DIVIDER);
+  imu.setAccRange(CHAR_ACC_RANGE);
+  imu.setGyrRange(CHAR_GYRO_RANGE);
+  if (!imuFifo.begin(Wire, IMU_INT_PIN, CHAR_RATE_DIVIDER, CHAR_ACC_RANGE,
+                     CHAR_GYRO_RANGE))
+  {
+    Serial.println("ERROR: MPU6500 FIFO setup failed! Halting.");
+    while (true) { delay(1000); }
+  }
+  sendInfo();
+  lastInfo = lastTemp = millis();
+}
+
+void loop()
+{
+  ImuSample batch[CHAR_BATCH];
+  size_t n = imuFifo.pending() ? imuFifo.drain(batch, CHAR_BATCH) : 0;
+  for (size_t i = 0; i < n; i++)
+  {
+    const float acc[3] = {batch[i].acc.x, batch[i].acc.y, batch[i].acc.z};
+    const float gyr[3] = {batch[i].gyr.x, batch[i].gyr.y, batch[i].gyr.z};
+    const float mag[3] = {0.0f, 0.0f, 0.0f};
+    int16_t v[9];
+    rawToFixed(acc, gyr, mag, v);
+    uint8_t frame[TELEMETRY_MAX_FRAME_BYTES];
+    size_t len = encodeFrame(frame, sizeof(frame), FRAME_RAW, sampleSeq++,
+                             batch[i].tUs, STATUS_IMU_OK, v, deviceId);
+    Serial.write(frame, len);
+  }
+
+  const unsigned long now = millis();
+  if (now - lastTemp >= CHAR_TEMP_MS)
+  {
+    lastTemp = now;
+    Serial.printf("TEMP,%.2f\r\n", imu.getTemperature());
+  }
+  if (now - lastInfo >= CHAR_INFO_MS)
+  {
+    lastInfo = now;
+    sendInfo();
+  }
+  if (!n)
+    delay(1);
+}
@@ -0,0 +1,74 @@
+#pragma once
+// ── Sensor calibration in NVS ──
+// One versioned blob in the "calib" Preferences namespace, shared by the
+// main firmware (reads it at boot, refreshes the gyro bias) and the
+// calibration env (writes the magnetometer part). Each half carries the
+// MPU6500 die temperature it was taken at so a stale bias can be rejected.
+//
+// IMU offsets use MPU6500_WE's own units (raw LSB at 2 g / 250 dps, as
+// returned by getAccOffsets() / getGyrOffsets()), so they are independent of
+// the ranges the firmware runs at. Mag values are raw HMC5883L LSB, applied
+// as softIron · (raw − offset) (see include/mag_fit.h).
+
+#include <Preferences.h>
+#include <stdint.h>
+#include <string.h>
+
+#define CALIB_NAMESPACE "calib"
+#define CALIB_KEY "data"
+#define CALIB_VERSION 2 // 2: 3x3 soft-iron matrix
+
+#define CALIB_HAS_IMU 0x01
+#define CALIB_HAS_MAG 0x02
+
+struct CalibrationData {
+  uint16_t version;
+  uint16_t flags; // CALIB_HAS_*
+  float accOffset[3];
+  float gyrOffset[3];
+  float imuTempC; // die temperature when the IMU offsets were taken
+  float magOffset[3];   // hard iron
+  float magSoftIron[9]; // row-major
+  float magTempC;
+};
+
+inline void calibDefaults(CalibrationData &c) {
+  memset(&c, 0, sizeof(c));
+  c.version = CALIB_VERSION;
+  c.magSoftIron[0] = c.magSoftIron[4] = c.magSoftIron[8] = 1.0f;
+}
+
+// False (and c reset to defaults) if nothing valid is stored
+inline bool calibLoad(CalibrationData &c) {
+  Preferences prefs;
+  calibDefaults(c);
+  if (!prefs.begin(CALIB_NAMESPACE, true))
+    return false;
+  CalibrationData stored;
+  bool ok = prefs.getBytesLength(CALIB_KEY) == sizeof(stored) &&
+            prefs.getBytes(CALIB_KEY, &stored, sizeof(stored)) ==
+                sizeof(stored) &&
+            stored.version == CALIB_VERSION;
+  prefs.end();
+  if (ok)
+    c = stored;
+  return ok;
+}
+
+inline bool calibSave(const CalibrationData &c) {
+  Preferences prefs;
+  if (!prefs.begin(CALIB_NAMESPACE, false))
+    return false;
+  bool ok = prefs.putBytes(CALIB_KEY, &c, sizeof(c)) == sizeof(c);
+  prefs.end();
+  return ok;
+}
+
+inline bool calibClear() {
+  Preferences prefs;
+  if (!prefs.begin(CALIB_NAMESPACE, false))
+    return false;
+  bool ok = prefs.remove(CALIB_KEY);
+  prefs.end();
+  return ok;
+}
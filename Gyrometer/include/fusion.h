@@ -0,0 +1,503 @@
+#pragma once
+// ── Sensor fusion ──
+// Pluggable orientation filters behind one interface:
+//   MadgwickFilter          — port of Arduino MadgwickAHRS (same gain and
+//                             angle conventions, quaternion exposed)
+//   FixedMadgwickFilter     — the same kernel in Q7.24 fixed point
+//   AdaptiveMadgwickFilter  — Madgwick with beta scheduled on startup time
+//                             and on how close |accel| is to 1 g
+//   MahonyFilter            — port of Arduino MahonyAHRS (PI feedback)
+//   ComplementaryFilter     — gyro integration + algebraic accel/mag
+//                             correction blended with fixed gains
+// All share the earth frame of Madgwick (x = magnetic north, z = up).
+// Inputs: gyro in deg/s, accel in g (the adaptive gain relies on it),
+// mag in any unit.
+
+#include "fusion_kernel.h"
+#include "quaternion.h"
+#include <math.h>
+#include <stdint.h>
+
+#define MADGWICK_BETA_DEFAULT 0.1f
+#define MAHONY_TWO_KP_DEFAULT (2.0f * 0.5f)
+#define MAHONY_TWO_KI_DEFAULT (2.0f * 0.0f)
+// Fraction of the accel / mag error angle removed per update
+#define COMPLEMENTARY_ACC_GAIN_DEFAULT 0.04f
+#define COMPLEMENTARY_MAG_GAIN_DEFAULT 0.02f
+
+// FUSION_FILTER selection values
+#define FUSION_MADGWICK 0
+#define FUSION_MAHONY 1
+#define FUSION_COMPLEMENTARY 2
+#define FUSION_MADGWICK_ADAPTIVE 3
+#define FUSION_MADGWICK_FIXED 4
+
+// ── Common interface ──
+class FusionFilter {
+public:
+  virtual ~FusionFilter() {}
+  virtual const char *name() const = 0;
+
+  void begin(float sampleFrequency) { invSampleFreq = 1.0f / sampleFrequency; }
+  float sampleFrequency() const { return 1.0f / invSampleFreq; }
+
+  // 9-axis update; an all-zero mag vector falls back to updateIMU()
+  virtual void update(float gx, float gy, float gz, float ax, float ay,
+                      float az, float mx, float my, float mz) = 0;
+  // 6-axis update (accel + gyro)
+  virtual void updateIMU(float gx, float gy, float gz, float ax, float ay,
+                         float az) = 0;
+
+  // Back to identity orientation and initial gains
+  virtual void reset() {
+    q0 = 1.0f;
+    q1 = q2 = q3 = 0.0f;
+    anglesComputed = false;
+  }
+
+  Quat quaternion() const { return {q0, q1, q2, q3}; }
+
+  // Degrees, MadgwickAHRS conventions (yaw in [0, 360))
+  float getRoll() {
+    computeAngles();
+    return roll;
+  }
+  float getPitch() {
+    computeAngles();
+    return pitch;
+  }
+  float getYaw() {
+    computeAngles();
+    return yaw;
+  }
+
+protected:
+  void normalizeQuat() {
+    float recipNorm = fusionInvSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+    q0 *= recipNorm;
+    q1 *= recipNorm;
+    q2 *= recipNorm;
+    q3 *= recipNorm;
+    anglesComputed = false;
+  }
+  // For filters that update q0..q3 without normalizeQuat()
+  void quaternionChanged() { anglesComputed = false; }
+
+  float q0 = 1.0f, q1 = 0.0f, q2 = 0.0f, q3 = 0.0f;
+  float invSampleFreq = 1.0f / 512.0f;
+
+private:
+  void computeAngles() {
+    if (!anglesComputed) {
+      quatToEulerDeg(quaternion(), roll, pitch, yaw);
+      anglesComputed = true;
+    }
+  }
+
+  float roll = 0, pitch = 0, yaw = 0;
+  bool anglesComputed = false;
+};
+
+// ── Madgwick (gradient descent) ──
+class MadgwickFilter : public FusionFilter {
+public:
+  const char *name() const override { return "madgwick"; }
+  void setBeta(float b) { beta = b; }
+  float getBeta() const { return beta; }
+
+  void update(float gx, float gy, float gz, float ax, float ay, float az,
+              float mx, float my, float mz) override {
+    // Use IMU algorithm if magnetometer measurement invalid (avoids NaN in
+    // magnetometer normalisation)
+    if ((mx == 0.0f) && (my == 0.0f) && (mz == 0.0f)) {
+      updateIMU(gx, gy, gz, ax, ay, az);
+      return;
+    }
+    madgwickStep<float, true>(q0, q1, q2, q3, gx * 0.0174533f,
+                              gy * 0.0174533f, gz * 0.0174533f, ax, ay, az,
+                              mx, my, mz, beta, invSampleFreq);
+    quaternionChanged();
+  }
+  void updateIMU(float gx, float gy, float gz, float ax, float ay,
+                 float az) override {
+    madgwickStep<float, false>(q0, q1, q2, q3, gx * 0.0174533f,
+                               gy * 0.0174533f, gz * 0.0174533f, ax, ay, az,
+                               0.0f, 0.0f, 0.0f, beta, invSampleFreq);
+    quaternionChanged();
+  }
+
+protected:
+  float beta = MADGWICK_BETA_DEFAULT;
+};
+
+// ── Madgwick in Q7.24 fixed point ──
+// Same kernel instantiated on Q24; floats only at the interface. Here to
+// measure against the FPU build, not because the S3 needs it. Accel and mag
+// magnitudes must stay below 128 (g and µT are fine).
+class FixedMadgwickFilter : public FusionFilter {
+public:
+  const char *name() const override { return "madgwick-q24"; }
+  void setBeta(float b) { beta = Q24(b); }
+
+  void update(float gx, float gy, float gz, float ax, float ay, float az,
+              float mx, float my, float mz) override {
+    if ((mx == 0.0f) && (my == 0.0f) && (mz == 0.0f)) {
+      updateIMU(gx, gy, gz, ax, ay, az);
+      return;
+    }
+    madgwickStep<Q24, true>(fq[0], fq[1], fq[2], fq[3], Q24(gx * 0.0174533f),
+                            Q24(gy * 0.0174533f), Q24(gz * 0.0174533f),
+                            Q24(ax), Q24(ay), Q24(az), Q24(mx), Q24(my),
+                            Q24(mz), beta, Q24(invSampleFreq));
+    publish();
+  }
+  void updateIMU(float gx, float gy, float gz, float ax, float ay,
+                 float az) override {
+    madgwickStep<Q24, false>(fq[0], fq[1], fq[2], fq[3], Q24(gx * 0.0174533f),
+                             Q24(gy * 0.0174533f), Q24(gz * 0.0174533f),
+                             Q24(ax), Q24(ay), Q24(az), Q24(), Q24(), Q24(),
+                             beta, Q24(invSampleFreq));
+    publish();
+  }
+  void reset() override {
+    FusionFilter::reset();
+    fq[0] = Q24(1.0f);
+    fq[1] = fq[2] = fq[3] = Q24();
+  }
+
+private:
+  void publish() {
+    q0 = fq[0].toFloat();
+    q1 = fq[1].toFloat();
+    q2 = fq[2].toFloat();
+    q3 = fq[3].toFloat();
+    quaternionChanged();
+  }
+
+  Q24 fq[4] = {Q24(1.0f), Q24(), Q24(), Q24()};
+  Q24 beta = Q24(MADGWICK_BETA_DEFAULT);
+};
+
+// ── Madgwick with scheduled beta ──
+// High gain during the first seconds (fast convergence from identity) and
+// whenever the accelerometer reads ≈1 g (it then measures gravity only);
+// low gain while the device is accelerating, where the accel "tilt" is wrong
+// and the gyro should be trusted.
+class AdaptiveMadgwickFilter : public MadgwickFilter {
+public:
+  const char *name() const override { return "madgwick-adapt"; }
+
+  void configure(float betaStill, float betaMotion, float betaStartup,
+                 float startupSeconds, float accelToleranceG) {
+    this->betaStill = betaStill;
+    this->betaMotion = betaMotion;
+    this->betaStartup = betaStartup;
+    this->startupSeconds = startupSeconds;
+    this->accelTolerance = accelToleranceG;
+  }
+  // Gain while the accelerometer reads 1 g; the others are left alone
+  void setStillBeta(float b) { betaStill = b; }
+  float getStillBeta() const { return betaStill; }
+
+  void update(float gx, float gy, float gz, float ax, float ay, float az,
+              float mx, float my, float mz) override {
+    adapt(ax, ay, az);
+    MadgwickFilter::update(gx, gy, gz, ax, ay, az, mx, my, mz);
+  }
+  void updateIMU(float gx, float gy, float gz, float ax, float ay,
+                 float az) override {
+    adapt(ax, ay, az);
+    MadgwickFilter::updateIMU(gx, gy, gz, ax, ay, az);
+  }
+  void reset() override {
+    MadgwickFilter::reset();
+    elapsed = 0.0f;
+  }
+
+private:
+  void adapt(float ax, float ay, float az) {
+    if (elapsed < startupSeconds) {
+      elapsed += invSampleFreq;
+      beta = betaStartup;
+      return;
+    }
+    // 1 at exactly 1 g, falling linearly to 0 at ±accelTolerance
+    float err = fabsf(sqrtf(ax * ax + ay * ay + az * az) - 1.0f);
+    float w = err < accelTolerance ? 1.0f - err / accelTolerance : 0.0f;
+    beta = betaMotion + (betaStill - betaMotion) * w;
+  }
+
+  float betaStill = 0.2f;
+  float betaMotion = 0.02f;
+  float betaStartup = 2.5f;
+  float startupSeconds = 2.0f;
+  float accelTolerance = 0.15f;
+  float elapsed = 0.0f;
+};
+
+// ── Mahony (nonlinear complementary, PI feedback) ──
+class MahonyFilter : public FusionFilter {
+public:
+  const char *name() const override { return "mahony"; }
+  void setGains(float twoKp, float twoKi) {
+    this->twoKp = twoKp;
+    this->twoKi = twoKi;
+  }
+
+  void update(float gx, float gy, float gz, float ax, float ay, float az,
+              float mx, float my, float mz) override;
+  void updateIMU(float gx, float gy, float gz, float ax, float ay,
+                 float az) override;
+  void reset() override {
+    FusionFilter::reset();
+    integralFBx = integralFBy = integralFBz = 0.0f;
+  }
+
+private:
+  void applyFeedback(float &gx, float &gy, float &gz, float halfex,
+                     float halfey, float halfez);
+  void integrate(float gx, float gy, float gz);
+
+  float twoKp = MAHONY_TWO_KP_DEFAULT;
+  float twoKi = MAHONY_TWO_KI_DEFAULT;
+  float integralFBx = 0.0f, integralFBy = 0.0f, integralFBz = 0.0f;
+};
+
+// ── Complementary ──
+// Integrates the gyro, then rotates the estimate a fixed fraction (the gain)
+// of the error angle towards the accel (gravity) and mag (north) references,
+// whatever the size of the error. Corrections are built algebraically from
+// vector pairs, so there is no trig per update.
+class ComplementaryFilter : public FusionFilter {
+public:
+  const char *name() const override { return "complementary"; }
+  void setGains(float accGain, float magGain) {
+    this->accGain = accGain;
+    this->magGain = magGain;
+  }
+
+  void update(float gx, float gy, float gz, float ax, float ay, float az,
+              float mx, float my, float mz) override {
+    if ((mx == 0.0f) && (my == 0.0f) && (mz == 0.0f)) {
+      updateIMU(gx, gy, gz, ax, ay, az);
+      return;
+    }
+    updateIMU(gx, gy, gz, ax, ay, az);
+    correctMag(mx, my, mz);
+  }
+
+  void updateIMU(float gx, float gy, float gz, float ax, float ay,
+                 float az) override {
+    predict(gx, gy, gz);
+    if (!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f)))
+      correctAccel(ax, ay, az);
+  }
+
+private:
+  void predict(float gx, float gy, float gz);
+  void correctAccel(float ax, float ay, float az);
+  void correctMag(float mx, float my, float mz);
+  // Earth-frame correction dq (any length; normalized, then identity-blended
+  // by gain) applied on the left
+  void applyCorrection(float dw, float dx, float dy, float dz, float gain);
+
+  float accGain = COMPLEMENTARY_ACC_GAIN_DEFAULT;
+  float magGain = COMPLEMENTARY_MAG_GAIN_DEFAULT;
+};
+
+// ── Mahony implementation ──
+inline void MahonyFilter::applyFeedback(float &gx, float &gy, float &gz,
+                                        float halfex, float halfey,
+                                        float halfez) {
+  // Compute and apply integral feedback if enabled
+  if (twoKi > 0.0f) {
+    integralFBx += twoKi * halfex * invSampleFreq;
+    integralFBy += twoKi * halfey * invSampleFreq;
+    integralFBz += twoKi * halfez * invSampleFreq;
+    gx += integralFBx;
+    gy += integralFBy;
+    gz += integralFBz;
+  } else {
+    integralFBx = integralFBy = integralFBz = 0.0f;
+  }
+  // Apply proportional feedback
+  gx += twoKp * halfex;
+  gy += twoKp * halfey;
+  gz += twoKp * halfez;
+}
+
+inline void MahonyFilter::integrate(float gx, float gy, float gz) {
+  // Integrate rate of change of quaternion
+  gx *= (0.5f * invSampleFreq);
+  gy *= (0.5f * invSampleFreq);
+  gz *= (0.5f * invSampleFreq);
+  float qa = q0, qb = q1, qc = q2;
+  q0 += (-qb * gx - qc * gy - q3 * gz);
+  q1 += (qa * gx + qc * gz - q3 * gy);
+  q2 += (qa * gy - qb * gz + q3 * gx);
+  q3 += (qa * gz + qb * gy - qc * gx);
+  normalizeQuat();
+}
+
+inline void MahonyFilter::update(float gx, float gy, float gz, float ax,
+                                 float ay, float az, float mx, float my,
+                                 float mz) {
+  if ((mx == 0.0f) && (my == 0.0f) && (mz == 0.0f)) {
+    updateIMU(gx, gy, gz, ax, ay, az);
+    return;
+  }
+
+  gx *= 0.0174533f;
+  gy *= 0.0174533f;
+  gz *= 0.0174533f;
+
+  if (!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) {
+    float recipNorm = fusionInvSqrt(ax * ax + ay * ay + az * az);
+    ax *= recipNorm;
+    ay *= recipNorm;
+    az *= recipNorm;
+
+    recipNorm = fusionInvSqrt(mx * mx + my * my + mz * mz);
+    mx *= recipNorm;
+    my *= recipNorm;
+    mz *= recipNorm;
+
+    float q0q0 = q0 * q0;
+    float q0q1 = q0 * q1;
+    float q0q2 = q0 * q2;
+    float q0q3 = q0 * q3;
+    float q1q1 = q1 * q1;
+    float q1q2 = q1 * q2;
+    float q1q3 = q1 * q3;
+    float q2q2 = q2 * q2;
+    float q2q3 = q2 * q3;
+    float q3q3 = q3 * q3;
+
+    // Reference direction of Earth's magnetic field
+    float hx = 2.0f * (mx * (0.5f - q2q2 - q3q3) + my * (q1q2 - q0q3) +
+                       mz * (q1q3 + q0q2));
+    float hy = 2.0f * (mx * (q1q2 + q0q3) + my * (0.5f - q1q1 - q3q3) +
+                       mz * (q2q3 - q0q1));
+    float bx = sqrtf(hx * hx + hy * hy);
+    float bz = 2.0f * (mx * (q1q3 - q0q2) + my * (q2q3 + q0q1) +
+                       mz * (0.5f - q1q1 - q2q2));
+
+    // Estimated direction of gravity and magnetic field
+    float halfvx = q1q3 - q0q2;
+    float halfvy = q0q1 + q2q3;
+    float halfvz = q0q0 - 0.5f + q3q3;
+    float halfwx = bx * (0.5f - q2q2 - q3q3) + bz * (q1q3 - q0q2);
+    float halfwy = bx * (q1q2 - q0q3) + bz * (q0q1 + q2q3);
+    float halfwz = bx * (q0q2 + q1q3) + bz * (0.5f - q1q1 - q2q2);
+
+    // Error is sum of cross product between estimated direction and
+    // measured direction of field vectors
+    float halfex = (ay * halfvz - az * halfvy) + (my * halfwz - mz * halfwy);
+    float halfey = (az * halfvx - ax * halfvz) + (mz * halfwx - mx * halfwz);
+    float halfez = (ax * halfvy - ay * halfvx) + (mx * halfwy - my * halfwx);
+    applyFeedback(gx, gy, gz, halfex, halfey, halfez);
+  }
+
+  integrate(gx, gy, gz);
+}
+
+inline void MahonyFilter::updateIMU(float gx, float gy, float gz, float ax,
+                                    float ay, float az) {
+  gx *= 0.0174533f;
+  gy *= 0.0174533f;
+  gz *= 0.0174533f;
+
+  if (!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) {
+    float recipNorm = fusionInvSqrt(ax * ax + ay * ay + az * az);
+    ax *= recipNorm;
+    ay *= recipNorm;
+    az *= recipNorm;
+
+    // Estimated direction of gravity
+    float halfvx = q1 * q3 - q0 * q2;
+    float halfvy = q0 * q1 + q2 * q3;
+    float halfvz = q0 * q0 - 0.5f + q3 * q3;
+
+    // Error is sum of cross product between estimated and measured
+    // direction of gravity
+    float halfex = (ay * halfvz - az * halfvy);
+    float halfey = (az * halfvx - ax * halfvz);
+    float halfez = (ax * halfvy - ay * halfvx);
+    applyFeedback(gx, gy, gz, halfex, halfey, halfez);
+  }
+
+  integrate(gx, gy, gz);
+}
+
+// ── Complementary implementation ──
+inline void ComplementaryFilter::predict(float gx, float gy, float gz) {
+  gx *= 0.0174533f * 0.5f * invSampleFreq;
+  gy *= 0.0174533f * 0.5f * invSampleFreq;
+  gz *= 0.0174533f * 0.5f * invSampleFreq;
+  float qa = q0, qb = q1, qc = q2;
+  q0 += (-qb * gx - qc * gy - q3 * gz);
+  q1 += (qa * gx + qc * gz - q3 * gy);
+  q2 += (qa * gy - qb * gz + q3 * gx);
+  q3 += (qa * gz + qb * gy - qc * gx);
+  normalizeQuat();
+}
+
+inline void ComplementaryFilter::applyCorrection(float dw, float dx, float dy,
+                                                 float dz, float gain) {
+  // nlerp(identity, dq / |dq|, gain): about gain x the error angle. The
+  // callers' (1 + cos, sin axis) form has length sqrt(2 (1 + cos)), which
+  // would otherwise scale the step with the error
+  const float scale =
+      gain * fusionInvSqrt(dw * dw + dx * dx + dy * dy + dz * dz);
+  dw = 1.0f - gain + scale * dw;
+  dx *= scale;
+  dy *= scale;
+  dz *= scale;
+  float a = q0, b = q1, c = q2, d = q3;
+  q0 = dw * a - dx * b - dy * c - dz * d;
+  q1 = dw * b + dx * a + dy * d - dz * c;
+  q2 = dw * c - dx * d + dy * a + dz * b;
+  q3 = dw * d + dx * c - dy * b + dz * a;
+  normalizeQuat();
+}
+
+inline void ComplementaryFilter::correctAccel(float ax, float ay, float az) {
+  float recipNorm = fusionInvSqrt(ax * ax + ay * ay + az * az);
+  ax *= recipNorm;
+  ay *= recipNorm;
+  az *= recipNorm;
+
+  // Measured gravity rotated into the earth frame: v = q a q*
+  float vx = (1.0f - 2.0f * (q2 * q2 + q3 * q3)) * ax +
+             2.0f * (q1 * q2 - q0 * q3) * ay + 2.0f * (q1 * q3 + q0 * q2) * az;
+  float vy = 2.0f * (q1 * q2 + q0 * q3) * ax +
+             (1.0f - 2.0f * (q1 * q1 + q3 * q3)) * ay +
+             2.0f * (q2 * q3 - q0 * q1) * az;
+  float vz = 2.0f * (q1 * q3 - q0 * q2) * ax + 2.0f * (q2 * q3 + q0 * q1) * ay +
+             (1.0f - 2.0f * (q1 * q1 + q2 * q2)) * az;
+
+  // Shortest rotation taking v onto +z: (1 + v·z, v × z)
+  if (vz < -0.99f)
+    return; // upside-down estimate: correction axis undefined this sample
+  applyCorrection(1.0f + vz, vy, -vx, 0.0f, accGain);
+}
+
+inline void ComplementaryFilter::correctMag(float mx, float my, float mz) {
+  // Earth-frame mag, horizontal part only (tilt already handled above)
+  float lx = (1.0f - 2.0f * (q2 * q2 + q3 * q3)) * mx +
+             2.0f * (q1 * q2 - q0 * q3) * my + 2.0f * (q1 * q3 + q0 * q2) * mz;
+  float ly = 2.0f * (q1 * q2 + q0 * q3) * mx +
+             (1.0f - 2.0f * (q1 * q1 + q3 * q3)) * my +
+             2.0f * (q2 * q3 - q0 * q1) * mz;
+  float gamma = lx * lx + ly * ly;
+  if (gamma <= 0.0f)
+    return;
+  float recipNorm = fusionInvSqrt(gamma);
+  lx *= recipNorm;
+  ly *= recipNorm;
+  if (lx < -0.99f)
+    return; // heading ~180° off: rotation axis ambiguous this sample
+
+  // Shortest rotation about z taking (lx, ly) onto +x (magnetic north)
+  applyCorrection(1.0f + lx, 0.0f, 0.0f, -ly, magGain);
+}
@@ -0,0 +1,266 @@
+#pragma once
+// ── Madgwick kernel ──
+// The gradient-descent update from MadgwickAHRS written once over a scalar
+// type and specialised at compile time:
+//   madgwickStep<float, true>   9-axis, hardware float
+//   madgwickStep<float, false>  6-axis, no mag code or branch at all
+//   madgwickStep<Q24, ...>      same maths in Q7.24 fixed point
+// Gyro in rad/s, accel/mag in any unit, dt in seconds. The quaternion is
+// updated in place and left normalised.
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// Inverse square root used by every float filter
+//   FUSION_INVSQRT_FAST — 0x5f3759df seed + two Newton steps (MadgwickAHRS)
+//   FUSION_INVSQRT_FPU  — 1.0f / sqrtf(x) on the hardware FPU
+#define FUSION_INVSQRT_FAST 0
+#define FUSION_INVSQRT_FPU 1
+#ifndef FUSION_INVSQRT
+#define FUSION_INVSQRT FUSION_INVSQRT_FAST
+#endif
+
+#if FUSION_INVSQRT == FUSION_INVSQRT_FPU
+inline float fusionInvSqrt(float x) { return 1.0f / sqrtf(x); }
+#else
+inline float fusionInvSqrt(float x) {
+  float halfx = 0.5f * x;
+  float y = x;
+  int32_t i;
+  memcpy(&i, &y, sizeof(i));
+  i = 0x5f3759df - (i >> 1);
+  memcpy(&y, &i, sizeof(y));
+  y = y * (1.5f - (halfx * y * y));
+  y = y * (1.5f - (halfx * y * y));
+  return y;
+}
+#endif
+
+inline const char *fusionInvSqrtName() {
+  return FUSION_INVSQRT == FUSION_INVSQRT_FPU ? "fpu" : "fast";
+}
+
+// ── Q7.24 fixed point ──
+// Range ±128, resolution 6e-8. Products go through 64 bits; norms are
+// accumulated in 64 bits so vectors up to |v| < 128 normalise safely.
+struct Q24 {
+  static const int FRAC_BITS = 24;
+  int32_t v;
+
+  Q24() : v(0) {}
+  explicit constexpr Q24(float f)
+      : v((int32_t)(f * (float)(1L << FRAC_BITS) + (f < 0 ? -0.5f : 0.5f))) {}
+  static Q24 raw(int32_t r) {
+    Q24 q;
+    q.v = r;
+    return q;
+  }
+  float toFloat() const { return v * (1.0f / (float)(1L << FRAC_BITS)); }
+
+  Q24 operator+(Q24 o) const { return raw(v + o.v); }
+  Q24 operator-(Q24 o) const { return raw(v - o.v); }
+  Q24 operator-() const { return raw(-v); }
+  Q24 operator*(Q24 o) const {
+    return raw((int32_t)(((int64_t)v * o.v) >> FRAC_BITS));
+  }
+  Q24 &operator+=(Q24 o) {
+    v += o.v;
+    return *this;
+  }
+  Q24 &operator-=(Q24 o) {
+    v -= o.v;
+    return *this;
+  }
+  Q24 &operator*=(Q24 o) { return *this = *this * o; }
+  bool operator==(Q24 o) const { return v == o.v; }
+};
+
+// floor(sqrt(x)) for 64-bit x, bit by bit (no divide, no FPU)
+inline uint32_t fusionIsqrt64(uint64_t x) {
+  uint64_t res = 0;
+  uint64_t bit = (uint64_t)1 << 62;
+  while (bit > x)
+    bit >>= 2;
+  while (bit) {
+    if (x >= res + bit) {
+      x -= res + bit;
+      res = (res >> 1) + bit;
+    } else {
+      res >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (uint32_t)res;
+}
+
+// ── Scalar hooks used by the kernel ──
+inline float fusionSqrt(float x) { return sqrtf(x); }
+inline Q24 fusionSqrt(Q24 x) {
+  return Q24::raw(
+      (int32_t)fusionIsqrt64((uint64_t)(int64_t)x.v << Q24::FRAC_BITS));
+}
+
+inline void fusionNormalize(float &x, float &y, float &z) {
+  float n2 = x * x + y * y + z * z;
+  if (n2 <= 0.0f)
+    return;
+  float r = fusionInvSqrt(n2);
+  x *= r;
+  y *= r;
+  z *= r;
+}
+
+inline void fusionNormalize(float &w, float &x, float &y, float &z) {
+  float n2 = w * w + x * x + y * y + z * z;
+  if (n2 <= 0.0f)
+    return;
+  float r = fusionInvSqrt(n2);
+  w *= r;
+  x *= r;
+  y *= r;
+  z *= r;
+}
+
+// v / |v| with |v| from a Q48 sum of squares
+inline void fusionNormalizeQ(Q24 *v, int n) {
+  uint64_t n2 = 0;
+  for (int i = 0; i < n; i++)
+    n2 += (uint64_t)((int64_t)v[i].v * v[i].v);
+  uint32_t norm = fusionIsqrt64(n2); // Q24
+  if (norm == 0)
+    return;
+  int64_t recip = ((int64_t)1 << (2 * Q24::FRAC_BITS)) / norm; // Q24
+  for (int i = 0; i < n; i++)
+    v[i].v = (int32_t)(((int64_t)v[i].v * recip) >> Q24::FRAC_BITS);
+}
+
+inline void fusionNormalize(Q24 &x, Q24 &y, Q24 &z) {
+  Q24 v[3] = {x, y, z};
+  fusionNormalizeQ(v, 3);
+  x = v[0];
+  y = v[1];
+  z = v[2];
+}
+
+inline void fusionNormalize(Q24 &w, Q24 &x, Q24 &y, Q24 &z) {
+  Q24 v[4] = {w, x, y, z};
+  fusionNormalizeQ(v, 4);
+  w = v[0];
+  x = v[1];
+  y = v[2];
+  z = v[3];
+}
+
+// ── Kernel ──
+template <typename T, bool WithMag>
+inline void madgwickStep(T &q0, T &q1, T &q2, T &q3, T gx, T gy, T gz, T ax,
+                         T ay, T az, T mx, T my, T mz, T beta, T dt) {
+  const T zero(0.0f), half(0.5f), one(1.0f), two(2.0f), four(4.0f),
+      eight(8.0f);
+
+  // Rate of change of quaternion from gyroscope
+  T qDot1 = half * (-q1 * gx - q2 * gy - q3 * gz);
+  T qDot2 = half * (q0 * gx + q2 * gz - q3 * gy);
+  T qDot3 = half * (q0 * gy - q1 * gz + q3 * gx);
+  T qDot4 = half * (q0 * gz + q1 * gy - q2 * gx);
+
+  // Feedback only if accelerometer measurement valid (avoids NaN in
+  // accelerometer normalisation)
+  if (!((ax == zero) && (ay == zero) && (az == zero))) {
+    fusionNormalize(ax, ay, az);
+    T s0, s1, s2, s3;
+
+    if (WithMag) {
+      fusionNormalize(mx, my, mz);
+
+      // Auxiliary variables to avoid repeated arithmetic
+      T _2q0mx = two * q0 * mx;
+      T _2q0my = two * q0 * my;
+      T _2q0mz = two * q0 * mz;
+      T _2q1mx = two * q1 * mx;
+      T _2q0 = two * q0;
+      T _2q1 = two * q1;
+      T _2q2 = two * q2;
+      T _2q3 = two * q3;
+      T _2q0q2 = two * q0 * q2;
+      T _2q2q3 = two * q2 * q3;
+      T q0q0 = q0 * q0;
+      T q0q1 = q0 * q1;
+      T q0q2 = q0 * q2;
+      T q0q3 = q0 * q3;
+      T q1q1 = q1 * q1;
+      T q1q2 = q1 * q2;
+      T q1q3 = q1 * q3;
+      T q2q2 = q2 * q2;
+      T q2q3 = q2 * q3;
+      T q3q3 = q3 * q3;
+
+      // Reference direction of Earth's magnetic field
+      T hx = mx * q0q0 - _2q0my * q3 + _2q0mz * q2 + mx * q1q1 +
+             _2q1 * my * q2 + _2q1 * mz * q3 - mx * q2q2 - mx * q3q3;
+      T hy = _2q0mx * q3 + my * q0q0 - _2q0mz * q1 + _2q1mx * q2 -
+             my * q1q1 + my * q2q2 + _2q2 * mz * q3 - my * q3q3;
+      T _2bx = fusionSqrt(hx * hx + hy * hy);
+      T _2bz = -_2q0mx * q2 + _2q0my * q1 + mz * q0q0 + _2q1mx * q3 -
+               mz * q1q1 + _2q2 * my * q3 - mz * q2q2 + mz * q3q3;
+      T _4bx = two * _2bx;
+      T _4bz = two * _2bz;
+
+      // Gradient descent algorithm corrective step
+      T ex = _2bx * (half - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx;
+      T ey = _2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my;
+      T ez = _2bx * (q0q2 + q1q3) + _2bz * (half - q1q1 - q2q2) - mz;
+      T fx = two * q1q3 - _2q0q2 - ax;
+      T fy = two * q0q1 + _2q2q3 - ay;
+      T fz = one - two * q1q1 - two * q2q2 - az;
+      s0 = -_2q2 * fx + _2q1 * fy - _2bz * q2 * ex +
+           (-_2bx * q3 + _2bz * q1) * ey + _2bx * q2 * ez;
+      s1 = _2q3 * fx + _2q0 * fy - four * q1 * fz + _2bz * q3 * ex +
+           (_2bx * q2 + _2bz * q0) * ey + (_2bx * q3 - _4bz * q1) * ez;
+      s2 = -_2q0 * fx + _2q3 * fy - four * q2 * fz +
+           (-_4bx * q2 - _2bz * q0) * ex + (_2bx * q1 + _2bz * q3) * ey +
+           (_2bx * q0 - _4bz * q2) * ez;
+      s3 = _2q1 * fx + _2q2 * fy + (-_4bx * q3 + _2bz * q1) * ex +
+           (-_2bx * q0 + _2bz * q2) * ey + _2bx * q1 * ez;
+    } else {
+      // Auxiliary variables to avoid repeated arithmetic
+      T _2q0 = two * q0;
+      T _2q1 = two * q1;
+      T _2q2 = two * q2;
+      T _2q3 = two * q3;
+      T _4q0 = four * q0;
+      T _4q1 = four * q1;
+      T _4q2 = four * q2;
+      T _8q1 = eight * q1;
+      T _8q2 = eight * q2;
+      T q0q0 = q0 * q0;
+      T q1q1 = q1 * q1;
+      T q2q2 = q2 * q2;
+      T q3q3 = q3 * q3;
+
+      // Gradient descent algorithm corrective step
+      s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+      s1 = _4q1 * q3q3 - _2q3 * ax + four * q0q0 * q1 - _2q0 * ay - _4q1 +
+           _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+      s2 = four * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 +
+           _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+      s3 = four * q1q1 * q3 - _2q1 * ax + four * q2q2 * q3 - _2q2 * ay;
+    }
+    fusionNormalize(s0, s1, s2, s3);
+
+    // Apply feedback step
+    qDot1 -= beta * s0;
+    qDot2 -= beta * s1;
+    qDot3 -= beta * s2;
+    qDot4 -= beta * s3;
+  }
+
+  // Integrate rate of change of quaternion to yield quaternion
+  q0 += qDot1 * dt;
+  q1 += qDot2 * dt;
+  q2 += qDot3 * dt;
+  q3 += qDot4 * dt;
+
+  fusionNormalize(q0, q1, q2, q3);
+}
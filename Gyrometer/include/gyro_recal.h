@@ -0,0 +1,64 @@
+#pragma once
+// ── Background gyro bias tracking ──
+// A device at rest reads its own gyro bias. Samples (already offset-corrected,
+// deg/s and g) are accumulated while every axis stays under `maxRateDps` and
+// |a| stays within `accTolG` of 1 g; any motion restarts the window. A full
+// window whose spread is at the noise floor yields the mean as the residual
+// bias to fold into the offsets. Hand tremor, slow turns and vibration all
+// fail the rate or spread test, so only a device set down on a surface
+// re-calibrates.
+
+#include <math.h>
+#include <stdint.h>
+
+class GyroBiasTracker {
+public:
+  GyroBiasTracker(uint16_t windowSamples, float maxRateDps = 2.0f,
+                  float maxStdDps = 0.25f, float accTolG = 0.05f)
+      : window(windowSamples), maxRate(maxRateDps),
+        maxVar(maxStdDps * maxStdDps), accTol(accTolG) {
+    restart();
+  }
+
+  // True when a still window just completed; bias() holds its mean (deg/s)
+  bool add(float ax, float ay, float az, float gx, float gy, float gz) {
+    const float an = sqrtf(ax * ax + ay * ay + az * az);
+    if (fabsf(gx) > maxRate || fabsf(gy) > maxRate || fabsf(gz) > maxRate ||
+        fabsf(an - 1.0f) > accTol) {
+      restart();
+      return false;
+    }
+    const float g[3] = {gx, gy, gz};
+    for (int i = 0; i < 3; i++) {
+      sum[i] += g[i];
+      sumSq[i] += g[i] * g[i];
+    }
+    if (++n < window)
+      return false;
+
+    bool quiet = true;
+    for (int i = 0; i < 3; i++) {
+      float mean = sum[i] / n;
+      float var = sumSq[i] / n - mean * mean;
+      quiet = quiet && var <= maxVar;
+      biasDps[i] = mean;
+    }
+    restart();
+    return quiet;
+  }
+
+  float bias(int axis) const { return biasDps[axis]; }
+
+  void restart() {
+    n = 0;
+    for (int i = 0; i < 3; i++)
+      sum[i] = sumSq[i] = 0.0f;
+  }
+
+private:
+  uint16_t window;
+  float maxRate, maxVar, accTol;
+  uint16_t n;
+  float sum[3], sumSq[3];
+  float biasDps[3] = {0, 0, 0};
+};
@@ -0,0 +1,69 @@
+#pragma once
+// ── HID mouse output over native USB and BLE ──
+// The device shows up as a mouse on up to two links at once and reports on
+// the best one that has a host: USB once a host has configured it (wired,
+// 1 ms polling), else BLE once a central has connected and subscribed
+// (NimBLE, connection interval negotiated down to POINTER_BLE_INTERVAL).
+// With neither, link() is POINTER_LINK_NONE and the UDP/serial stream is the
+// only output, as before.
+//
+// BLE sends at most one report per connection interval: motion that arrives
+// in between is summed by the caller (PointerEngine) and goes out in the
+// next connection event, so a 1 kHz sensor never queues more notifications
+// than the link can carry.
+//
+// Link state is updated from the USB and BLE stack callbacks and read
+// through atomics; ready() / send() belong to one task.
+
+#include <Arduino.h>
+#include <atomic>
+#include <stdint.h>
+
+enum PointerLink : uint8_t {
+  POINTER_LINK_NONE,
+  POINTER_LINK_USB,
+  POINTER_LINK_BLE,
+};
+
+inline const char *pointerLinkName(PointerLink link) {
+  static const char *const names[] = {"none", "usb", "ble"};
+  return link <= POINTER_LINK_BLE ? names[link] : "?";
+}
+
+class HidPointer {
+public:
+  // bleInterval in 1.25 ms units (6 = 7.5 ms, the BLE minimum); the
+  // central may grant a longer one, which sets the report pacing
+  void begin(bool useUsb, bool useBle, const char *bleName,
+             uint16_t bleInterval);
+
+  // Best link with a host right now
+  PointerLink link() const;
+
+  // True when the current link can take a report now
+  bool ready(uint32_t nowUs);
+
+  // µs until ready() may turn true (0 = now or unknown, poll again soon)
+  uint32_t waitUs(uint32_t nowUs) const;
+
+  // One relative mouse report on the current link
+  void send(int8_t dx, int8_t dy);
+
+  // Granted BLE connection interval (µs), 0 when not connected
+  uint32_t bleIntervalUs() const { return bleIntervalUs_; }
+
+  // Link state from the stack callbacks (any task)
+  void onUsbMounted(bool mounted) { usbMounted = mounted; }
+  void onBleConnected(uint32_t intervalUs);
+  void onBleDisconnected();
+  void onBleSubscribed(bool subscribed) { bleSubscribed = subscribed; }
+  void onBleInterval(uint32_t intervalUs) { bleIntervalUs_ = intervalUs; }
+
+private:
+  bool usbEnabled = false, bleEnabled = false;
+  std::atomic<bool> usbMounted{false};
+  std::atomic<bool> bleConnected{false};
+  std::atomic<bool> bleSubscribed{false};
+  std::atomic<uint32_t> bleIntervalUs_{0};
+  uint32_t lastBleSendUs = 0;
+};
@@ -0,0 +1,87 @@
+#pragma once
+// ── I2C device health from real reads ──
+// No probe transactions while a device works: every sensor read reports
+// whether it completed and whether the value moved. A device is declared
+// failed after `failLimit` consecutive bus errors or `stuckLimit` consecutive
+// identical values (real MEMS outputs always carry noise; a dead bus reads
+// back the same bytes). Only then does the owner start probing, paced with
+// exponential backoff so a missing device costs one address probe per
+// backoff interval.
+
+#include <stdint.h>
+
+class DeviceHealth {
+public:
+  DeviceHealth(uint16_t failLimit, uint16_t stuckLimit,
+               uint16_t probeMinMs = 100, uint16_t probeMaxMs = 2000)
+      : failLimit(failLimit), stuckLimit(stuckLimit), probeMinMs(probeMinMs),
+        probeMaxMs(probeMaxMs), backoffMs(probeMinMs) {}
+
+  bool ok() const { return up; }
+
+  // ok = the transfer completed; changed = value differs from the last read
+  void onRead(bool ok, bool changed) {
+    if (!up)
+      return;
+    if (!ok) {
+      stuck = 0;
+      if (++errors >= failLimit)
+        fail();
+      return;
+    }
+    errors = 0;
+    if (changed)
+      stuck = 0;
+    else if (++stuck >= stuckLimit)
+      fail();
+  }
+
+  void fail() {
+    if (!up)
+      return;
+    up = false;
+    failures++;
+    probeFails = 0;
+    backoffMs = probeMinMs;
+    lastProbeMs = 0;
+    probeArmed = false;
+  }
+
+  // Failed devices only: true when the next recovery probe may run
+  bool probeDue(uint32_t nowMs) {
+    if (up)
+      return false;
+    if (probeArmed && nowMs - lastProbeMs < backoffMs)
+      return false;
+    probeArmed = true;
+    lastProbeMs = nowMs;
+    return true;
+  }
+
+  // Outcome of a probe (+ re-init); returns consecutive failed probes
+  uint16_t onProbe(bool recovered) {
+    if (recovered) {
+      up = true;
+      errors = stuck = 0;
+      probeFails = 0;
+      backoffMs = probeMinMs;
+      return 0;
+    }
+    probeFails++;
+    backoffMs = backoffMs * 2 > probeMaxMs ? probeMaxMs : backoffMs * 2;
+    return probeFails;
+  }
+
+  uint32_t failureCount() const { return failures; }
+
+private:
+  uint16_t failLimit, stuckLimit;
+  uint16_t probeMinMs, probeMaxMs;
+  uint16_t errors = 0, stuck = 0;
+  uint16_t probeFails = 0;
+  uint32_t backoffMs;
+  uint32_t lastProbeMs = 0;
+  uint32_t failures = 0;
+  bool up = true;
+  bool probeArmed = false;
+};
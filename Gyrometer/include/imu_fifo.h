@@ -0,0 +1,81 @@
+#pragma once
+// ── MPU6500 FIFO acquisition ──
+// Interrupt-driven, FIFO-batched reader for the MPU6500. The data-ready pin
+// only counts samples; the accel+gyro frames are pulled out of the on-chip
+// FIFO in burst reads and timestamped from the configured sample cadence, so
+// a late loop() iteration delays the batch but never skews sample timing.
+
+#include <Arduino.h>
+#include <MPU6500_WE.h>
+#include <Wire.h>
+
+// One accel+gyro frame as stored in the FIFO (ACCEL_XOUT..GYRO_ZOUT, no temp)
+#define IMU_FIFO_FRAME_BYTES 12
+#define IMU_FIFO_SIZE_BYTES 512
+// ESP32 Arduino Wire buffers 128 bytes per transfer → 10 frames per burst
+#define IMU_FIFO_BURST_FRAMES 10
+
+struct ImuSample {
+  xyzFloat acc;  // g
+  xyzFloat gyr;  // deg/s
+  uint32_t tUs;  // device timestamp derived from the FIFO cadence
+};
+
+class ImuFifo {
+public:
+  explicit ImuFifo(uint8_t addr) : addr(addr) {}
+
+  // Configure FIFO + data-ready interrupt. Sensor ranges, DLPF and divider
+  // must already be set through MPU6500_WE. Returns false on I2C failure.
+  bool begin(TwoWire &wire, int intPin, uint8_t sampleRateDivider,
+             MPU6500_accRange accRange, MPU6500_gyroRange gyrRange);
+
+  // Software offsets as reported by MPU6500_WE::getAccOffsets() /
+  // getGyrOffsets() (raw LSB at 2G / 250 dps, like the library keeps them).
+  void setOffsets(const xyzFloat &accOffset, const xyzFloat &gyrOffset);
+
+  // Task woken (xTaskNotifyGive) on every data-ready edge, or nullptr
+  void setNotifyTask(TaskHandle_t task) { notifyTask = task; }
+
+  // Data-ready interrupts seen since the last drain()
+  uint32_t pending() const { return irqCount - drainedIrqCount; }
+
+  // Burst-read every complete frame currently in the FIFO (up to maxSamples).
+  // Returns the number of samples written to out.
+  size_t drain(ImuSample *out, size_t maxSamples);
+
+  // Discard FIFO contents and restart the timestamp cadence
+  void reset();
+
+  uint32_t periodUs() const { return samplePeriodUs; }
+  float sampleRateHz() const { return 1e6f / samplePeriodUs; }
+  uint32_t overflowCount() const { return overflows; }
+  uint32_t busErrorCount() const { return busErrors; }
+
+private:
+  static void IRAM_ATTR onDataReady();
+  static ImuFifo *instance;
+
+  bool writeReg(uint8_t reg, uint8_t val);
+  bool readRegs(uint8_t reg, uint8_t *buf, size_t len);
+  void decodeFrame(const uint8_t *p, ImuSample &s) const;
+
+  uint8_t addr;
+  TwoWire *bus = nullptr;
+  int intPin = -1;
+  volatile TaskHandle_t notifyTask = nullptr;
+
+  float accScale = 0, gyrScale = 0;         // LSB → g, LSB → deg/s
+  xyzFloat accBias = {0, 0, 0}, gyrBias = {0, 0, 0}; // in output units
+
+  uint32_t samplePeriodUs = 10000;
+  uint32_t nextSampleUs = 0;
+  bool cadenceValid = false;
+
+  volatile uint32_t irqCount = 0;
+  volatile uint32_t lastIrqUs = 0;
+  uint32_t drainedIrqCount = 0;
+
+  uint32_t overflows = 0;
+  uint32_t busErrors = 0;
+};
@@ -0,0 +1,271 @@
+#pragma once
+// ── Incremental ellipsoid fit for magnetometer calibration ──
+// Hard- and soft-iron distortion map the field sphere onto an ellipsoid
+//   A x² + B y² + C z² + 2D xy + 2E xz + 2F yz + 2G x + 2H y + 2I z = 1
+// The nine coefficients are a linear least-squares problem, so only the
+// normal equations (45 + 9 running sums) are kept: memory is O(1) whatever
+// the number of samples, and each sample costs ~60 multiply-adds.
+//
+// fit() turns the quadric into the centre (hard iron) and a symmetric 3x3
+// matrix W = R · sqrt(M) (soft iron) with
+//   corrected = W · (raw − offset),  |corrected| ≈ R
+// where R is the ellipsoid's geometric-mean radius, so the correction keeps
+// the sensor's LSB scale.
+//
+// Coverage: directions from the running min/max centre are binned on a cube
+// map (6 faces × MAG_FIT_FACE_BINS²). A well-conditioned fit wants most bins
+// hit; coverage() is the fraction seen so far.
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MAG_FIT_FACE_BINS 3
+#define MAG_FIT_BINS (6 * MAG_FIT_FACE_BINS * MAG_FIT_FACE_BINS)
+// Raw values are scaled into ~±1 before accumulation (HMC5883L LSB ≲ 2048)
+#define MAG_FIT_INPUT_SCALE (1.0 / 1024.0)
+
+struct MagFitResult {
+  float offset[3];   // raw LSB
+  float softIron[9]; // row-major W
+  float radius;      // raw LSB
+  float residual;    // RMS algebraic residual (0 = perfect ellipsoid)
+};
+
+// corrected = softIron · (raw − offset) · scale, e.g. scale = µT per LSB
+inline void magApplyCalibration(const int16_t *raw, const float *offset,
+                                const float *softIron, float scale,
+                                float *out) {
+  const float dx = raw[0] - offset[0];
+  const float dy = raw[1] - offset[1];
+  const float dz = raw[2] - offset[2];
+  const float *w = softIron;
+  out[0] = (w[0] * dx + w[1] * dy + w[2] * dz) * scale;
+  out[1] = (w[3] * dx + w[4] * dy + w[5] * dz) * scale;
+  out[2] = (w[6] * dx + w[7] * dy + w[8] * dz) * scale;
+}
+
+class MagEllipsoidFit {
+public:
+  MagEllipsoidFit() { reset(); }
+
+  void reset() {
+    memset(ata, 0, sizeof(ata));
+    memset(atb, 0, sizeof(atb));
+    n = 0;
+    bins = 0;
+    for (int i = 0; i < 3; i++) {
+      lo[i] = 32767;
+      hi[i] = -32768;
+    }
+  }
+
+  void add(int16_t rx, int16_t ry, int16_t rz) {
+    const double x = rx * MAG_FIT_INPUT_SCALE, y = ry * MAG_FIT_INPUT_SCALE,
+                 z = rz * MAG_FIT_INPUT_SCALE;
+    const double phi[9] = {x * x,     y * y,     z * z,
+                           2 * x * y, 2 * x * z, 2 * y * z,
+                           2 * x,     2 * y,     2 * z};
+    for (int i = 0; i < 9; i++) {
+      atb[i] += phi[i];
+      for (int j = i; j < 9; j++)
+        ata[i][j] += phi[i] * phi[j];
+    }
+    n++;
+
+    const int16_t r[3] = {rx, ry, rz};
+    for (int i = 0; i < 3; i++) {
+      if (r[i] < lo[i])
+        lo[i] = r[i];
+      if (r[i] > hi[i])
+        hi[i] = r[i];
+    }
+    markCoverage(r);
+  }
+
+  uint32_t samples() const { return n; }
+  float coverage() const {
+    return (float)__builtin_popcountll(bins) / MAG_FIT_BINS;
+  }
+  int16_t minRaw(int axis) const { return lo[axis]; }
+  int16_t maxRaw(int axis) const { return hi[axis]; }
+
+  // False if there are too few samples or the data isn't an ellipsoid
+  bool fit(MagFitResult &out) const {
+    if (n < 9)
+      return false;
+    double a[9][10];
+    for (int i = 0; i < 9; i++) {
+      for (int j = 0; j < 9; j++)
+        a[i][j] = i <= j ? ata[i][j] : ata[j][i];
+      a[i][9] = atb[i];
+    }
+    double p[9];
+    if (!solve(a, p))
+      return false;
+
+    // Algebraic residual from the accumulated sums: |Φp − 1|² =
+    // pᵀ(ΦᵀΦ)p − 2pᵀΦᵀ1 + n
+    double r2 = n;
+    for (int i = 0; i < 9; i++) {
+      r2 -= 2 * p[i] * atb[i];
+      for (int j = 0; j < 9; j++)
+        r2 += p[i] * p[j] * (i <= j ? ata[i][j] : ata[j][i]);
+    }
+
+    double m[3][3] = {{p[0], p[3], p[4]}, {p[3], p[1], p[5]},
+                      {p[4], p[5], p[2]}};
+    const double v[3] = {p[6], p[7], p[8]};
+    double minv[3][3];
+    if (!invert3(m, minv))
+      return false;
+    double c[3];
+    for (int i = 0; i < 3; i++)
+      c[i] = -(minv[i][0] * v[0] + minv[i][1] * v[1] + minv[i][2] * v[2]);
+    // (x − c)ᵀ M (x − c) = 1 + cᵀ M c
+    double k = 1.0;
+    for (int i = 0; i < 3; i++)
+      for (int j = 0; j < 3; j++)
+        k += c[i] * m[i][j] * c[j];
+    if (k <= 0)
+      return false;
+
+    // M / k = V diag(λ) Vᵀ, all λ > 0 for an ellipsoid
+    double evec[3][3], eval[3];
+    for (int i = 0; i < 3; i++)
+      for (int j = 0; j < 3; j++)
+        m[i][j] /= k;
+    eigenSym3(m, evec, eval);
+    if (eval[0] <= 0 || eval[1] <= 0 || eval[2] <= 0)
+      return false;
+    // Semi-axes are 1/sqrt(λ); R is their geometric mean
+    const double radius = 1.0 / cbrt(sqrt(eval[0] * eval[1] * eval[2]));
+
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        double w = 0;
+        for (int e = 0; e < 3; e++)
+          w += evec[i][e] * sqrt(eval[e]) * evec[j][e];
+        out.softIron[3 * i + j] = (float)(radius * w);
+      }
+      out.offset[i] = (float)(c[i] / MAG_FIT_INPUT_SCALE);
+    }
+    out.radius = (float)(radius / MAG_FIT_INPUT_SCALE);
+    out.residual = (float)sqrt(r2 > 0 ? r2 / n : 0.0);
+    return true;
+  }
+
+private:
+  void markCoverage(const int16_t *r) {
+    float d[3];
+    for (int i = 0; i < 3; i++)
+      d[i] = r[i] - 0.5f * (lo[i] + hi[i]);
+    int major = 0;
+    for (int i = 1; i < 3; i++)
+      if (fabsf(d[i]) > fabsf(d[major]))
+        major = i;
+    const float len = fabsf(d[major]);
+    if (len < 1.0f)
+      return;
+    const int face = 2 * major + (d[major] < 0 ? 1 : 0);
+    const float u = d[(major + 1) % 3] / len, w = d[(major + 2) % 3] / len;
+    int bu = (int)((u + 1.0f) * 0.5f * MAG_FIT_FACE_BINS);
+    int bw = (int)((w + 1.0f) * 0.5f * MAG_FIT_FACE_BINS);
+    bu = bu < MAG_FIT_FACE_BINS ? bu : MAG_FIT_FACE_BINS - 1;
+    bw = bw < MAG_FIT_FACE_BINS ? bw : MAG_FIT_FACE_BINS - 1;
+    const int bin =
+        (face * MAG_FIT_FACE_BINS + bu) * MAG_FIT_FACE_BINS + bw;
+    bins |= (uint64_t)1 << bin;
+  }
+
+  // Gaussian elimination with partial pivoting on [A | b]
+  static bool solve(double a[9][10], double *x) {
+    for (int col = 0; col < 9; col++) {
+      int piv = col;
+      for (int r = col + 1; r < 9; r++)
+        if (fabs(a[r][col]) > fabs(a[piv][col]))
+          piv = r;
+      if (fabs(a[piv][col]) < 1e-12)
+        return false;
+      if (piv != col)
+        for (int j = 0; j < 10; j++) {
+          double t = a[col][j];
+          a[col][j] = a[piv][j];
+          a[piv][j] = t;
+        }
+      for (int r = col + 1; r < 9; r++) {
+        const double f = a[r][col] / a[col][col];
+        for (int j = col; j < 10; j++)
+          a[r][j] -= f * a[col][j];
+      }
+    }
+    for (int r = 8; r >= 0; r--) {
+      double s = a[r][9];
+      for (int j = r + 1; j < 9; j++)
+        s -= a[r][j] * x[j];
+      x[r] = s / a[r][r];
+    }
+    return true;
+  }
+
+  static bool invert3(const double m[3][3], double inv[3][3]) {
+    const double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+                       m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+                       m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    if (fabs(det) < 1e-18)
+      return false;
+    for (int i = 0; i < 3; i++)
+      for (int j = 0; j < 3; j++) {
+        // Cofactor of (j, i) over the determinant
+        const int r0 = (j + 1) % 3, r1 = (j + 2) % 3;
+        const int c0 = (i + 1) % 3, c1 = (i + 2) % 3;
+        inv[i][j] = (m[r0][c0] * m[r1][c1] - m[r0][c1] * m[r1][c0]) / det;
+      }
+    return true;
+  }
+
+  // Cyclic Jacobi: m = V diag(val) Vᵀ, eigenvectors in V's columns
+  static void eigenSym3(double m[3][3], double v[3][3], double *val) {
+    for (int i = 0; i < 3; i++)
+      for (int j = 0; j < 3; j++)
+        v[i][j] = i == j ? 1.0 : 0.0;
+    for (int sweep = 0; sweep < 16; sweep++) {
+      const double off = m[0][1] * m[0][1] + m[0][2] * m[0][2] +
+                         m[1][2] * m[1][2];
+      if (off < 1e-30)
+        break;
+      for (int p = 0; p < 2; p++)
+        for (int q = p + 1; q < 3; q++) {
+          if (fabs(m[p][q]) < 1e-300)
+            continue;
+          const double theta = (m[q][q] - m[p][p]) / (2 * m[p][q]);
+          const double t = (theta >= 0 ? 1.0 : -1.0) /
+                           (fabs(theta) + sqrt(theta * theta + 1));
+          const double c = 1 / sqrt(t * t + 1), s = t * c;
+          for (int k = 0; k < 3; k++) {
+            const double mkp = m[k][p], mkq = m[k][q];
+            m[k][p] = c * mkp - s * mkq;
+            m[k][q] = s * mkp + c * mkq;
+          }
+          for (int k = 0; k < 3; k++) {
+            const double mpk = m[p][k], mqk = m[q][k];
+            m[p][k] = c * mpk - s * mqk;
+            m[q][k] = s * mpk + c * mqk;
+          }
+          for (int k = 0; k < 3; k++) {
+            const double vkp = v[k][p], vkq = v[k][q];
+            v[k][p] = c * vkp - s * vkq;
+            v[k][q] = s * vkp + c * vkq;
+          }
+        }
+    }
+    for (int i = 0; i < 3; i++)
+      val[i] = m[i][i];
+  }
+
+  double ata[9][9]; // upper triangle used
+  double atb[9];
+  uint32_t n;
+  int16_t lo[3], hi[3];
+  uint64_t bins;
+};
@@ -0,0 +1,95 @@
+#pragma once
+// ── Motion-aware rate and power scaling ──
+// MotionDetector decides whether the device is in use from the samples it
+// already reads (offset-corrected, deg/s and g): any axis above wakeDps or
+// |a| off 1 g by more than accTolG is motion, and only idleAfterUs without
+// any makes it idle. One moving sample ends idle at once, so a pickup is
+// never held back by the hysteresis; the caller can also force it (wake())
+// when the MPU6500 wake-on-motion interrupt fires between two slow samples.
+//
+// FrameSuppressor drops orientation samples that would go out unchanged:
+// equal after fixed-point encoding, or within `deadband` LSB of the last
+// one sent (the caller widens it while idle), so a device on a desk sends
+// one frame per keepaliveUs instead of one per sample. Comparing against
+// the last value *sent* means slow drift still goes out once it adds up.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+class MotionDetector {
+public:
+  MotionDetector(float wakeDps, float accTolG, uint32_t idleAfterUs)
+      : wakeDps(wakeDps), accTol(accTolG), idleAfterUs(idleAfterUs) {}
+
+  // One sample; true when idle() changed
+  bool add(float ax, float ay, float az, float gx, float gy, float gz,
+           uint32_t tUs) {
+    const float an2 = ax * ax + ay * ay + az * az;
+    const float lo = 1.0f - accTol, hi = 1.0f + accTol;
+    const bool moving = gx > wakeDps || gx < -wakeDps || gy > wakeDps ||
+                        gy < -wakeDps || gz > wakeDps || gz < -wakeDps ||
+                        an2 < lo * lo || an2 > hi * hi;
+    if (moving || !started) {
+      started = true;
+      lastMotionUs = tUs;
+      return wake();
+    }
+    if (!isIdle && tUs - lastMotionUs >= idleAfterUs) {
+      isIdle = true;
+      return true;
+    }
+    return false;
+  }
+
+  // Back to active now (wake-on-motion); true if it was idle
+  bool wake() {
+    const bool changed = isIdle;
+    isIdle = false;
+    return changed;
+  }
+
+  bool idle() const { return isIdle; }
+
+private:
+  float wakeDps, accTol;
+  uint32_t idleAfterUs;
+  uint32_t lastMotionUs = 0;
+  bool started = false;
+  bool isIdle = false;
+};
+
+#define FRAME_SUPPRESS_MAX_VALUES 4
+
+class FrameSuppressor {
+public:
+  explicit FrameSuppressor(uint32_t keepaliveUs) : keepaliveUs(keepaliveUs) {}
+
+  // True if these values should go out (then they become the reference);
+  // count <= FRAME_SUPPRESS_MAX_VALUES
+  bool changed(const int16_t *v, int count, int deadband, uint32_t tUs) {
+    bool differs = !haveLast || count != lastCount ||
+                   tUs - lastSentUs >= keepaliveUs;
+    for (int i = 0; i < count && !differs; i++)
+      differs = abs(v[i] - last[i]) > deadband;
+    if (!differs) {
+      dropped++;
+      return false;
+    }
+    for (int i = 0; i < count; i++)
+      last[i] = v[i];
+    lastCount = count;
+    lastSentUs = tUs;
+    haveLast = true;
+    return true;
+  }
+
+  uint32_t suppressed() const { return dropped; }
+
+private:
+  uint32_t keepaliveUs;
+  int16_t last[FRAME_SUPPRESS_MAX_VALUES];
+  int lastCount = 0;
+  uint32_t lastSentUs = 0;
+  uint32_t dropped = 0;
+  bool haveLast = false;
+};
@@ -0,0 +1,115 @@
+#pragma once
+// ── Per-stage cycle profiling ──
+// Fixed-size histograms of CPU-cycle durations, cheap enough for the sample
+// path (no heap, no float, one clz per sample). Each PerfStats must only be
+// written by one task; the owner takes summary() and reset()s it.
+//
+// Buckets: exact below 4 cycles, then log2 octaves split into 4 linear
+// sub-buckets, so a quantile is over-estimated by at most 25% of its octave
+// (clamped to the observed max).
+
+#include <stdint.h>
+
+enum PerfStage : uint8_t {
+  PERF_IMU_READ, // accel/gyro I2C read (FIFO mode: one drain)
+  PERF_MAG_READ, // HMC5883L I2C read
+  PERF_FUSION,   // filter update
+  PERF_SMOOTH,   // quaternion nlerp/slerp or Euler EMA, plus the ring push
+  PERF_SENSOR,   // whole sensor-task iteration after wake-up
+  PERF_ENCODE,   // frame / text serialization
+  PERF_SEND,     // UDP packet or serial write
+  PERF_STAGE_COUNT
+};
+
+inline const char *perfStageName(uint8_t stage) {
+  static const char *const names[PERF_STAGE_COUNT] = {
+      "imu_read", "mag_read", "fusion", "smooth", "sensor", "encode", "send"};
+  return stage < PERF_STAGE_COUNT ? names[stage] : "?";
+}
+
+#define PERF_SUB_BUCKET_BITS 2
+#define PERF_BUCKETS (32 << PERF_SUB_BUCKET_BITS)
+
+struct PerfSummary {
+  uint32_t count;
+  uint32_t min, mean, p99, max; // cycles
+};
+
+class PerfStats {
+public:
+  PerfStats() { reset(); }
+
+  void add(uint32_t cycles) {
+    hist[bucketOf(cycles)]++;
+    count++;
+    sum += cycles;
+    if (cycles < minCycles)
+      minCycles = cycles;
+    if (cycles > maxCycles)
+      maxCycles = cycles;
+  }
+
+  void reset() {
+    for (uint32_t &h : hist)
+      h = 0;
+    count = 0;
+    sum = 0;
+    minCycles = UINT32_MAX;
+    maxCycles = 0;
+  }
+
+  uint32_t samples() const { return count; }
+
+  // Upper bound of the bucket holding the given quantile (0..1)
+  uint32_t quantile(float q) const {
+    if (count == 0)
+      return 0;
+    uint32_t rank = (uint32_t)(q * count);
+    if (rank >= count)
+      rank = count - 1;
+    uint32_t seen = 0;
+    for (int b = 0; b < PERF_BUCKETS; b++) {
+      seen += hist[b];
+      if (seen > rank) {
+        uint32_t upper = bucketUpper(b);
+        return upper < maxCycles ? upper : maxCycles;
+      }
+    }
+    return maxCycles;
+  }
+
+  PerfSummary summary() const {
+    PerfSummary s;
+    s.count = count;
+    s.min = count ? minCycles : 0;
+    s.mean = count ? (uint32_t)(sum / count) : 0;
+    s.p99 = quantile(0.99f);
+    s.max = maxCycles;
+    return s;
+  }
+
+  static int bucketOf(uint32_t c) {
+    if (c < (1u << PERF_SUB_BUCKET_BITS))
+      return (int)c;
+    int octave = 31 - __builtin_clz(c); // >= PERF_SUB_BUCKET_BITS
+    int shift = octave - PERF_SUB_BUCKET_BITS;
+    int sub = (c >> shift) & ((1 << PERF_SUB_BUCKET_BITS) - 1);
+    return ((shift + 1) << PERF_SUB_BUCKET_BITS) + sub;
+  }
+
+  static uint32_t bucketUpper(int b) {
+    if (b < (1 << PERF_SUB_BUCKET_BITS))
+      return (uint32_t)b;
+    int shift = (b >> PERF_SUB_BUCKET_BITS) - 1;
+    uint32_t sub = b & ((1 << PERF_SUB_BUCKET_BITS) - 1);
+    uint64_t lower = (uint64_t)((1u << PERF_SUB_BUCKET_BITS) + sub) << shift;
+    uint64_t upper = lower + ((uint64_t)1 << shift) - 1;
+    return upper > UINT32_MAX ? UINT32_MAX : (uint32_t)upper;
+  }
+
+private:
+  uint32_t hist[PERF_BUCKETS];
+  uint32_t count;
+  uint64_t sum;
+  uint32_t minCycles, maxCycles;
+};
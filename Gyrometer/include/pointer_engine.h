@@ -0,0 +1,200 @@
+#pragma once
+// ── Gyro-rate pointer engine ──
+// Relative pointing: angular rate on the two pointer axes becomes cursor
+// motion in HID mouse counts. Nothing depends on absolute orientation, so
+// there is no Euler conversion, no drift of a "home" angle and nothing to
+// recenter. Per sample, in constant time:
+//
+//   rate − bias → tremor low-pass → speed → gain(speed) → counts
+//
+//  - Bias: while the filtered speed is inside the dead zone the residual
+//    gyro bias is tracked with time constant biasTimeS (capped at
+//    maxBiasDps), so slow drift never reaches the cursor.
+//  - Tremor: a first-order low-pass whose cutoff rises with speed
+//    (tremorMinHz + tremorHzPerDps · speed, the "1 euro" idea): hand
+//    tremor (8–12 Hz) is damped while the pointer is nearly still, and fast
+//    turns pass with little lag.
+//  - Gain: counts per degree from lowGain for slow, precise turns to
+//    highGain for fast ones, switching around kneeDps with steepness
+//    curveExponent; zero inside deadZoneDps with a smooth ramp over the
+//    next deadZoneDps. The curve is applied to the speed, not per axis, so
+//    it never bends the direction of motion.
+//
+// The gain curve is tabulated by configure() (powf only there): one entry
+// every 1/POINTER_LUT_PER_OCTAVE octave of speed from 2^POINTER_LUT_MIN_EXP
+// to 2^POINTER_LUT_MAX_EXP deg/s, indexed straight from the float's
+// exponent and mantissa bits and interpolated linearly within the bin.
+//
+// Motion accumulates between HID reports with its fractional part kept, so
+// slow turns still move the cursor and a report that goes out late carries
+// everything since the previous one. take() hands out at most ±127 counts
+// per axis (one mouse report); the backlog is capped at POINTER_MAX_BACKLOG
+// so a host that stops polling (suspend, busy endpoint) does not get a jump
+// when it comes back.
+//
+// Shared with Air_Pointer (see its platformio.ini).
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#define POINTER_REPORT_MAX 127
+#define POINTER_MAX_BACKLOG (4.0f * POINTER_REPORT_MAX)
+#define POINTER_LUT_MIN_EXP -3 // 0.125 deg/s
+#define POINTER_LUT_MAX_EXP 10 // 1024 deg/s
+#define POINTER_LUT_OCTAVE_BITS 3
+#define POINTER_LUT_PER_OCTAVE (1 << POINTER_LUT_OCTAVE_BITS)
+#define POINTER_LUT_SIZE                                                       \
+  ((POINTER_LUT_MAX_EXP - POINTER_LUT_MIN_EXP) * POINTER_LUT_PER_OCTAVE + 1)
+
+struct PointerConfig {
+  float lowGain;        // counts per degree, slow turns
+  float highGain;       // counts per degree, fast turns
+  float kneeDps;        // speed halfway between the two
+  float curveExponent;  // steepness of the switch (1 = gentle)
+  float deadZoneDps;    // 0 = off
+  float tremorMinHz;    // low-pass cutoff at rest (0 = filter off)
+  float tremorHzPerDps; // cutoff increase per deg/s of speed
+  float biasTimeS;      // 0 = no bias tracking
+  float maxBiasDps;
+};
+
+inline PointerConfig defaultPointerConfig() {
+  PointerConfig c;
+  c.lowGain = 8.0f;
+  c.highGain = 30.0f;
+  c.kneeDps = 60.0f;
+  c.curveExponent = 2.0f;
+  c.deadZoneDps = 1.0f;
+  c.tremorMinHz = 5.0f;
+  c.tremorHzPerDps = 0.2f;
+  c.biasTimeS = 2.0f;
+  c.maxBiasDps = 2.0f;
+  return c;
+}
+
+class PointerEngine {
+public:
+  explicit PointerEngine(const PointerConfig &c = defaultPointerConfig()) {
+    configure(c);
+  }
+
+  // Rebuilds the gain table; filter and bias state are kept
+  void configure(const PointerConfig &c) {
+    cfg = c;
+    for (int i = 0; i < POINTER_LUT_SIZE; i++) {
+      const int octave = i / POINTER_LUT_PER_OCTAVE;
+      const int step = i % POINTER_LUT_PER_OCTAVE;
+      const float speed = ldexpf(1.0f + (float)step / POINTER_LUT_PER_OCTAVE,
+                                 POINTER_LUT_MIN_EXP + octave);
+      lut[i] = gainAt(speed);
+    }
+  }
+  const PointerConfig &config() const { return cfg; }
+
+  // Counts per degree at this speed (deg/s), exactly as tabulated
+  float gainAt(float speed) const {
+    const float dz = cfg.deadZoneDps;
+    if (speed <= dz)
+      return 0.0f;
+    const float r = powf(speed / cfg.kneeDps, cfg.curveExponent);
+    float g = cfg.lowGain + (cfg.highGain - cfg.lowGain) * r / (1.0f + r);
+    if (speed < 2.0f * dz) {
+      const float t = (speed - dz) / dz; // smoothstep out of the dead zone
+      g *= t * t * (3.0f - 2.0f * t);
+    }
+    return g;
+  }
+
+  // Same value from the table (what addRate() uses)
+  float gainLookup(float speed) const {
+    uint32_t bits;
+    memcpy(&bits, &speed, sizeof(bits));
+    const int e = (int)((bits >> 23) & 0xFF) - 127;
+    if (e < POINTER_LUT_MIN_EXP)
+      return speed > 0.0f ? lut[0] * speed * (1 << -POINTER_LUT_MIN_EXP) : 0;
+    if (e >= POINTER_LUT_MAX_EXP)
+      return lut[POINTER_LUT_SIZE - 1];
+    // Top mantissa bits pick the bin, the rest interpolate inside it
+    const int shift = 23 - POINTER_LUT_OCTAVE_BITS;
+    const uint32_t m = bits & 0x7FFFFF;
+    const int i = (e - POINTER_LUT_MIN_EXP) * POINTER_LUT_PER_OCTAVE +
+                  (int)(m >> shift);
+    const float frac = (float)(m & ((1u << shift) - 1)) / (float)(1u << shift);
+    return lut[i] + (lut[i + 1] - lut[i]) * frac;
+  }
+
+  // One gyro sample: rates in deg/s (x right-positive, y down-positive),
+  // dtS the time it covers
+  void addRate(float rateX, float rateY, float dtS) {
+    float x = rateX - biasX, y = rateY - biasY;
+
+    if (cfg.tremorMinHz > 0.0f) {
+      // α = dt / (dt + τ), τ = 1 / (2π fc)
+      const float fc = cfg.tremorMinHz + cfg.tremorHzPerDps * speed;
+      const float a = dtS / (dtS + 1.0f / (6.2831853f * fc));
+      fx += (x - fx) * a;
+      fy += (y - fy) * a;
+      x = fx;
+      y = fy;
+    }
+    speed = sqrtf(x * x + y * y);
+
+    if (cfg.biasTimeS > 0.0f && speed < cfg.deadZoneDps) {
+      const float k = dtS / (dtS + cfg.biasTimeS);
+      biasX = clamp(biasX + (rateX - biasX) * k, cfg.maxBiasDps);
+      biasY = clamp(biasY + (rateY - biasY) * k, cfg.maxBiasDps);
+    }
+
+    const float g = gainLookup(speed) * dtS;
+    accX = clamp(accX + x * g, POINTER_MAX_BACKLOG);
+    accY = clamp(accY + y * g, POINTER_MAX_BACKLOG);
+  }
+
+  // Whole counts for the next report; false if there is nothing to send.
+  // The fractional remainder stays for the next report.
+  bool take(int8_t &dx, int8_t &dy) {
+    const int x = takeAxis(accX), y = takeAxis(accY);
+    dx = (int8_t)x;
+    dy = (int8_t)y;
+    return x != 0 || y != 0;
+  }
+
+  // Counts still waiting (whole and fractional)
+  float pendingX() const { return accX; }
+  float pendingY() const { return accY; }
+  float speedDps() const { return speed; }
+  float biasDps(int axis) const { return axis == 0 ? biasX : biasY; }
+
+  // Forget motion not yet reported (no host to send it to)
+  void drop() { accX = accY = 0.0f; }
+
+  void reset() {
+    drop();
+    fx = fy = speed = 0.0f;
+    biasX = biasY = 0.0f;
+  }
+
+private:
+  static float clamp(float v, float limit) {
+    return v > limit ? limit : (v < -limit ? -limit : v);
+  }
+
+  // Truncate towards zero: the remainder keeps the accumulator's sign, so
+  // jitter around zero never rounds into motion
+  static int takeAxis(float &acc) {
+    int n = (int)acc;
+    n = n > POINTER_REPORT_MAX
+            ? POINTER_REPORT_MAX
+            : (n < -POINTER_REPORT_MAX ? -POINTER_REPORT_MAX : n);
+    acc -= n;
+    return n;
+  }
+
+  PointerConfig cfg;
+  float lut[POINTER_LUT_SIZE];
+  float fx = 0.0f, fy = 0.0f; // tremor-filtered rate
+  float speed = 0.0f;         // |filtered rate|, deg/s
+  float biasX = 0.0f, biasY = 0.0f;
+  float accX = 0.0f, accY = 0.0f;
+};
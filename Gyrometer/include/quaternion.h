@@ -0,0 +1,77 @@
+#pragma once
+// ── Quaternion helpers ──
+// Unit quaternions (w, x, y, z) in the same convention as the Madgwick
+// filter: q rotates sensor-frame vectors into the earth frame.
+
+#include <math.h>
+
+struct Quat {
+  float w, x, y, z;
+};
+
+inline float quatDot(const Quat &a, const Quat &b) {
+  return a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+inline Quat quatNormalize(const Quat &q) {
+  float n = sqrtf(quatDot(q, q));
+  if (n <= 0.0f)
+    return {1.0f, 0.0f, 0.0f, 0.0f};
+  float r = 1.0f / n;
+  return {q.w * r, q.x * r, q.y * r, q.z * r};
+}
+
+inline Quat quatConjugate(const Quat &q) { return {q.w, -q.x, -q.y, -q.z}; }
+
+inline Quat quatMultiply(const Quat &a, const Quat &b) {
+  return {a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+          a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+          a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+          a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w};
+}
+
+// Normalized lerp from a towards b along the shorter arc. For the small
+// per-sample steps of a smoothing filter this matches slerp closely at a
+// fraction of the cost (no trig).
+inline Quat quatNlerp(const Quat &a, const Quat &b, float t) {
+  float s = quatDot(a, b) < 0.0f ? -t : t; // q and -q are the same rotation
+  float u = 1.0f - t;
+  return quatNormalize(
+      {u * a.w + s * b.w, u * a.x + s * b.x, u * a.y + s * b.y,
+       u * a.z + s * b.z});
+}
+
+// Spherical linear interpolation (constant angular velocity in t)
+inline Quat quatSlerp(const Quat &a, const Quat &b, float t) {
+  float d = quatDot(a, b);
+  Quat bb = b;
+  if (d < 0.0f) {
+    d = -d;
+    bb = {-b.w, -b.x, -b.y, -b.z};
+  }
+  if (d > 0.9995f) // nearly parallel: nlerp is exact enough and stable
+    return quatNlerp(a, bb, t);
+  float theta = acosf(d);
+  float sinTheta = sinf(theta);
+  float wa = sinf((1.0f - t) * theta) / sinTheta;
+  float wb = sinf(t * theta) / sinTheta;
+  return {wa * a.w + wb * bb.w, wa * a.x + wb * bb.x, wa * a.y + wb * bb.y,
+          wa * a.z + wb * bb.z};
+}
+
+// Euler angles in degrees with the Arduino MadgwickAHRS conventions
+// (yaw in [0, 360)). Only needed off the hot path (DIAG, Euler output mode).
+inline void quatToEulerDeg(const Quat &q, float &roll, float &pitch,
+                           float &yaw) {
+  float sp = -2.0f * (q.x * q.z - q.w * q.y);
+  if (sp > 1.0f)
+    sp = 1.0f;
+  if (sp < -1.0f)
+    sp = -1.0f;
+  roll = atan2f(q.w * q.x + q.y * q.z, 0.5f - q.x * q.x - q.y * q.y) *
+         57.29578f;
+  pitch = asinf(sp) * 57.29578f;
+  yaw = atan2f(q.x * q.y + q.w * q.z, 0.5f - q.y * q.y - q.z * q.z) *
+            57.29578f +
+        180.0f;
+}
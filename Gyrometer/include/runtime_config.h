@@ -0,0 +1,256 @@
+#pragma once
+// ── Runtime configuration ──
+// The acquisition, smoothing and network settings the host may change while
+// the device runs (host commands in src/main.cpp), kept as one versioned
+// blob in the "config" Preferences namespace. The compile-time #defines in
+// main.cpp are only the defaults: a stored blob replaces them at boot.
+//
+// Each setting has a text key. configSet() parses and range-checks one value
+// and returns which part of the firmware has to re-apply it (CONFIG_APPLY_*),
+// 0 if the key or value is rejected; configFormat() prints one setting back.
+// Nothing here touches hardware, so the parser runs in the host tests.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef ARDUINO
+#include <Preferences.h>
+#endif
+
+#define CONFIG_NAMESPACE "config"
+#define CONFIG_KEY "data"
+#define CONFIG_VERSION 2
+
+// What a change has to be re-applied by
+#define CONFIG_APPLY_IMU 0x01    // sensor task: MPU6500 registers
+#define CONFIG_APPLY_FILTER 0x02 // sensor task: fusion, smoothing, prediction
+#define CONFIG_APPLY_NET 0x04    // transport task: UDP destination / port
+
+struct RuntimeConfig {
+  uint16_t version;
+  uint8_t rateDivider;  // MPU6500 rate = 1 kHz / (1 + rateDivider)
+  uint8_t dlpf;         // MPU6500_DLPF_0..7, accel and gyro
+  uint8_t accRangeG;    // 2, 4, 8, 16
+  uint16_t gyrRangeDps; // 250, 500, 1000, 2000
+  float emaAlpha;       // output smoothing, (0, 1]; lower = smoother
+  float beta;           // Madgwick gain (at-rest gain of the adaptive one)
+  uint8_t predictMs;    // latency compensation horizon, 0 = off
+  uint8_t serverIp[4];
+  uint16_t udpPort;
+};
+
+enum ConfigKey : uint8_t {
+  CONFIG_RATE_DIVIDER,
+  CONFIG_DLPF,
+  CONFIG_ACC_RANGE,
+  CONFIG_GYRO_RANGE,
+  CONFIG_EMA_ALPHA,
+  CONFIG_BETA,
+  CONFIG_PREDICT,
+  CONFIG_SERVER_IP,
+  CONFIG_UDP_PORT,
+  CONFIG_KEY_COUNT
+};
+
+inline const char *configKeyName(uint8_t key) {
+  static const char *const names[CONFIG_KEY_COUNT] = {
+      "rate_div", "dlpf", "acc_range", "gyro_range",
+      "ema_alpha", "beta", "predict_ms", "server_ip", "udp_port"};
+  return key < CONFIG_KEY_COUNT ? names[key] : "?";
+}
+
+// CONFIG_KEY_COUNT if unknown
+inline uint8_t configKeyLookup(const char *name) {
+  for (uint8_t i = 0; i < CONFIG_KEY_COUNT; i++)
+    if (strcmp(name, configKeyName(i)) == 0)
+      return i;
+  return CONFIG_KEY_COUNT;
+}
+
+// MPU6500_WE range codes: the range is 2 g (250 dps) << code
+inline uint8_t configAccRangeCode(const RuntimeConfig &c) {
+  return c.accRangeG >= 16 ? 3 : (c.accRangeG >= 8 ? 2 : c.accRangeG / 4);
+}
+inline uint8_t configGyrRangeCode(const RuntimeConfig &c) {
+  return c.gyrRangeDps >= 2000 ? 3 : c.gyrRangeDps / 500;
+}
+
+inline uint32_t configPeriodUs(const RuntimeConfig &c) {
+  return 1000UL * (1 + c.rateDivider);
+}
+
+// Whole-string integer / float; false on trailing garbage or overflow
+inline bool configParseLong(const char *s, long lo, long hi, long &out) {
+  char *end;
+  const long v = strtol(s, &end, 10);
+  if (end == s || *end != '\0' || v < lo || v > hi)
+    return false;
+  out = v;
+  return true;
+}
+
+inline bool configParseFloat(const char *s, float lo, float hi, float &out) {
+  char *end;
+  const float v = strtof(s, &end);
+  // !(v >= lo) also rejects nan
+  if (end == s || *end != '\0' || !(v >= lo) || v > hi)
+    return false;
+  out = v;
+  return true;
+}
+
+// "a.b.c.d"
+inline bool configParseIp(const char *s, uint8_t ip[4]) {
+  unsigned a, b, c, d;
+  char tail;
+  if (sscanf(s, "%u.%u.%u.%u%c", &a, &b, &c, &d, &tail) != 4 || a > 255 ||
+      b > 255 || c > 255 || d > 255)
+    return false;
+  ip[0] = a;
+  ip[1] = b;
+  ip[2] = c;
+  ip[3] = d;
+  return true;
+}
+
+// Sets one value; CONFIG_APPLY_* for what must pick it up, 0 if rejected
+// (c is then unchanged)
+inline uint8_t configSet(RuntimeConfig &c, const char *name,
+                         const char *value) {
+  long n;
+  float f;
+  switch (configKeyLookup(name)) {
+  case CONFIG_RATE_DIVIDER:
+    if (!configParseLong(value, 0, 255, n))
+      return 0;
+    c.rateDivider = n;
+    // The filters integrate with the sample period
+    return CONFIG_APPLY_IMU | CONFIG_APPLY_FILTER;
+  case CONFIG_DLPF:
+    if (!configParseLong(value, 0, 7, n))
+      return 0;
+    c.dlpf = n;
+    return CONFIG_APPLY_IMU;
+  case CONFIG_ACC_RANGE:
+    if (!configParseLong(value, 2, 16, n) || (n & (n - 1)))
+      return 0;
+    c.accRangeG = n;
+    return CONFIG_APPLY_IMU;
+  case CONFIG_GYRO_RANGE:
+    if (!configParseLong(value, 250, 2000, n) ||
+        (n != 250 && n != 500 && n != 1000 && n != 2000))
+      return 0;
+    c.gyrRangeDps = n;
+    return CONFIG_APPLY_IMU;
+  case CONFIG_EMA_ALPHA:
+    if (!configParseFloat(value, 0.001f, 1.0f, f))
+      return 0;
+    c.emaAlpha = f;
+    return CONFIG_APPLY_FILTER;
+  case CONFIG_BETA:
+    if (!configParseFloat(value, 0.0f, 10.0f, f))
+      return 0;
+    c.beta = f;
+    return CONFIG_APPLY_FILTER;
+  case CONFIG_PREDICT:
+    if (!configParseLong(value, 0, 100, n))
+      return 0;
+    c.predictMs = n;
+    return CONFIG_APPLY_FILTER;
+  case CONFIG_SERVER_IP:
+    if (!configParseIp(value, c.serverIp))
+      return 0;
+    return CONFIG_APPLY_NET;
+  case CONFIG_UDP_PORT:
+    if (!configParseLong(value, 1, 65535, n))
+      return 0;
+    c.udpPort = n;
+    return CONFIG_APPLY_NET;
+  default:
+    return 0;
+  }
+}
+
+// "<key>,<value>" into out; returns the length (snprintf semantics)
+inline int configFormat(const RuntimeConfig &c, uint8_t key, char *out,
+                        size_t cap) {
+  const char *name = configKeyName(key);
+  switch (key) {
+  case CONFIG_RATE_DIVIDER:
+    return snprintf(out, cap, "%s,%u", name, (unsigned)c.rateDivider);
+  case CONFIG_DLPF:
+    return snprintf(out, cap, "%s,%u", name, (unsigned)c.dlpf);
+  case CONFIG_ACC_RANGE:
+    return snprintf(out, cap, "%s,%u", name, (unsigned)c.accRangeG);
+  case CONFIG_GYRO_RANGE:
+    return snprintf(out, cap, "%s,%u", name, (unsigned)c.gyrRangeDps);
+  case CONFIG_EMA_ALPHA:
+    return snprintf(out, cap, "%s,%.4f", name, c.emaAlpha);
+  case CONFIG_BETA:
+    return snprintf(out, cap, "%s,%.4f", name, c.beta);
+  case CONFIG_PREDICT:
+    return snprintf(out, cap, "%s,%u", name, (unsigned)c.predictMs);
+  case CONFIG_SERVER_IP:
+    return snprintf(out, cap, "%s,%u.%u.%u.%u", name, c.serverIp[0],
+                    c.serverIp[1], c.serverIp[2], c.serverIp[3]);
+  case CONFIG_UDP_PORT:
+    return snprintf(out, cap, "%s,%u", name, (unsigned)c.udpPort);
+  default:
+    return snprintf(out, cap, "?");
+  }
+}
+
+// Every value through the same checks as configSet() (a stored blob from
+// an older build may hold one that is no longer accepted)
+inline bool configValid(const RuntimeConfig &c) {
+  RuntimeConfig probe = c;
+  char line[48];
+  for (uint8_t key = 0; key < CONFIG_KEY_COUNT; key++) {
+    configFormat(c, key, line, sizeof(line));
+    char *value = strchr(line, ',');
+    if (!value)
+      return false;
+    *value++ = '\0';
+    if (!configSet(probe, line, value))
+      return false;
+  }
+  return c.version == CONFIG_VERSION;
+}
+
+#ifdef ARDUINO
+// False (and c untouched, i.e. the caller's defaults) if nothing valid is
+// stored
+inline bool configLoad(RuntimeConfig &c) {
+  Preferences prefs;
+  if (!prefs.begin(CONFIG_NAMESPACE, true))
+    return false;
+  RuntimeConfig stored;
+  bool ok = prefs.getBytesLength(CONFIG_KEY) == sizeof(stored) &&
+            prefs.getBytes(CONFIG_KEY, &stored, sizeof(stored)) ==
+                sizeof(stored) &&
+            configValid(stored);
+  prefs.end();
+  if (ok)
+    c = stored;
+  return ok;
+}
+
+inline bool configSave(const RuntimeConfig &c) {
+  Preferences prefs;
+  if (!prefs.begin(CONFIG_NAMESPACE, false))
+    return false;
+  bool ok = prefs.putBytes(CONFIG_KEY, &c, sizeof(c)) == sizeof(c);
+  prefs.end();
+  return ok;
+}
+
+inline bool configClear() {
+  Preferences prefs;
+  if (!prefs.begin(CONFIG_NAMESPACE, false))
+    return false;
+  bool ok = prefs.remove(CONFIG_KEY);
+  prefs.end();
+  return ok;
+}
+#endif
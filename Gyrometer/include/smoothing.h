@@ -0,0 +1,55 @@
+#pragma once
+// ── Output smoothing ──
+// Per-axis Euler EMA for the EULER output mode. The quaternion mode smooths
+// with quatNlerp()/quatSlerp() (include/quaternion.h) instead.
+
+#include "quaternion.h"
+
+// b - a in degrees, wrapped to [-180, 180]
+inline float angleDiff(float a, float b) {
+  float diff = b - a;
+  while (diff > 180.0f)
+    diff -= 360.0f;
+  while (diff < -180.0f)
+    diff += 360.0f;
+  return diff;
+}
+
+// Angle-aware EMA (handles wraparound) in degrees
+inline float emaAngle(float smoothed, float raw, float alpha) {
+  return smoothed + alpha * angleDiff(smoothed, raw);
+}
+
+// ── Latency compensation ──
+// Both EMAs trail a steady rotation by (1 - alpha) / alpha samples. Turning
+// the smoothed output ahead by the current gyro rate over that horizon puts
+// it back on the live orientation while the rate holds; when the rate
+// changes it overshoots by (change in rate) x horizon, so a shorter horizon
+// trades some lag for less overshoot.
+
+// Steady-state lag of the EMA at gain alpha, in seconds
+inline float emaLagS(float alpha, float periodS) {
+  return (1.0f - alpha) / alpha * periodS;
+}
+
+// q turned by the body rate (gx, gy, gz) in deg/s for horizonS seconds:
+// the filters' own q' = q * (0, w) / 2 step, renormalized. No trig; short of
+// the exact rotation by under 0.03 deg for predictions up to 10 deg.
+inline Quat quatPredict(const Quat &q, float gx, float gy, float gz,
+                        float horizonS) {
+  const float k = 0.5f * horizonS * 0.0174532925f;
+  return quatNormalize(quatMultiply(q, {1.0f, gx * k, gy * k, gz * k}));
+}
+
+// Smoothed Euler angles moved by the change quatPredict() makes to the live
+// filter orientation q
+inline void eulerPredict(const Quat &q, float gx, float gy, float gz,
+                         float horizonS, float &roll, float &pitch,
+                         float &yaw) {
+  float r0, p0, y0, r1, p1, y1;
+  quatToEulerDeg(q, r0, p0, y0);
+  quatToEulerDeg(quatPredict(q, gx, gy, gz, horizonS), r1, p1, y1);
+  roll += angleDiff(r0, r1);
+  pitch += p1 - p0;
+  yaw += angleDiff(y0, y1);
+}
@@ -0,0 +1,52 @@
+#pragma once
+// ── Lock-free single-producer / single-consumer ring buffer ──
+// One task pushes, one task pops; head and tail are each written by only one
+// side, so acquire/release ordering is all the synchronisation needed. A full
+// ring rejects the push (the producer never waits on the consumer).
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+template <typename T, size_t N> class SpscRing {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+  // Producer side. Returns false (and counts a drop) when full.
+  bool push(const T &item) {
+    size_t head = headIdx.load(std::memory_order_relaxed);
+    size_t tail = tailIdx.load(std::memory_order_acquire);
+    if (head - tail >= N) {
+      dropCount.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    slots[head & (N - 1)] = item;
+    headIdx.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns false when empty.
+  bool pop(T &item) {
+    size_t tail = tailIdx.load(std::memory_order_relaxed);
+    size_t head = headIdx.load(std::memory_order_acquire);
+    if (tail == head)
+      return false;
+    item = slots[tail & (N - 1)];
+    tailIdx.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t size() const {
+    return headIdx.load(std::memory_order_acquire) -
+           tailIdx.load(std::memory_order_acquire);
+  }
+  bool empty() const { return size() == 0; }
+  static constexpr size_t capacity() { return N; }
+  uint32_t dropped() const { return dropCount.load(std::memory_order_relaxed); }
+
+private:
+  T slots[N];
+  std::atomic<size_t> headIdx{0};
+  std::atomic<size_t> tailIdx{0};
+  std::atomic<uint32_t> dropCount{0};
+};
@@ -0,0 +1,289 @@
+#pragma once
+// ── Binary telemetry frames ──
+// Fixed-size little-endian frames that replace the "EULER,r,p,y" text lines.
+// Must stay in sync with viewer/telemetry.py.
+//
+//   off  size  field
+//   0    1     magic   0xA5 (never appears in the ASCII lines)
+//   1    1     version TELEMETRY_VERSION
+//   2    1     type    FrameType
+//   3    1     flags   StatusFlags
+//   4    2     seq     sample sequence number (wraps)
+//   6    4     t_us    device timestamp, µs (wraps)
+//   10   2     device  sender ID, so one host can tell several units apart
+//   12   n     payload (type specific)
+//   12+n 2     crc     CRC-16/CCITT-FALSE over bytes [0, 12+n)
+//
+// Version 1 frames had no device field (10-byte header); the host decoder
+// still reads them.
+//
+// Payloads:
+//   FRAME_EULER  roll, pitch, yaw   int16 centidegrees, wrapped to ±180°
+//                (decoders map yaw back to [0, 360) like the ASCII stream)
+//   FRAME_QUAT   w, x, y, z         int16 Q14 (1.0 == 16384)
+//   FRAME_RAW    ax, ay, az, gx, gy, gz, mx, my, mz   int16, calibrated:
+//                accel 1/8192 g, gyro 1/64 °/s, mag 1/16 µT; flag
+//                STATUS_MAG_FUSED marks a fresh mag reading (host fusion)
+//   FRAME_BATCH  sample_type u8, count u8, then per sample:
+//                dt_us u16 (offset from header t_us), flags u8, payload of
+//                sample_type. Sample k has seq = header seq + k.
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TELEMETRY_FORMAT_ASCII 0
+#define TELEMETRY_FORMAT_BINARY 1
+
+#define TELEMETRY_MAGIC 0xA5
+#define TELEMETRY_VERSION 2
+#define TELEMETRY_HEADER_BYTES 12
+#define TELEMETRY_CRC_BYTES 2
+#define TELEMETRY_MAX_FRAME_BYTES 64
+#define TELEMETRY_BATCH_MAX_SAMPLES 32
+#define TELEMETRY_MAX_VALUES 9 // int16 values in the largest sample payload
+#define TELEMETRY_MAX_BATCH_BYTES                                              \
+  (TELEMETRY_HEADER_BYTES + 2 +                                                \
+   TELEMETRY_BATCH_MAX_SAMPLES * (3 + 2 * TELEMETRY_MAX_VALUES) +              \
+   TELEMETRY_CRC_BYTES)
+
+enum FrameType : uint8_t {
+  FRAME_EULER = 1,
+  FRAME_QUAT = 2,
+  FRAME_RAW = 3,
+  FRAME_BATCH = 0x10,
+};
+
+// int16 values carried by a sample of the given type
+inline uint8_t payloadValues(FrameType type) {
+  switch (type) {
+  case FRAME_EULER:
+    return 3;
+  case FRAME_QUAT:
+    return 4;
+  case FRAME_RAW:
+    return 9;
+  default:
+    return 0;
+  }
+}
+
+enum StatusFlags : uint8_t {
+  STATUS_IMU_OK = 1 << 0,
+  STATUS_MAG_OK = 1 << 1,
+  STATUS_MAG_FUSED = 1 << 2, // this sample used a 9-axis update
+};
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF) — binascii.crc_hqx on host
+inline uint16_t crc16Ccitt(const uint8_t *data, size_t len,
+                           uint16_t crc = 0xFFFF) {
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int b = 0; b < 8; b++)
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021)
+                           : (uint16_t)(crc << 1);
+  }
+  return crc;
+}
+
+// Saturating float → int16 with a fixed scale
+inline int16_t toFixed16(float v, float scale) {
+  float s = v * scale;
+  if (!(s > -32767.0f)) // also catches NaN
+    return s > 0 ? 32767 : -32767;
+  if (s > 32767.0f)
+    return 32767;
+  return (int16_t)lroundf(s);
+}
+
+// Wrap degrees to [-180, 180) so they fit the centidegree encoding
+inline float wrapDegrees180(float deg) {
+  deg = fmodf(deg + 180.0f, 360.0f);
+  if (deg < 0)
+    deg += 360.0f;
+  return deg - 180.0f;
+}
+
+// ── Little-endian frame builder over a caller-owned buffer ──
+class FrameWriter {
+public:
+  FrameWriter(uint8_t *buf, size_t cap) : buf(buf), cap(cap) {}
+
+  void header(FrameType type, uint8_t flags, uint16_t seq, uint32_t tUs,
+              uint16_t device) {
+    len = 0;
+    overflow = false;
+    put8(TELEMETRY_MAGIC);
+    put8(TELEMETRY_VERSION);
+    put8(type);
+    put8(flags);
+    put16(seq);
+    put32(tUs);
+    put16(device);
+  }
+
+  void put8(uint8_t v) {
+    if (len < cap)
+      buf[len++] = v;
+    else
+      overflow = true;
+  }
+  void put16(uint16_t v) {
+    put8(v & 0xFF);
+    put8(v >> 8);
+  }
+  void put32(uint32_t v) {
+    put16(v & 0xFFFF);
+    put16(v >> 16);
+  }
+  void putI16(int16_t v) { put16((uint16_t)v); }
+
+  // Appends the CRC and returns the total frame length (0 on overflow)
+  size_t finish() {
+    uint16_t crc = crc16Ccitt(buf, len);
+    put16(crc);
+    return overflow ? 0 : len;
+  }
+
+  size_t size() const { return len; }
+
+private:
+  uint8_t *buf;
+  size_t cap;
+  size_t len = 0;
+  bool overflow = false;
+};
+
+inline void eulerToFixed(float roll, float pitch, float yaw, int16_t out[3]) {
+  out[0] = toFixed16(wrapDegrees180(roll), 100.0f);
+  out[1] = toFixed16(wrapDegrees180(pitch), 100.0f);
+  out[2] = toFixed16(wrapDegrees180(yaw), 100.0f);
+}
+
+inline void quatToFixed(float qw, float qx, float qy, float qz,
+                        int16_t out[4]) {
+  out[0] = toFixed16(qw, 16384.0f);
+  out[1] = toFixed16(qx, 16384.0f);
+  out[2] = toFixed16(qy, 16384.0f);
+  out[3] = toFixed16(qz, 16384.0f);
+}
+
+#define RAW_ACC_SCALE 8192.0f // LSB per g   (±4 g)
+#define RAW_GYR_SCALE 64.0f   // LSB per °/s (±512 °/s)
+#define RAW_MAG_SCALE 16.0f   // LSB per µT  (±2048 µT)
+// Widest MPU6500 ranges the scales above carry without clipping
+#define RAW_ACC_MAX_G 4
+#define RAW_GYR_MAX_DPS 500
+
+inline void rawToFixed(const float acc[3], const float gyr[3],
+                       const float mag[3], int16_t out[9]) {
+  for (int i = 0; i < 3; i++) {
+    out[i] = toFixed16(acc[i], RAW_ACC_SCALE);
+    out[3 + i] = toFixed16(gyr[i], RAW_GYR_SCALE);
+    out[6 + i] = toFixed16(mag[i], RAW_MAG_SCALE);
+  }
+}
+
+// Single-sample frame from already-quantised payload values
+inline size_t encodeFrame(uint8_t *out, size_t cap, FrameType type,
+                          uint16_t seq, uint32_t tUs, uint8_t flags,
+                          const int16_t *values, uint16_t device) {
+  FrameWriter w(out, cap);
+  w.header(type, flags, seq, tUs, device);
+  for (uint8_t i = 0; i < payloadValues(type); i++)
+    w.putI16(values[i]);
+  return w.finish();
+}
+
+inline size_t encodeEulerFrame(uint8_t *out, size_t cap, uint16_t seq,
+                               uint32_t tUs, uint8_t flags, float roll,
+                               float pitch, float yaw, uint16_t device) {
+  int16_t v[3];
+  eulerToFixed(roll, pitch, yaw, v);
+  return encodeFrame(out, cap, FRAME_EULER, seq, tUs, flags, v, device);
+}
+
+inline size_t encodeQuatFrame(uint8_t *out, size_t cap, uint16_t seq,
+                              uint32_t tUs, uint8_t flags, float qw, float qx,
+                              float qy, float qz, uint16_t device) {
+  int16_t v[4];
+  quatToFixed(qw, qx, qy, qz, v);
+  return encodeFrame(out, cap, FRAME_QUAT, seq, tUs, flags, v, device);
+}
+
+// ── Multi-sample coalescing into one FRAME_BATCH datagram ──
+// A batch is closed when it holds maxSamples, when its oldest sample has
+// waited latencyBudgetUs (wall clock, measured by the caller), or when the
+// next sample cannot join it (different type, seq gap, dt overflow).
+class FrameBatcher {
+public:
+  FrameBatcher(uint8_t maxSamples, uint32_t latencyBudgetUs)
+      : maxSamples(maxSamples > TELEMETRY_BATCH_MAX_SAMPLES
+                       ? TELEMETRY_BATCH_MAX_SAMPLES
+                       : (maxSamples ? maxSamples : 1)),
+        budgetUs(latencyBudgetUs) {}
+
+  // Sender ID for the headers of the batches opened from now on
+  void setDevice(uint16_t id) { device = id; }
+
+  bool empty() const { return count == 0; }
+  bool full() const { return count >= maxSamples; }
+
+  bool accepts(FrameType type, uint16_t seq, uint32_t tUs) const {
+    return count == 0 ||
+           (type == sampleType && seq == (uint16_t)(firstSeq + count) &&
+            tUs - firstUs <= 0xFFFF);
+  }
+
+  // Caller must check accepts() first; opens a new batch when empty
+  void add(FrameType type, uint8_t flags, uint16_t seq, uint32_t tUs,
+           const int16_t *values, uint32_t nowUs) {
+    if (count == 0) {
+      sampleType = type;
+      firstSeq = seq;
+      firstUs = tUs;
+      openedUs = nowUs;
+      w.header(FRAME_BATCH, 0, seq, tUs, device);
+      w.put8(type);
+      w.put8(0); // count, patched in flush()
+    }
+    w.put16((uint16_t)(tUs - firstUs));
+    w.put8(flags);
+    for (uint8_t i = 0; i < payloadValues(type); i++)
+      w.putI16(values[i]);
+    lastFlags = flags;
+    count++;
+  }
+
+  bool expired(uint32_t nowUs) const {
+    return count > 0 && nowUs - openedUs >= budgetUs;
+  }
+
+  // Closes the batch; returns a pointer to the encoded frame and its length
+  const uint8_t *flush(size_t &len) {
+    if (count == 0) {
+      len = 0;
+      return buf;
+    }
+    buf[3] = lastFlags;                        // header flags = newest sample
+    buf[TELEMETRY_HEADER_BYTES + 1] = count;
+    len = w.finish();
+    count = 0;
+    return buf;
+  }
+
+  uint32_t latencyBudgetUs() const { return budgetUs; }
+
+private:
+  uint8_t buf[TELEMETRY_MAX_BATCH_BYTES];
+  FrameWriter w{buf, sizeof(buf)};
+  uint8_t maxSamples;
+  uint32_t budgetUs;
+  uint16_t device = 0;
+  uint8_t count = 0;
+  FrameType sampleType = FRAME_EULER;
+  uint8_t lastFlags = 0;
+  uint16_t firstSeq = 0;
+  uint32_t firstUs = 0;
+  uint32_t openedUs = 0;
+};
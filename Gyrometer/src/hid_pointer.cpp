@@ -0,0 +1,214 @@
+#include "hid_pointer.h"
+#include <NimBLEDevice.h>
+#include <NimBLEHIDDevice.h>
+
+// USB HID needs the TinyUSB (OTG) stack: ARDUINO_USB_MODE=0, see
+// platformio.ini. A hardware-CDC build simply never has a USB link.
+#if CONFIG_TINYUSB_HID_ENABLED && !ARDUINO_USB_MODE
+#define HID_POINTER_USB 1
+#include <USB.h>
+#include <USBHIDMouse.h>
+#else
+#define HID_POINTER_USB 0
+#endif
+
+#define BLE_REPORT_ID 1
+#define BLE_SUPERVISION_TIMEOUT 300 // × 10 ms
+#define BLE_INTERVAL_REFRESH_US 1000000
+#define BLE_INTERVAL_UNIT_US 1250
+
+// 3 buttons, X, Y, wheel (int8) — the same report USBHIDMouse sends
+static const uint8_t bleReportMap[] = {
+    0x05, 0x01,       // Usage Page (Generic Desktop)
+    0x09, 0x02,       // Usage (Mouse)
+    0xA1, 0x01,       // Collection (Application)
+    0x85, BLE_REPORT_ID, //   Report ID
+    0x09, 0x01,       //   Usage (Pointer)
+    0xA1, 0x00,       //   Collection (Physical)
+    0x05, 0x09,       //     Usage Page (Buttons)
+    0x19, 0x01,       //     Usage Minimum (1)
+    0x29, 0x03,       //     Usage Maximum (3)
+    0x15, 0x00,       //     Logical Minimum (0)
+    0x25, 0x01,       //     Logical Maximum (1)
+    0x95, 0x03,       //     Report Count (3)
+    0x75, 0x01,       //     Report Size (1)
+    0x81, 0x02,       //     Input (Data, Variable, Absolute)
+    0x95, 0x01,       //     Report Count (1)
+    0x75, 0x05,       //     Report Size (5)
+    0x81, 0x03,       //     Input (Constant) — padding
+    0x05, 0x01,       //     Usage Page (Generic Desktop)
+    0x09, 0x30,       //     Usage (X)
+    0x09, 0x31,       //     Usage (Y)
+    0x09, 0x38,       //     Usage (Wheel)
+    0x15, 0x81,       //     Logical Minimum (-127)
+    0x25, 0x7F,       //     Logical Maximum (127)
+    0x75, 0x08,       //     Report Size (8)
+    0x95, 0x03,       //     Report Count (3)
+    0x81, 0x06,       //     Input (Data, Variable, Relative)
+    0xC0,             //   End Collection
+    0xC0,             // End Collection
+};
+
+static HidPointer *instance = nullptr;
+static NimBLEServer *bleServer = nullptr;
+static NimBLECharacteristic *bleInput = nullptr;
+static uint16_t bleConnHandle = 0;
+static uint16_t bleWantedInterval = 6;
+static uint32_t bleIntervalCheckedUs = 0;
+
+#if HID_POINTER_USB
+static USBHIDMouse usbMouse;
+static USBHID usbHid;
+
+static void onUsbEvent(void *, esp_event_base_t base, int32_t id, void *) {
+  if (base != ARDUINO_USB_EVENTS || !instance)
+    return;
+  switch (id) {
+  case ARDUINO_USB_STARTED_EVENT: // host configured the device
+  case ARDUINO_USB_RESUME_EVENT:
+    instance->onUsbMounted(true);
+    break;
+  case ARDUINO_USB_STOPPED_EVENT:
+  case ARDUINO_USB_SUSPEND_EVENT:
+    instance->onUsbMounted(false);
+    break;
+  }
+}
+#endif
+
+// ── BLE stack callbacks (NimBLE host task) ──
+class BleServerCallbacks : public NimBLEServerCallbacks {
+  void onConnect(NimBLEServer *server, ble_gap_conn_desc *desc) override {
+    bleConnHandle = desc->conn_handle;
+    // Ask for the shortest interval with no slave latency: one connection
+    // event per interval is one report slot
+    server->updateConnParams(desc->conn_handle, bleWantedInterval,
+                             bleWantedInterval, 0, BLE_SUPERVISION_TIMEOUT);
+    if (instance)
+      instance->onBleConnected(desc->conn_itvl * BLE_INTERVAL_UNIT_US);
+  }
+  void onDisconnect(NimBLEServer *, ble_gap_conn_desc *) override {
+    // Advertising restarts on its own (advertiseOnDisconnect)
+    if (instance)
+      instance->onBleDisconnected();
+  }
+};
+
+class BleInputCallbacks : public NimBLECharacteristicCallbacks {
+  void onSubscribe(NimBLECharacteristic *, ble_gap_conn_desc *,
+                   uint16_t subValue) override {
+    if (instance)
+      instance->onBleSubscribed(subValue & 0x0001); // notifications
+  }
+};
+
+static BleServerCallbacks bleServerCallbacks;
+static BleInputCallbacks bleInputCallbacks;
+
+void HidPointer::begin(bool useUsb, bool useBle, const char *bleName,
+                       uint16_t bleInterval) {
+  instance = this;
+  usbEnabled = useUsb && HID_POINTER_USB;
+  bleEnabled = useBle;
+  bleWantedInterval = bleInterval;
+
+#if HID_POINTER_USB
+  if (usbEnabled) {
+    USB.onEvent(onUsbEvent);
+    usbMouse.begin();
+    USB.begin();
+  }
+#endif
+
+  if (bleEnabled) {
+    NimBLEDevice::init(bleName);
+    // Bonded "just works" pairing, as hosts expect from a mouse
+    NimBLEDevice::setSecurityAuth(true, false, true);
+    bleServer = NimBLEDevice::createServer();
+    bleServer->setCallbacks(&bleServerCallbacks, false);
+
+    NimBLEHIDDevice *hid = new NimBLEHIDDevice(bleServer);
+    hid->manufacturer()->setValue(std::string("Gyrometer"));
+    hid->pnp(0x02, 0x303A, 0x8001, 0x0100); // USB-IF vendor id source
+    hid->hidInfo(0x00, 0x01);               // not localised, remote wake
+    hid->reportMap((uint8_t *)bleReportMap, sizeof(bleReportMap));
+    bleInput = hid->inputReport(BLE_REPORT_ID);
+    bleInput->setCallbacks(&bleInputCallbacks);
+    hid->setBatteryLevel(100);
+    hid->startServices();
+
+    NimBLEAdvertising *adv = bleServer->getAdvertising();
+    adv->setAppearance(HID_MOUSE);
+    adv->addServiceUUID(hid->hidService()->getUUID());
+    adv->start();
+  }
+}
+
+PointerLink HidPointer::link() const {
+  if (usbEnabled && usbMounted)
+    return POINTER_LINK_USB;
+  if (bleEnabled && bleConnected && bleSubscribed)
+    return POINTER_LINK_BLE;
+  return POINTER_LINK_NONE;
+}
+
+void HidPointer::onBleConnected(uint32_t intervalUs) {
+  bleIntervalUs_ = intervalUs;
+  bleConnected = true;
+}
+
+void HidPointer::onBleDisconnected() {
+  bleConnected = false;
+  bleSubscribed = false;
+  bleIntervalUs_ = 0;
+}
+
+bool HidPointer::ready(uint32_t nowUs) {
+  switch (link()) {
+  case POINTER_LINK_USB:
+#if HID_POINTER_USB
+    return usbHid.ready();
+#else
+    return false;
+#endif
+  case POINTER_LINK_BLE:
+    // The granted interval can change after connect (the central answers
+    // the update request, or renegotiates later)
+    if (nowUs - bleIntervalCheckedUs >= BLE_INTERVAL_REFRESH_US) {
+      bleIntervalCheckedUs = nowUs;
+      ble_gap_conn_desc desc;
+      if (ble_gap_conn_find(bleConnHandle, &desc) == 0)
+        onBleInterval(desc.conn_itvl * BLE_INTERVAL_UNIT_US);
+    }
+    return nowUs - lastBleSendUs >= bleIntervalUs_;
+  default:
+    return false;
+  }
+}
+
+uint32_t HidPointer::waitUs(uint32_t nowUs) const {
+  if (link() != POINTER_LINK_BLE)
+    return 0;
+  const uint32_t since = nowUs - lastBleSendUs;
+  const uint32_t interval = bleIntervalUs_;
+  return since >= interval ? 0 : interval - since;
+}
+
+void HidPointer::send(int8_t dx, int8_t dy) {
+  switch (link()) {
+  case POINTER_LINK_USB:
+#if HID_POINTER_USB
+    usbMouse.move(dx, dy);
+#endif
+    break;
+  case POINTER_LINK_BLE: {
+    uint8_t report[4] = {0, (uint8_t)dx, (uint8_t)dy, 0};
+    bleInput->setValue(report, sizeof(report));
+    bleInput->notify();
+    lastBleSendUs = micros();
+    break;
+  }
+  default:
+    break;
+  }
+}
@@ -0,0 +1,180 @@
+#include "imu_fifo.h"
+
+// ── MPU6500 register map (subset) ──
+#define REG_CONFIG 0x1A
+#define REG_FIFO_EN 0x23
+#define REG_INT_PIN_CFG 0x37
+#define REG_INT_ENABLE 0x38
+#define REG_USER_CTRL 0x6A
+#define REG_FIFO_COUNTH 0x72
+#define REG_FIFO_R_W 0x74
+
+#define CONFIG_FIFO_MODE 0x40     // stop writing when full (keeps alignment)
+#define FIFO_EN_ACCEL_GYRO 0x78   // ACCEL + GYRO_X/Y/Z
+#define INT_PIN_CFG_MASK 0xF0     // ACTL | OPEN | LATCH_INT_EN | ANYRD_2CLEAR
+#define INT_PIN_CFG_ANYRD_2CLEAR 0x10 // any register read clears INT_STATUS
+#define INT_ENABLE_RAW_RDY 0x01
+#define USER_CTRL_FIFO_EN 0x40
+#define USER_CTRL_FIFO_RST 0x04
+
+ImuFifo *ImuFifo::instance = nullptr;
+
+void IRAM_ATTR ImuFifo::onDataReady() {
+  ImuFifo *self = instance;
+  if (self) {
+    self->lastIrqUs = micros();
+    self->irqCount = self->irqCount + 1;
+    if (self->notifyTask) {
+      BaseType_t woken = pdFALSE;
+      vTaskNotifyGiveFromISR(self->notifyTask, &woken);
+      if (woken)
+        portYIELD_FROM_ISR();
+    }
+  }
+}
+
+bool ImuFifo::writeReg(uint8_t reg, uint8_t val) {
+  bus->beginTransmission(addr);
+  bus->write(reg);
+  bus->write(val);
+  if (bus->endTransmission() != 0) {
+    busErrors++;
+    return false;
+  }
+  return true;
+}
+
+bool ImuFifo::readRegs(uint8_t reg, uint8_t *buf, size_t len) {
+  bus->beginTransmission(addr);
+  bus->write(reg);
+  if (bus->endTransmission(false) != 0 ||
+      bus->requestFrom(addr, (uint8_t)len) != len) {
+    busErrors++;
+    return false;
+  }
+  bus->readBytes(buf, len);
+  return true;
+}
+
+bool ImuFifo::begin(TwoWire &wire, int pin, uint8_t sampleRateDivider,
+                    MPU6500_accRange accRange, MPU6500_gyroRange gyrRange) {
+  bus = &wire;
+  intPin = pin;
+
+  // Same scaling MPU6500_WE uses in getGValues() / getGyrValues()
+  accScale = (1 << accRange) / 16384.0f;
+  gyrScale = (1 << gyrRange) * 250.0f / 32768.0f;
+  // Internal rate is 1 kHz with the DLPF enabled
+  samplePeriodUs = 1000UL * (1 + sampleRateDivider);
+
+  uint8_t cfg = 0, pinCfg = 0;
+  if (!readRegs(REG_CONFIG, &cfg, 1) || !readRegs(REG_INT_PIN_CFG, &pinCfg, 1))
+    return false;
+  // ACTL, OPEN and LATCH_INT_EN cleared: active high, push-pull, 50 µs pulse.
+  // ANYRD_2CLEAR: the FIFO reads clear the status, no INT_STATUS read needed
+  pinCfg = (pinCfg & ~INT_PIN_CFG_MASK) | INT_PIN_CFG_ANYRD_2CLEAR;
+
+  bool ok = writeReg(REG_CONFIG, cfg | CONFIG_FIFO_MODE) &&
+            writeReg(REG_INT_PIN_CFG, pinCfg) &&
+            writeReg(REG_FIFO_EN, FIFO_EN_ACCEL_GYRO) &&
+            writeReg(REG_INT_ENABLE, INT_ENABLE_RAW_RDY);
+  if (!ok)
+    return false;
+
+  reset();
+
+  instance = this;
+  pinMode(intPin, INPUT);
+  attachInterrupt(digitalPinToInterrupt(intPin), onDataReady, RISING);
+  return true;
+}
+
+void ImuFifo::setOffsets(const xyzFloat &accOffset, const xyzFloat &gyrOffset) {
+  // (raw - off / rangeFactor) * scale  ==  raw * scale - off * baseScale
+  accBias = xyzFloat(accOffset.x / 16384.0f, accOffset.y / 16384.0f,
+                     accOffset.z / 16384.0f);
+  gyrBias = xyzFloat(gyrOffset.x * 250.0f / 32768.0f,
+                     gyrOffset.y * 250.0f / 32768.0f,
+                     gyrOffset.z * 250.0f / 32768.0f);
+}
+
+void ImuFifo::reset() {
+  uint8_t ctrl = 0;
+  readRegs(REG_USER_CTRL, &ctrl, 1);
+  writeReg(REG_USER_CTRL, (ctrl & ~USER_CTRL_FIFO_EN) | USER_CTRL_FIFO_RST);
+  writeReg(REG_USER_CTRL, ctrl | USER_CTRL_FIFO_EN);
+  drainedIrqCount = irqCount;
+  cadenceValid = false;
+}
+
+void ImuFifo::decodeFrame(const uint8_t *p, ImuSample &s) const {
+  int16_t ax = (int16_t)((p[0] << 8) | p[1]);
+  int16_t ay = (int16_t)((p[2] << 8) | p[3]);
+  int16_t az = (int16_t)((p[4] << 8) | p[5]);
+  int16_t gx = (int16_t)((p[6] << 8) | p[7]);
+  int16_t gy = (int16_t)((p[8] << 8) | p[9]);
+  int16_t gz = (int16_t)((p[10] << 8) | p[11]);
+  s.acc = xyzFloat(ax * accScale - accBias.x, ay * accScale - accBias.y,
+                   az * accScale - accBias.z);
+  s.gyr = xyzFloat(gx * gyrScale - gyrBias.x, gy * gyrScale - gyrBias.y,
+                   gz * gyrScale - gyrBias.z);
+}
+
+size_t ImuFifo::drain(ImuSample *out, size_t maxSamples) {
+  uint32_t irqSnapshot = irqCount;
+  uint32_t irqUs = lastIrqUs;
+
+  uint8_t cnt[2];
+  if (!readRegs(REG_FIFO_COUNTH, cnt, 2))
+    return 0;
+  size_t bytes = ((cnt[0] & 0x1F) << 8) | cnt[1];
+
+  // A full FIFO has stopped accepting writes mid-frame: resync from scratch
+  if (bytes > IMU_FIFO_SIZE_BYTES - IMU_FIFO_FRAME_BYTES) {
+    overflows++;
+    reset();
+    return 0;
+  }
+
+  size_t available = bytes / IMU_FIFO_FRAME_BYTES;
+  size_t frames = available < maxSamples ? available : maxSamples;
+  if (frames == 0) {
+    drainedIrqCount = irqSnapshot;
+    return 0;
+  }
+
+  // Timestamps: the newest frame in the FIFO belongs to the last data-ready
+  // edge. Keep the fixed cadence and only snap to the interrupt clock when
+  // it drifts by more than half a period (lost frames, FIFO reset).
+  uint32_t newestUs = irqUs - (uint32_t)(available - frames) * samplePeriodUs;
+  uint32_t firstUs = newestUs - (uint32_t)(frames - 1) * samplePeriodUs;
+  if (!cadenceValid ||
+      abs((int32_t)(firstUs - nextSampleUs)) > (int32_t)(samplePeriodUs / 2)) {
+    nextSampleUs = firstUs;
+    cadenceValid = true;
+  }
+
+  uint8_t buf[IMU_FIFO_BURST_FRAMES * IMU_FIFO_FRAME_BYTES];
+  size_t done = 0;
+  while (done < frames) {
+    size_t chunk = frames - done;
+    if (chunk > IMU_FIFO_BURST_FRAMES)
+      chunk = IMU_FIFO_BURST_FRAMES;
+    if (!readRegs(REG_FIFO_R_W, buf, chunk * IMU_FIFO_FRAME_BYTES)) {
+      // Partial read leaves the FIFO misaligned
+      reset();
+      return done;
+    }
+    for (size_t i = 0; i < chunk; i++) {
+      ImuSample &s = out[done + i];
+      decodeFrame(&buf[i * IMU_FIFO_FRAME_BYTES], s);
+      s.tUs = nextSampleUs;
+      nextSampleUs += samplePeriodUs;
+    }
+    done += chunk;
+  }
+
+  uint32_t remaining = available - frames;
+  drainedIrqCount = irqSnapshot - remaining;
+  return done;
+}
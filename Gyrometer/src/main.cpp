@@ -1,7 +1,20 @@
 #include "HMC5883L.h"
+#include "calib_store.h"
+#include "fusion.h"
+#include "gyro_recal.h"
+#include "hid_pointer.h"
+#include "i2c_health.h"
+#include "imu_fifo.h"
+#include "mag_fit.h"
+#include "motion_scaling.h"
+#include "perf_stats.h"
+#include "pointer_engine.h"
+#include "runtime_config.h"
+#include "smoothing.h"
+#include "spsc_ring.h"
+#include "telemetry.h"
 #include <Arduino.h>
 #include <MPU9250_WE.h>
-#include <MadgwickAHRS.h>
 #include <WiFi.h>
 #include <WiFiUdp.h>
 #include <Wire.h>
@@ -21,6 +34,133 @@
 #define SERVER_IP 192, 168, 1, 100
 #define UDP_PORT 4210
 
+// Runtime configuration (see include/runtime_config.h): SERVER_IP, UDP_PORT,
+// the IMU rate / DLPF / ranges, EMA_ALPHA and FUSION_BETA below are only the
+// defaults. "SET,<key>,<value>" over serial or UDP changes one while the
+// device runs; it is stored in NVS once no change has come for
+// CONFIG_SAVE_DELAY_MS, so a sweep does not write the flash on every step.
+#define CONFIG_SAVE_DELAY_MS 5000
+
+// Wi-Fi connects in the background: samples stream over serial from boot
+// and hand over to UDP once the station has an IP, and fall back to serial
+// whenever the link drops. Reconnect attempts back off between these bounds.
+#define WIFI_RETRY_MIN_MS 500
+#define WIFI_RETRY_MAX_MS 8000
+
+// Wire format for orientation samples (see include/telemetry.h)
+//   TELEMETRY_FORMAT_BINARY — CRC-checked frames, 12-byte header + payload
+//                             (EULER 20 bytes, QUAT 22)
+//   TELEMETRY_FORMAT_ASCII  — legacy "EULER,r,p,y" text lines
+#ifndef TELEMETRY_FORMAT
+#define TELEMETRY_FORMAT TELEMETRY_FORMAT_BINARY
+#endif
+
+// Orientation output
+//   1 — smooth the fusion quaternion (nlerp/slerp) and send QUAT samples;
+//       Euler angles are only computed on the host
+//   0 — per-axis Euler EMA, EULER samples
+#ifndef OUTPUT_QUATERNION
+#define OUTPUT_QUATERNION 1
+#endif
+#define QUAT_SMOOTH_SLERP 0 // 0 = normalized lerp (no trig), 1 = slerp
+#define EMA_ALPHA 0.15f     // lower = smoother but more lag
+// Latency compensation (include/smoothing.h): turn the smoothed output
+// ahead by the gyro rate for this long; 0 = off. The EMA lags by
+// (1 - EMA_ALPHA) / EMA_ALPHA samples (57 ms at 0.15 and 100 Hz); measure
+// what a horizon buys on a capture with viewer/replay.py --latency.
+#define PREDICT_HORIZON_MS 0
+
+// Host-side fusion: 1 = no fusion on the device, stream calibrated
+// accel/gyro/mag as FRAME_RAW samples at the IMU's full rate and let
+// viewer/server.py run the filter (binary format only)
+#ifndef OUTPUT_RAW
+#define OUTPUT_RAW 0
+#endif
+#if OUTPUT_RAW && TELEMETRY_FORMAT != TELEMETRY_FORMAT_BINARY
+#error "OUTPUT_RAW needs TELEMETRY_FORMAT_BINARY"
+#endif
+
+// Orientation filter (see include/fusion.h)
+//   FUSION_MADGWICK, FUSION_MADGWICK_ADAPTIVE, FUSION_MADGWICK_FIXED,
+//   FUSION_MAHONY, FUSION_COMPLEMENTARY
+// FUSION_INVSQRT (build flag) picks the float inverse square root.
+// FUSION_MADGWICK_ADAPTIVE converges faster from boot and trusts the accel
+// less under linear acceleration, but tracks worse than plain Madgwick on
+// every test/test_fusion_bench profile, so it is opt-in.
+#ifndef FUSION_FILTER
+#define FUSION_FILTER FUSION_MADGWICK
+#endif
+// Madgwick beta; for the adaptive filter its gain at rest. Mahony and
+// complementary keep their own gains (the "beta" key is rejected).
+#if FUSION_FILTER == FUSION_MADGWICK_ADAPTIVE
+#define FUSION_BETA 0.2f
+#else
+#define FUSION_BETA MADGWICK_BETA_DEFAULT
+#endif
+#define FUSION_HAS_BETA                                                        \
+  (FUSION_FILTER == FUSION_MADGWICK ||                                         \
+   FUSION_FILTER == FUSION_MADGWICK_ADAPTIVE ||                               \
+   FUSION_FILTER == FUSION_MADGWICK_FIXED)
+// 0 = 6-axis only: the mag is never read, every sample takes the 6-axis kernel
+#ifndef FUSION_USE_MAG
+#define FUSION_USE_MAG 1
+#endif
+// 1 = print cycles/update of every filter at boot (delays the first sample)
+#ifndef FUSION_BENCHMARK
+#define FUSION_BENCHMARK 0
+#endif
+
+// UDP coalescing (binary format only): pack up to N samples into one
+// datagram, never holding the oldest longer than the latency budget (plus
+// up to half a budget of transport wake-up slack). 1 = one datagram per sample.
+#if OUTPUT_RAW
+#define TELEMETRY_BATCH_SAMPLES 10 // 1 kHz raw: 100 datagrams/s
+#else
+#define TELEMETRY_BATCH_SAMPLES 1
+#endif
+#define TELEMETRY_BATCH_BUDGET_US 5000
+#if TELEMETRY_FORMAT == TELEMETRY_FORMAT_BINARY && TELEMETRY_BATCH_SAMPLES > 1
+#define TELEMETRY_BATCHING 1
+#else
+#define TELEMETRY_BATCHING 0
+#endif
+
+// Pointer output (see include/hid_pointer.h): the device is also a HID mouse
+// driven by gyro rate (include/pointer_engine.h) — over native USB when a
+// host has it configured, else BLE once a central connects. With neither,
+// the UDP/serial stream drives the host-side pointer as before. Each change
+// is announced as a "POINTER,<usb|ble|none>" line. While a HID link is up the
+// stream drops to one keepalive sample per POINTER_STREAM_KEEPALIVE_MS and
+// Wi-Fi to deep modem sleep; both come back when the link goes.
+// Opt-in (pio run -e pointer): USB HID needs the TinyUSB port setup of that
+// env, which takes the native port's CDC away.
+#ifndef POINTER_HID
+#define POINTER_HID 0
+#endif
+#ifndef POINTER_USB
+#define POINTER_USB 1
+#endif
+#ifndef POINTER_BLE
+#define POINTER_BLE 1
+#endif
+#define POINTER_BLE_NAME "Gyrometer"
+#define POINTER_BLE_INTERVAL 6 // × 1.25 ms = 7.5 ms, the shortest BLE allows
+// Acceleration curve, dead zone and tremor filter (include/pointer_engine.h)
+#define POINTER_GAIN_LOW 8.0f   // counts per degree, slow precise turns
+#define POINTER_GAIN_HIGH 30.0f // counts per degree, fast turns
+#define POINTER_GAIN_KNEE_DPS 60.0f
+#define POINTER_CURVE_EXPONENT 2.0f
+#define POINTER_DEAD_ZONE_DPS 1.0f
+#define POINTER_TREMOR_MIN_HZ 5.0f // 0 = no tremor filter
+#define POINTER_TREMOR_HZ_PER_DPS 0.2f
+// Gyro axis (0 = x, 1 = y, 2 = z) and sign for cursor right / down
+#define POINTER_AXIS_X 2
+#define POINTER_SIGN_X -1.0f
+#define POINTER_AXIS_Y 1
+#define POINTER_SIGN_Y 1.0f
+#define POINTER_MAX_DT_US 50000 // longest gap one sample may cover
+#define POINTER_STREAM_KEEPALIVE_MS 1000
+
 // ╔══════════════════════════════════════════════════╗
 // ║             HARDWARE CONFIGURATION              ║
 // ╚══════════════════════════════════════════════════╝
@@ -29,8 +169,104 @@
 // Correct addresses
 #define MPU6500_ADDR 0x68
 #define HMC5883L_ADDR 0x1E
+#define IMU_INT_PIN 4 // MPU6500 INT → GPIO (only used in FIFO mode)
+#define I2C_CLOCK_HZ 400000
+
+// ── I2C health (see include/i2c_health.h) ──
+// Inferred from the regular reads: a device is marked down after this many
+// consecutive failed reads, or identical samples, then probed with backoff
+// and re-initialised once it ACKs again. After I2C_RECOVER_AFTER failed
+// probes the bus itself is recovered (SCL clocked out, Wire re-initialised).
+#define IMU_FAIL_READS 5
+#define IMU_STUCK_READS 50 // 0.5 s at 100 Hz; real samples always carry noise
+#define MAG_FAIL_READS 5
+#define MAG_STUCK_READS 40 // mag polls without a new output (~0.5 s)
+#define I2C_RECOVER_AFTER 3
+#define I2C_RECOVER_MIN_MS 1000
 
-// ── HMC5883L Calibration (Placeholders) ──
+// ── IMU acquisition ──
+// 1 = data-ready interrupt + on-chip FIFO (requires INT wired to IMU_INT_PIN)
+// 0 = millis() polling with separate accel / gyro reads
+#ifndef IMU_USE_FIFO
+#define IMU_USE_FIFO 0
+#endif
+#if OUTPUT_RAW
+#define IMU_SAMPLE_RATE_DIVIDER 0 // 1kHz
+#define IMU_DLPF MPU6500_DLPF_3   // ~42 Hz bandwidth, worth sampling at 1 kHz
+#else
+#define IMU_SAMPLE_RATE_DIVIDER 9 // 1kHz / (1+9) = 100Hz
+#define IMU_DLPF MPU6500_DLPF_6   // ~5 Hz bandwidth
+#endif
+#define IMU_FIFO_BATCH 1          // drain once this many samples are queued
+#define IMU_FIFO_MAX_BATCH 40     // upper bound per drain (stack buffer)
+#define IMU_ACC_RANGE_G 4
+#define IMU_GYRO_RANGE_DPS 500
+
+// ── Motion scaling (see include/motion_scaling.h) ──
+// Still for MOTION_IDLE_AFTER_MS: the IMU drops to MOTION_IDLE_RATE_DIVIDER,
+// Wi-Fi goes to deep modem sleep and samples that would repeat the last one
+// sent are suppressed (one keepalive frame per MOTION_KEEPALIVE_MS). Any
+// motion above MOTION_WAKE_DPS / MOTION_WAKE_ACC_G, or the MPU6500
+// wake-on-motion interrupt between two slow samples, restores the configured
+// rate at once. Each change is announced as a "MOTION,<idle|active>" line.
+#ifndef MOTION_SCALING
+#define MOTION_SCALING 1
+#endif
+#define MOTION_WAKE_DPS 3.0f
+#define MOTION_WAKE_ACC_G 0.05f
+#define MOTION_IDLE_AFTER_MS 3000
+#define MOTION_IDLE_RATE_DIVIDER 99 // 1kHz / (1+99) = 10Hz
+#define MOTION_IDLE_DEADBAND 2      // LSB an idle sample may move unsent
+#define MOTION_KEEPALIVE_MS 1000
+// Wake-on-motion needs the MPU6500 INT line, which FIFO mode already uses
+// for data-ready; polling builds take it on IMU_INT_PIN. -1 = not wired (a
+// pickup is then seen on the next slow sample).
+#define MOTION_WOM_PIN IMU_INT_PIN
+#define MOTION_WOM_MG 40 // accel change that wakes (4 mg steps)
+#define MOTION_WOM (MOTION_SCALING && !IMU_USE_FIFO && MOTION_WOM_PIN >= 0)
+
+// ── Magnetometer acquisition ──
+// HMC5883L in continuous-measurement mode; the sensor task reads it on its
+// own schedule (or on DRDY when wired) and fuses each sample once — IMU ticks
+// in between take the 6-axis update.
+#define MAG_DATA_RATE HMC5883L_RATE_75
+#define MAG_PERIOD_US 13333 // 1 / 75 Hz
+#define MAG_AVERAGING HMC5883L_AVERAGING_1
+#define MAG_DRDY_PIN -1 // HMC5883L DRDY → GPIO, -1 = not wired (use schedule)
+
+// ── Tasks ──
+// Sensing + fusion run on core 1; transport (UDP/serial, Wi-Fi manager) runs
+// on core 0 next to the Wi-Fi stack. They only share the output ring. The
+// pointer task (HID reports) also runs on core 0 and shares only the pointer
+// engine with the sensor task.
+#define SENSOR_TASK_CORE 1
+#define SENSOR_TASK_PRIORITY 10
+#define SENSOR_TASK_STACK 8192
+#define TRANSPORT_TASK_CORE 0
+#define TRANSPORT_TASK_PRIORITY 3
+#define TRANSPORT_TASK_STACK 8192
+#define POINTER_TASK_CORE 0
+#define POINTER_TASK_PRIORITY 4 // above transport: reports never wait on UDP
+#define POINTER_TASK_STACK 4096
+#define OUTPUT_RING_SIZE 256 // records (2.5 s at 100 Hz)
+
+// Per-stage cycle profiling (see include/perf_stats.h). PERF lines go out on
+// the active transport when "PERF" is typed on the serial console, or every
+// PERF_REPORT_MS if set (0 = on demand only, nothing joins the stream).
+#ifndef PERF_PROFILING
+#define PERF_PROFILING 1
+#endif
+#ifndef PERF_REPORT_MS
+#define PERF_REPORT_MS 0
+#endif
+
+// ── Calibration (see include/calib_store.h) ──
+// IMU offsets come from NVS when they were taken within CALIB_MAX_TEMP_DELTA_C
+// of the current die temperature; otherwise autoOffsets() runs (device flat
+// and still) and the result is stored. The mag offset + soft-iron matrix are
+// written to NVS by the calibration env; these placeholders (a diagonal
+// matrix) apply until then.
+#define CALIB_MAX_TEMP_DELTA_C 10.0f
 #define MAG_OFFSET_X 0.0f
 #define MAG_OFFSET_Y 0.0f
 #define MAG_OFFSET_Z 0.0f
@@ -39,101 +275,1495 @@
 #define MAG_SCALE_Z 1.0f
 #define MAG_UT_PER_LSB (100.0f / 1090.0f)
 
+// Gyro bias refresh while the device rests (see include/gyro_recal.h). New
+// offsets apply at once; NVS is rewritten at most every GYRO_RECAL_SAVE_MS.
+#ifndef GYRO_RECAL
+#define GYRO_RECAL 1
+#endif
+#define GYRO_RECAL_WINDOW 200 // samples (2 s at 100 Hz)
+#define GYRO_RECAL_MIN_DPS 0.05f // ignore corrections below the noise floor
+#define GYRO_RECAL_SAVE_MS 600000
+
 // ── Objects ──
 MPU6500_WE imu = MPU6500_WE(MPU6500_ADDR); // MPU6500, NOT MPU9250!
+ImuFifo imuFifo(MPU6500_ADDR);
 HMC5883L mag;
-Madgwick filter;
+MadgwickFilter madgwickFilter;
+MahonyFilter mahonyFilter;
+ComplementaryFilter complementaryFilter;
+AdaptiveMadgwickFilter adaptiveFilter;
+FixedMadgwickFilter fixedFilter;
+// Indexed by the FUSION_* selection values
+FusionFilter *const fusionFilters[] = {&madgwickFilter, &mahonyFilter,
+                                       &complementaryFilter, &adaptiveFilter,
+                                       &fixedFilter};
+FusionFilter &filter = *fusionFilters[FUSION_FILTER];
 WiFiUDP udp;
 
+// ── Sensor → transport records ──
+enum RecordKind : uint8_t {
+  REC_EULER,
+  REC_QUAT,
+  REC_STATUS,
+  REC_DIAG,
+  REC_PERF,
+  REC_CALIB,
+  REC_RAW
+};
+
+struct OutputRecord {
+  RecordKind kind;
+  uint8_t flags; // StatusFlags
+  uint16_t seq;
+  uint32_t tUs;
+  union {
+    struct {
+      float roll, pitch, yaw;
+    } euler;
+    struct {
+      float w, x, y, z;
+    } quat;
+    struct {
+      float acc[3], gyr[3], mag[3]; // g, deg/s, µT
+    } raw;
+    struct {
+      bool imu, mag;
+    } status;
+    struct {
+      float a[3], g[3], m[3];
+      float rpy[3];
+      bool magValid;
+    } diag;
+    struct {
+      uint8_t stage; // PerfStage
+      bool last;     // final sensor stage of this report
+      PerfSummary s;
+    } perf;
+    struct {
+      float acc[3], gyr[3]; // MPU6500_WE offset units
+      float tempC;
+      bool saveNow; // fresh autoOffsets(); otherwise a background refresh
+    } calib;
+  };
+};
+
+SpscRing<OutputRecord, OUTPUT_RING_SIZE> outputRing;
+#if TELEMETRY_BATCHING
+FrameBatcher batcher(TELEMETRY_BATCH_SAMPLES, TELEMETRY_BATCH_BUDGET_US);
+#endif
+TaskHandle_t sensorTaskHandle = nullptr;
+TaskHandle_t transportTaskHandle = nullptr;
+TaskHandle_t pointerTaskHandle = nullptr;
+
+// ── Profiling ──
+// Sensor-side stages are only written by the sensor task, encode/send only
+// by the transport task; each side summarises and resets its own.
+#if PERF_PROFILING
+PerfStats perfStats[PERF_STAGE_COUNT];
+std::atomic<bool> perfRequested{false};
+unsigned long lastPerfReport = 0;
+
+struct PerfScope {
+  PerfStats &stats;
+  uint32_t start;
+  explicit PerfScope(PerfStage stage)
+      : stats(perfStats[stage]), start(ESP.getCycleCount()) {}
+  ~PerfScope() { stats.add(ESP.getCycleCount() - start); }
+};
+#define PERF_CONCAT_(a, b) a##b
+#define PERF_CONCAT(a, b) PERF_CONCAT_(a, b)
+#define PERF_SCOPE(stage) PerfScope PERF_CONCAT(perfScope_, __LINE__)(stage)
+#else
+#define PERF_SCOPE(stage)
+#endif
+
 // ── Timing ──
-unsigned long lastUpdate = 0;
-unsigned long lastStatusCheck = 0;
-unsigned long lastWiFiCheck = 0;
 unsigned long lastDiag = 0;
 
 // ── State ──
 bool imuConnected = true;
 bool magConnected = true;
-bool useWiFi = false;
-bool wifiEverConnected = false;
+bool useWiFi = false; // transport task only; follows wifiHasIP
+// Set from the Wi-Fi event callback (see onWiFiEvent)
+std::atomic<bool> wifiHasIP{false};
+std::atomic<uint32_t> wifiDisconnects{0};
+std::atomic<uint8_t> wifiDisconnectReason{0};
 
 // ── EMA smoothing ──
-const float EMA_ALPHA = 0.15f; // lower = smoother but more lag
 float smoothRoll = 0, smoothPitch = 0, smoothYaw = 0;
+Quat smoothQ = {1.0f, 0.0f, 0.0f, 0.0f};
 bool emaInitialized = false;
+uint16_t sampleSeq = 0;
+
+// ── Calibration ──
+// Loaded in setup(). Afterwards the transport task owns the IMU half (it
+// merges REC_CALIB updates and writes NVS); the mag half never changes.
+CalibrationData calib;
+bool calibDirty = false;
+unsigned long lastCalibSave = 0;
+#if GYRO_RECAL
+GyroBiasTracker gyroBias(GYRO_RECAL_WINDOW);
+#endif
+
+// ── Motion scaling ──
+// The sensor task owns the detector and the suppressor; motionIdle mirrors
+// the state for the transport task (Wi-Fi power, MOTION line).
+#if MOTION_SCALING
+MotionDetector motion(MOTION_WAKE_DPS, MOTION_WAKE_ACC_G,
+                      MOTION_IDLE_AFTER_MS * 1000UL);
+FrameSuppressor frameSuppressor(MOTION_KEEPALIVE_MS * 1000UL);
+std::atomic<bool> motionIdle{false};
+#endif
+#if MOTION_WOM
+std::atomic<bool> womFired{false};
+#endif
+
+// ── Runtime configuration ──
+// The transport task owns `config`: it runs the host commands, applies the
+// network settings itself and writes NVS. The sensor task works from its own
+// copy, taken between two samples whenever sensorConfigApply has bits set.
+RuntimeConfig config;
+RuntimeConfig sensorConfig, sensorConfigNext; // next: under configMux
+portMUX_TYPE configMux = portMUX_INITIALIZER_UNLOCKED;
+std::atomic<uint8_t> sensorConfigApply{0}; // CONFIG_APPLY_IMU / _FILTER
+std::atomic<uint32_t> imuPeriodUs{1000UL * (1 + IMU_SAMPLE_RATE_DIVIDER)};
+bool configDirty = false;
+unsigned long lastConfigChange = 0;
+
+#if OUTPUT_RAW
+static_assert(IMU_ACC_RANGE_G <= RAW_ACC_MAX_G &&
+                  IMU_GYRO_RANGE_DPS <= RAW_GYR_MAX_DPS,
+              "FRAME_RAW clips beyond ±4 g / ±500 dps");
+
+// FRAME_RAW packs at fixed scales: a wider range would clip what host
+// fusion, replay and allan.py see
+bool rawRangesFit(const RuntimeConfig &c) {
+  return c.accRangeG <= RAW_ACC_MAX_G && c.gyrRangeDps <= RAW_GYR_MAX_DPS;
+}
+#endif
+
+RuntimeConfig defaultRuntimeConfig() {
+  RuntimeConfig c;
+  memset(&c, 0, sizeof(c));
+  c.version = CONFIG_VERSION;
+  c.rateDivider = IMU_SAMPLE_RATE_DIVIDER;
+  c.dlpf = IMU_DLPF;
+  c.accRangeG = IMU_ACC_RANGE_G;
+  c.gyrRangeDps = IMU_GYRO_RANGE_DPS;
+  c.emaAlpha = EMA_ALPHA;
+  c.beta = FUSION_BETA;
+  c.predictMs = PREDICT_HORIZON_MS;
+  const uint8_t ip[4] = {SERVER_IP};
+  memcpy(c.serverIp, ip, sizeof(ip));
+  c.udpPort = UDP_PORT;
+  return c;
+}
+
+// ── Pointer ──
+// The sensor task adds motion, the pointer task takes reports; the engine is
+// a few floats, so a spinlock around each side is enough.
+#if POINTER_HID
+HidPointer hidPointer;
+PointerConfig pointerConfig() {
+  PointerConfig c = defaultPointerConfig();
+  c.lowGain = POINTER_GAIN_LOW;
+  c.highGain = POINTER_GAIN_HIGH;
+  c.kneeDps = POINTER_GAIN_KNEE_DPS;
+  c.curveExponent = POINTER_CURVE_EXPONENT;
+  c.deadZoneDps = POINTER_DEAD_ZONE_DPS;
+  c.tremorMinHz = POINTER_TREMOR_MIN_HZ;
+  c.tremorHzPerDps = POINTER_TREMOR_HZ_PER_DPS;
+  return c;
+}
+PointerEngine pointer(pointerConfig());
+portMUX_TYPE pointerMux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+// ── Output buffers (transport task only; no heap after setup) ──
+char lineBuf[160];
+uint32_t heapFreeAtBoot = 0;
 
 // Static IP objects
 IPAddress staticIP(STATIC_IP);
 IPAddress gateway(GATEWAY);
 IPAddress subnet(SUBNET);
-IPAddress serverIP(SERVER_IP);
+IPAddress serverIP(SERVER_IP); // config.serverIp / udpPort once loaded
+uint16_t udpPort = UDP_PORT;
+uint16_t deviceId = 0; // telemetry sender ID (frame header), set in setup()
+
+// ── I2C health ──
+// Sensor task only: it owns the bus, so probes and recovery never race a read
+DeviceHealth imuHealth(IMU_FAIL_READS, IMU_STUCK_READS);
+DeviceHealth magHealth(MAG_FAIL_READS, MAG_STUCK_READS);
+uint32_t i2cBusRecoveries = 0;
+unsigned long lastBusRecovery = 0;
 
-// ── I2C health check ──
 bool checkI2CDevice(uint8_t addr) {
   Wire.beginTransmission(addr);
   return (Wire.endTransmission() == 0);
 }
 
 // ── Send a line over the active transport ──
-void sendLine(const String &line) {
+void sendLine(const char *line, size_t len) {
   if (useWiFi) {
-    udp.beginPacket(serverIP, UDP_PORT);
-    udp.print(line);
+    udp.beginPacket(serverIP, udpPort);
+    udp.write((const uint8_t *)line, len);
     udp.endPacket();
   } else {
-    Serial.println(line);
+    Serial.write((const uint8_t *)line, len);
+    Serial.write((const uint8_t *)"\r\n", 2);
     Serial.flush(); // Ensure the entire line is transmitted before anything
                     // else prints
   }
 }
 
-// ── Angle-aware EMA (handles wraparound) ──
-float emaAngle(float smoothed, float raw, float alpha) {
-  float diff = raw - smoothed;
-  // Wrap the difference to [-180, 180]
-  while (diff > 180.0f)
-    diff -= 360.0f;
-  while (diff < -180.0f)
-    diff += 360.0f;
-  return smoothed + alpha * diff;
+void sendLine(const char *line) { sendLine(line, strlen(line)); }
+
+// ── Fixed-point "%.Nf" without float printf (no dtoa, no heap) ──
+size_t formatFixed(char *out, size_t cap, float v, int decimals) {
+  static const long scales[] = {1, 10, 100, 1000, 10000};
+  long scale = scales[decimals];
+  long fixed = lroundf(v * scale);
+  unsigned long mag = fixed < 0 ? -fixed : fixed;
+  return snprintf(out, cap, "%s%lu.%0*lu", fixed < 0 ? "-" : "", mag / scale,
+                  decimals, mag % scale);
 }
 
-// ── WiFi setup with timeout ──
-bool setupWiFi() {
+// "<prefix>,v0,v1,..." into lineBuf; returns the length
+size_t formatSampleLine(const char *prefix, const float *values, int count,
+                        int decimals) {
+  size_t len = snprintf(lineBuf, sizeof(lineBuf), "%s", prefix);
+  for (int i = 0; i < count; i++) {
+    lineBuf[len++] = ',';
+    len += formatFixed(lineBuf + len, sizeof(lineBuf) - len, values[i],
+                       decimals);
+  }
+  return len;
+}
+
+// ── Serial-only diagnostic line from a static buffer ──
+void diagPrintf(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf(lineBuf, sizeof(lineBuf), fmt, args);
+  va_end(args);
+  if (len > 0)
+    Serial.write((const uint8_t *)lineBuf,
+                 (size_t)len < sizeof(lineBuf) ? len : sizeof(lineBuf) - 1);
+}
+
+// ── Send a binary frame over the active transport ──
+void sendFrame(const uint8_t *frame, size_t len) {
+  if (len == 0)
+    return;
+  PERF_SCOPE(PERF_SEND);
+  if (useWiFi) {
+    udp.beginPacket(serverIP, udpPort);
+    udp.write(frame, len);
+    udp.endPacket();
+  } else {
+    Serial.write(frame, len);
+  }
+}
+
+// ── Send the open UDP batch, if any ──
+void flushBatch() {
+#if TELEMETRY_BATCHING
+  size_t len;
+  const uint8_t *frame = batcher.flush(len);
+  sendFrame(frame, len);
+#endif
+}
+
+// ── Hand a record to the transport task (never blocks) ──
+void publish(const OutputRecord &rec) {
+  outputRing.push(rec);
+  if (transportTaskHandle)
+    xTaskNotifyGive(transportTaskHandle);
+}
+
+// ── Magnetometer read (calibrated, µT) ──
+// magCache holds the latest sample; `fresh` until one IMU sample fuses it.
+struct MagReading {
+  float x, y, z;
+  bool valid;
+  bool fresh;
+};
+
+MagReading magCache = {0, 0, 0, false, false};
+const MagReading magNone = {0, 0, 0, false, false};
+int16_t magLastRaw[3] = {0, 0, 0};
+uint32_t magNextUs = 0;
+
+#if MAG_DRDY_PIN >= 0
+volatile bool magDataReady = false;
+void IRAM_ATTR onMagDataReady() { magDataReady = true; }
+#endif
+
+// Reads the HMC5883L only when a new output is due
+void pollMag(uint32_t nowUs) {
+  if (!FUSION_USE_MAG || !magHealth.ok()) {
+    magCache.valid = magCache.fresh = false;
+    return;
+  }
+#if MAG_DRDY_PIN >= 0
+  if (!magDataReady)
+    return;
+  magDataReady = false;
+#else
+  if ((int32_t)(nowUs - magNextUs) < 0)
+    return;
+#endif
+
+  int16_t raw[3] = {0, 0, 0};
+  {
+    PERF_SCOPE(PERF_MAG_READ);
+    mag.getHeading(&raw[0], &raw[1], &raw[2]);
+  }
+  // All-zero registers: the transfer failed (or the chip reset to idle)
+  const bool ok = raw[0] != 0 || raw[1] != 0 || raw[2] != 0;
+  // Same registers as last time: the next output isn't out yet, retry on the
+  // next IMU tick. Too many in a row and the device counts as stuck.
+  const bool changed = raw[0] != magLastRaw[0] || raw[1] != magLastRaw[1] ||
+                       raw[2] != magLastRaw[2];
+  magHealth.onRead(ok, changed);
+  if (!ok || !changed)
+    return;
+  magLastRaw[0] = raw[0];
+  magLastRaw[1] = raw[1];
+  magLastRaw[2] = raw[2];
+
+  // Next output lands ~one period after this one; check from one IMU tick
+  // (or half a period) before that
+  const uint32_t periodUs = imuPeriodUs;
+  const uint32_t slackUs =
+      periodUs < MAG_PERIOD_US / 2 ? periodUs : MAG_PERIOD_US / 2;
+  magNextUs = nowUs + MAG_PERIOD_US - slackUs;
+
+  // Hard iron, then the soft-iron matrix from the ellipsoid fit
+  float ut[3];
+  magApplyCalibration(raw, calib.magOffset, calib.magSoftIron,
+                      MAG_UT_PER_LSB, ut);
+  magCache.x = ut[0];
+  magCache.y = ut[1];
+  magCache.z = ut[2];
+  magCache.valid = true;
+  magCache.fresh = true;
+}
+
+// Hands new IMU offsets to the transport task for NVS
+void publishCalib(bool saveNow, float tempC) {
+  OutputRecord rec;
+  rec.kind = REC_CALIB;
+  rec.tUs = micros();
+  const xyzFloat acc = imu.getAccOffsets(), gyr = imu.getGyrOffsets();
+  rec.calib.acc[0] = acc.x;
+  rec.calib.acc[1] = acc.y;
+  rec.calib.acc[2] = acc.z;
+  rec.calib.gyr[0] = gyr.x;
+  rec.calib.gyr[1] = gyr.y;
+  rec.calib.gyr[2] = gyr.z;
+  rec.calib.tempC = tempC;
+  rec.calib.saveNow = saveNow;
+  publish(rec);
+}
+
+#if GYRO_RECAL
+// A still window's mean gyro reading is residual bias: fold it into the
+// offsets (MPU6500_WE keeps them in raw LSB at 250 dps)
+void refreshGyroBias() {
+  const float lsbPerDps = 32768.0f / 250.0f;
+  const float bx = gyroBias.bias(0), by = gyroBias.bias(1),
+              bz = gyroBias.bias(2);
+  if (fabsf(bx) < GYRO_RECAL_MIN_DPS && fabsf(by) < GYRO_RECAL_MIN_DPS &&
+      fabsf(bz) < GYRO_RECAL_MIN_DPS)
+    return;
+  xyzFloat gyr = imu.getGyrOffsets();
+  gyr.x += bx * lsbPerDps;
+  gyr.y += by * lsbPerDps;
+  gyr.z += bz * lsbPerDps;
+  imu.setGyrOffsets(gyr);
+#if IMU_USE_FIFO
+  imuFifo.setOffsets(imu.getAccOffsets(), gyr);
+#endif
+  publishCalib(false, imu.getTemperature());
+}
+#endif
+
+// False when accel and gyro are bit-identical to the previous sample
+bool changedSample(const xyzFloat &a, const xyzFloat &g) {
+  static xyzFloat lastA = {0, 0, 0}, lastG = {0, 0, 0};
+  const bool changed = a.x != lastA.x || a.y != lastA.y || a.z != lastA.z ||
+                       g.x != lastG.x || g.y != lastG.y || g.z != lastG.z;
+  lastA = a;
+  lastG = g;
+  return changed;
+}
+
+#if POINTER_HID
+// ── Gyro rate → pointer motion (sensor task) ──
+float gyroAxis(const xyzFloat &g, int axis) {
+  return axis == 0 ? g.x : (axis == 1 ? g.y : g.z);
+}
+
+void feedPointer(const xyzFloat &g, uint32_t tUs) {
+  static uint32_t lastUs = 0;
+  uint32_t dtUs = tUs - lastUs;
+  lastUs = tUs;
+  if (dtUs > POINTER_MAX_DT_US)
+    dtUs = POINTER_MAX_DT_US;
+  // Always fed so the filter and bias stay warm; without a HID host the
+  // motion is dropped, so a connect starts from rest
+  const bool linked = hidPointer.link() != POINTER_LINK_NONE;
+  portENTER_CRITICAL(&pointerMux);
+  pointer.addRate(POINTER_SIGN_X * gyroAxis(g, POINTER_AXIS_X),
+                  POINTER_SIGN_Y * gyroAxis(g, POINTER_AXIS_Y), dtUs * 1e-6f);
+  if (!linked)
+    pointer.drop();
+  portEXIT_CRITICAL(&pointerMux);
+  if (linked && pointerTaskHandle)
+    xTaskNotifyGive(pointerTaskHandle);
+}
+#endif
+
+// False for an orientation sample that would repeat the last one sent
+bool sampleChanged(const int16_t *v, int count, uint32_t tUs) {
+#if MOTION_SCALING
+  return frameSuppressor.changed(
+      v, count, motion.idle() ? MOTION_IDLE_DEADBAND : 0, tUs);
+#else
+  return true;
+#endif
+}
+
+// ── Fusion + smoothing + output for one IMU sample ──
+void processSample(const xyzFloat &a, const xyzFloat &g, const MagReading &m,
+                   uint32_t tUs) {
+  // 9-axis update only with a new, valid mag sample, otherwise 6-axis
+  const bool fuseMag = FUSION_USE_MAG && m.valid && m.fresh;
+#if !OUTPUT_RAW
+  {
+    PERF_SCOPE(PERF_FUSION);
+    if (fuseMag) {
+      filter.update(g.x, g.y, g.z, a.x, a.y, a.z, m.x, m.y, m.z);
+    } else {
+      filter.updateIMU(g.x, g.y, g.z, a.x, a.y, a.z);
+    }
+  }
+#endif
+
+#if POINTER_HID
+  feedPointer(g, tUs);
+#endif
+
+#if GYRO_RECAL
+  if (gyroBias.add(a.x, a.y, a.z, g.x, g.y, g.z))
+    refreshGyroBias();
+#endif
+
+#if MOTION_SCALING
+  // The new rate is applied before the next sample (applySensorConfig)
+  if (motion.add(a.x, a.y, a.z, g.x, g.y, g.z, tUs))
+    sensorConfigApply |= CONFIG_APPLY_IMU | CONFIG_APPLY_FILTER;
+#endif
+
+  OutputRecord rec;
+  rec.flags = (imuConnected ? STATUS_IMU_OK : 0) |
+              (magConnected ? STATUS_MAG_OK : 0) |
+              (fuseMag ? STATUS_MAG_FUSED : 0);
+  rec.tUs = tUs;
+
+#if OUTPUT_RAW
+  // Fusion runs on the host; STATUS_MAG_FUSED marks a fresh mag reading
+  rec.kind = REC_RAW;
+  rec.seq = sampleSeq++;
+  rec.raw = {{a.x, a.y, a.z}, {g.x, g.y, g.z}, {m.x, m.y, m.z}};
+  publish(rec);
+#elif OUTPUT_QUATERNION
+  // Smooth on the unit sphere: no per-axis wraparound and no Euler
+  // singularity at ±90° pitch; no trig on the hot path with nlerp
+  Quat q = filter.quaternion();
+  if (!isnan(q.w) && !isnan(q.x) && !isnan(q.y) && !isnan(q.z)) {
+    PERF_SCOPE(PERF_SMOOTH);
+    if (!emaInitialized) {
+      smoothQ = q;
+      emaInitialized = true;
+    } else {
+#if QUAT_SMOOTH_SLERP
+      smoothQ = quatSlerp(smoothQ, q, sensorConfig.emaAlpha);
+#else
+      smoothQ = quatNlerp(smoothQ, q, sensorConfig.emaAlpha);
+#endif
+    }
+    Quat out = smoothQ;
+    if (sensorConfig.predictMs)
+      out = quatPredict(smoothQ, g.x, g.y, g.z, sensorConfig.predictMs * 1e-3f);
+    int16_t v[4];
+    quatToFixed(out.w, out.x, out.y, out.z, v);
+    if (sampleChanged(v, 4, tUs)) {
+      rec.kind = REC_QUAT;
+      rec.seq = sampleSeq++;
+      rec.quat = {out.w, out.x, out.y, out.z};
+      publish(rec);
+    }
+  }
+#else
+  float roll = filter.getRoll();
+  float pitch = filter.getPitch();
+  float yaw = filter.getYaw();
+
+  // Guard against nan (can happen during first few iterations)
+  if (!isnan(roll) && !isnan(pitch) && !isnan(yaw)) {
+    PERF_SCOPE(PERF_SMOOTH);
+    // Apply EMA smoothing
+    if (!emaInitialized) {
+      smoothRoll = roll;
+      smoothPitch = pitch;
+      smoothYaw = yaw;
+      emaInitialized = true;
+    } else {
+      const float alpha = sensorConfig.emaAlpha;
+      smoothRoll = emaAngle(smoothRoll, roll, alpha);
+      smoothPitch = emaAngle(smoothPitch, pitch, alpha);
+      smoothYaw = emaAngle(smoothYaw, yaw, alpha);
+    }
+
+    float outRoll = smoothRoll, outPitch = smoothPitch, outYaw = smoothYaw;
+    if (sensorConfig.predictMs)
+      eulerPredict(filter.quaternion(), g.x, g.y, g.z,
+                   sensorConfig.predictMs * 1e-3f, outRoll, outPitch, outYaw);
+    int16_t v[3];
+    eulerToFixed(outRoll, outPitch, outYaw, v);
+    if (sampleChanged(v, 3, tUs)) {
+      rec.kind = REC_EULER;
+      rec.seq = sampleSeq++;
+      rec.euler = {outRoll, outPitch, outYaw};
+      publish(rec);
+    }
+  }
+#endif
+
+  // Periodic diagnostic (every 3 seconds)
+  if (millis() - lastDiag >= 3000) {
+    lastDiag = millis();
+    OutputRecord rec;
+    rec.kind = REC_DIAG;
+    rec.tUs = tUs;
+#if OUTPUT_RAW
+    // The on-device filter does not run: no attitude to report
+    rec.diag = {{a.x, a.y, a.z}, {g.x, g.y, g.z}, {m.x, m.y, m.z},
+                {0.0f, 0.0f, 0.0f}, m.valid};
+#else
+    rec.diag = {{a.x, a.y, a.z}, {g.x, g.y, g.z}, {m.x, m.y, m.z},
+                {filter.getRoll(), filter.getPitch(), filter.getYaw()},
+                m.valid};
+#endif
+    publish(rec);
+  }
+}
+
+#if PERF_PROFILING
+// ── PERF report ──
+// "PERF,<stage>,<count>,<min>,<mean>,<p99>,<max>" in CPU cycles, preceded by
+// "PERF,clock,<cpu MHz>,<sample period µs>" so the host can convert.
+void sendPerfLine(uint8_t stage, const PerfSummary &p) {
+  int len = snprintf(lineBuf, sizeof(lineBuf), "PERF,%s,%lu,%lu,%lu,%lu,%lu",
+                     perfStageName(stage), (unsigned long)p.count,
+                     (unsigned long)p.min, (unsigned long)p.mean,
+                     (unsigned long)p.p99, (unsigned long)p.max);
+  sendLine(lineBuf, len);
+}
+
+// Sensor task: snapshot + reset its stages into the ring
+void publishPerf(uint32_t tUs) {
+  const uint8_t sensorStages[] = {PERF_IMU_READ, PERF_MAG_READ, PERF_FUSION,
+                                  PERF_SMOOTH, PERF_SENSOR};
+  const size_t n = sizeof(sensorStages) / sizeof(sensorStages[0]);
+  for (size_t i = 0; i < n; i++) {
+    OutputRecord rec;
+    rec.kind = REC_PERF;
+    rec.tUs = tUs;
+    rec.perf.stage = sensorStages[i];
+    rec.perf.last = i == n - 1;
+    rec.perf.s = perfStats[sensorStages[i]].summary();
+    perfStats[sensorStages[i]].reset();
+    publish(rec);
+  }
+}
+
+// Transport task: print a sensor stage; after the last one, its own stages
+void sendPerf(const OutputRecord &rec) {
+  if (rec.perf.stage == PERF_IMU_READ) {
+    int len = snprintf(lineBuf, sizeof(lineBuf), "PERF,clock,%lu,%lu",
+                       (unsigned long)ESP.getCpuFreqMHz(),
+                       (unsigned long)imuPeriodUs.load());
+    sendLine(lineBuf, len);
+  }
+  sendPerfLine(rec.perf.stage, rec.perf.s);
+  if (rec.perf.last) {
+    const uint8_t transportStages[] = {PERF_ENCODE, PERF_SEND};
+    for (uint8_t stage : transportStages) {
+      sendPerfLine(stage, perfStats[stage].summary());
+      perfStats[stage].reset();
+    }
+  }
+}
+#else
+void sendPerf(const OutputRecord &) {}
+#endif
+
+// ── Host commands (one per serial line or UDP datagram) ──
+//   PERF                 request a PERF report (PERF_PROFILING builds)
+//   SYNC,<id>,<host_us>  clock probe from viewer/latency.py, answered at once:
+//                        SYNC,<id>,<host_us>,<device_us>,<age_mean_us>,
+//                        <age_max_us>,<ring_drops>
+//   CONFIG               list the runtime configuration, one
+//                        CONFIG,<key>,<value> line per setting
+//   SET,<key>,<value>    change one setting (include/runtime_config.h);
+//                        answered CONFIG,<key>,<value> or CONFIG,ERR,<key>
+//                        (OUTPUT_RAW: acc_range above 4 / gyro_range above
+//                        500 are rejected, FRAME_RAW would clip)
+//   DEFAULTS             back to the compiled defaults, NVS copy erased
+// age_* is the sample → transport hand-off delay since the previous reply.
+uint32_t sampleAgeSumUs = 0, sampleAgeMaxUs = 0, sampleAgeCount = 0;
+
+void noteSampleAge(uint32_t tUs) {
+  uint32_t age = micros() - tUs;
+  sampleAgeSumUs += age;
+  sampleAgeCount++;
+  if (age > sampleAgeMaxUs)
+    sampleAgeMaxUs = age;
+}
+
+// Answer on the link the command came in on
+void replyLine(const char *line, size_t len, bool viaUdp) {
+  if (viaUdp) {
+    udp.beginPacket(udp.remoteIP(), udp.remotePort());
+    udp.write((const uint8_t *)line, len);
+    udp.endPacket();
+  } else {
+    Serial.write((const uint8_t *)line, len);
+    Serial.write((const uint8_t *)"\r\n", 2);
+  }
+}
+
+void replyConfig(uint8_t key, bool viaUdp) {
+  int len = snprintf(lineBuf, sizeof(lineBuf), "CONFIG,");
+  len += configFormat(config, key, lineBuf + len, sizeof(lineBuf) - len);
+  if ((size_t)len < sizeof(lineBuf))
+    replyLine(lineBuf, len, viaUdp);
+}
+
+// Transport task: take a new configuration. The network half is applied
+// here, the rest goes to the sensor task; NVS follows in saveConfigIfDue().
+void applyConfig(const RuntimeConfig &next, uint8_t apply) {
+  config = next;
+  configDirty = true;
+  lastConfigChange = millis();
+  if (apply & (CONFIG_APPLY_IMU | CONFIG_APPLY_FILTER)) {
+    portENTER_CRITICAL(&configMux);
+    sensorConfigNext = config;
+    portEXIT_CRITICAL(&configMux);
+    sensorConfigApply |= apply & (CONFIG_APPLY_IMU | CONFIG_APPLY_FILTER);
+  }
+  if (apply & CONFIG_APPLY_NET) {
+    serverIP = IPAddress(config.serverIp[0], config.serverIp[1],
+                         config.serverIp[2], config.serverIp[3]);
+    const bool rebind = config.udpPort != udpPort;
+    udpPort = config.udpPort;
+    if (rebind && useWiFi) {
+      udp.stop();
+      udp.begin(udpPort);
+    }
+  }
+}
+
+void setCommand(char *args, bool viaUdp) {
+  char *value = strchr(args, ',');
+  uint8_t apply = 0;
+  RuntimeConfig next = config;
+  if (value) {
+    *value++ = '\0';
+    apply = configSet(next, args, value);
+#if !FUSION_HAS_BETA
+    if (configKeyLookup(args) == CONFIG_BETA)
+      apply = 0;
+#endif
+#if OUTPUT_RAW
+    if (!rawRangesFit(next))
+      apply = 0;
+#endif
+  }
+  if (!apply) {
+    int len = snprintf(lineBuf, sizeof(lineBuf), "CONFIG,ERR,%s", args);
+    if (len > 0 && (size_t)len < sizeof(lineBuf))
+      replyLine(lineBuf, len, viaUdp);
+    return;
+  }
+  // Answer first: a new port or server must not swallow the reply
+  const uint8_t key = configKeyLookup(args);
+  applyConfig(next, apply & ~CONFIG_APPLY_NET);
+  replyConfig(key, viaUdp);
+  if (apply & CONFIG_APPLY_NET)
+    applyConfig(next, CONFIG_APPLY_NET);
+}
+
+void handleCommand(char *cmd, bool viaUdp) {
+  size_t n = strlen(cmd);
+  while (n > 0 &&
+         (cmd[n - 1] == '\r' || cmd[n - 1] == '\n' || cmd[n - 1] == ' '))
+    cmd[--n] = '\0';
+
+  if (strncmp(cmd, "SYNC,", 5) == 0) {
+    uint32_t nowUs = micros();
+    int len = snprintf(
+        lineBuf, sizeof(lineBuf), "%s,%lu,%lu,%lu,%lu", cmd,
+        (unsigned long)nowUs,
+        (unsigned long)(sampleAgeCount ? sampleAgeSumUs / sampleAgeCount : 0),
+        (unsigned long)sampleAgeMaxUs, (unsigned long)outputRing.dropped());
+    sampleAgeSumUs = sampleAgeMaxUs = sampleAgeCount = 0;
+    if (len > 0 && (size_t)len < sizeof(lineBuf))
+      replyLine(lineBuf, len, viaUdp);
+  } else if (strcmp(cmd, "CONFIG") == 0) {
+    for (uint8_t key = 0; key < CONFIG_KEY_COUNT; key++)
+      replyConfig(key, viaUdp);
+  } else if (strncmp(cmd, "SET,", 4) == 0) {
+    setCommand(cmd + 4, viaUdp);
+  } else if (strcmp(cmd, "DEFAULTS") == 0) {
+    configClear();
+    const RuntimeConfig defaults = defaultRuntimeConfig();
+    applyConfig(defaults, CONFIG_APPLY_IMU | CONFIG_APPLY_FILTER);
+    for (uint8_t key = 0; key < CONFIG_KEY_COUNT; key++)
+      replyConfig(key, viaUdp);
+    applyConfig(defaults, CONFIG_APPLY_NET);
+    configDirty = false; // nothing stored: later builds' defaults apply
+  }
+#if PERF_PROFILING
+  else if (strcmp(cmd, "PERF") == 0) {
+    perfRequested = true;
+  }
+#endif
+}
+
+void pollCommands() {
+  static char serialCmd[64];
+  static size_t serialLen = 0;
+  while (Serial.available() > 0) {
+    char c = (char)Serial.read();
+    if (c == '\r' || c == '\n') {
+      serialCmd[serialLen] = '\0';
+      if (serialLen > 0)
+        handleCommand(serialCmd, false);
+      serialLen = 0;
+    } else if (serialLen < sizeof(serialCmd) - 1) {
+      serialCmd[serialLen++] = c;
+    }
+  }
+
+  if (!useWiFi)
+    return;
+  char packet[64];
+  while (udp.parsePacket() > 0) {
+    int len = udp.read(packet, sizeof(packet) - 1);
+    if (len <= 0)
+      continue;
+    packet[len] = '\0';
+    handleCommand(packet, true);
+  }
+}
+
+// ── Transport task: format + send one record ──
+#if POINTER_HID
+// A HID link carries the pointer: the stream only has to show the device is
+// there (and roughly where it points), so most samples are dropped
+bool streamSampleDue(uint32_t tUs) {
+  static bool throttled = false;
+  static uint32_t lastUs = 0;
+  if (hidPointer.link() == POINTER_LINK_NONE) {
+    throttled = false;
+    return true;
+  }
+  if (throttled && tUs - lastUs < POINTER_STREAM_KEEPALIVE_MS * 1000UL)
+    return false;
+  throttled = true;
+  lastUs = tUs;
+  return true;
+}
+#endif
+
+void sendRecord(const OutputRecord &rec) {
+  switch (rec.kind) {
+  case REC_EULER:
+  case REC_QUAT:
+  case REC_RAW: {
+#if POINTER_HID
+    if (!streamSampleDue(rec.tUs))
+      break;
+#endif
+    const bool isQuat = rec.kind == REC_QUAT;
+    const float *values = isQuat ? &rec.quat.w : &rec.euler.roll;
+    noteSampleAge(rec.tUs);
+#if TELEMETRY_FORMAT == TELEMETRY_FORMAT_BINARY
+    const FrameType type = rec.kind == REC_RAW ? FRAME_RAW
+                           : isQuat            ? FRAME_QUAT
+                                               : FRAME_EULER;
+    int16_t v[TELEMETRY_MAX_VALUES];
+    {
+      PERF_SCOPE(PERF_ENCODE);
+      if (rec.kind == REC_RAW)
+        rawToFixed(rec.raw.acc, rec.raw.gyr, rec.raw.mag, v);
+      else if (isQuat)
+        quatToFixed(values[0], values[1], values[2], values[3], v);
+      else
+        eulerToFixed(values[0], values[1], values[2], v);
+    }
+#if TELEMETRY_BATCHING
+    if (useWiFi) {
+      if (!batcher.accepts(type, rec.seq, rec.tUs))
+        flushBatch();
+      {
+        PERF_SCOPE(PERF_ENCODE);
+        batcher.add(type, rec.flags, rec.seq, rec.tUs, v, micros());
+      }
+      if (batcher.full())
+        flushBatch();
+      break;
+    }
+    flushBatch(); // transport fell back to serial mid-batch
+#endif
+    uint8_t frame[TELEMETRY_MAX_FRAME_BYTES];
+    size_t len;
+    {
+      PERF_SCOPE(PERF_ENCODE);
+      len = encodeFrame(frame, sizeof(frame), type, rec.seq, rec.tUs,
+                        rec.flags, v, deviceId);
+    }
+    sendFrame(frame, len);
+#else
+    size_t len;
+    {
+      PERF_SCOPE(PERF_ENCODE);
+      len = isQuat ? formatSampleLine("QUAT", values, 4, 4)
+                   : formatSampleLine("EULER", values, 3, 2);
+    }
+    PERF_SCOPE(PERF_SEND);
+    sendLine(lineBuf, len);
+#endif
+    break;
+  }
+  case REC_STATUS: {
+    int len = snprintf(lineBuf, sizeof(lineBuf), "STATUS,%d,%d",
+                       rec.status.imu ? 1 : 0, rec.status.mag ? 1 : 0);
+    sendLine(lineBuf, len);
+    break;
+  }
+  case REC_DIAG: {
+    const auto &d = rec.diag;
+#if OUTPUT_RAW
+    diagPrintf("DIAG: a=(%.2f,%.2f,%.2f) g=(%.1f,%.1f,%.1f) "
+               "m=(%.1f,%.1f,%.1f) magValid=%d\n",
+               d.a[0], d.a[1], d.a[2], d.g[0], d.g[1], d.g[2], d.m[0], d.m[1],
+               d.m[2], d.magValid);
+#else
+    diagPrintf("DIAG: a=(%.2f,%.2f,%.2f) g=(%.1f,%.1f,%.1f) "
+               "m=(%.1f,%.1f,%.1f) magValid=%d RPY=(%.1f,%.1f,%.1f)\n",
+               d.a[0], d.a[1], d.a[2], d.g[0], d.g[1], d.g[2], d.m[0], d.m[1],
+               d.m[2], d.magValid, d.rpy[0], d.rpy[1], d.rpy[2]);
+#endif
+    // Heap: free / low-water / largest block, fragmentation and drift since
+    // the end of setup() — the sample path must keep all of these flat
+    uint32_t heapFree = ESP.getFreeHeap();
+    uint32_t maxBlock = ESP.getMaxAllocHeap();
+    diagPrintf("DIAG: heap free=%lu min=%lu maxBlock=%lu frag=%lu%% "
+               "drift=%ld\n",
+               (unsigned long)heapFree, (unsigned long)ESP.getMinFreeHeap(),
+               (unsigned long)maxBlock,
+               heapFree ? (unsigned long)(100 - (uint64_t)maxBlock * 100 /
+                                                    heapFree)
+                        : 0UL,
+               (long)heapFree - (long)heapFreeAtBoot);
+    if (wifiDisconnects)
+      diagPrintf("DIAG: wifi disconnects=%lu lastReason=%u\n",
+                 (unsigned long)wifiDisconnects.load(),
+                 (unsigned)wifiDisconnectReason.load());
+    if (outputRing.dropped())
+      diagPrintf("DIAG: output ring dropped=%lu\n",
+                 (unsigned long)outputRing.dropped());
+#if MOTION_SCALING
+    diagPrintf("DIAG: motion %s period=%luus suppressed=%lu\n",
+               motionIdle ? "idle" : "active",
+               (unsigned long)imuPeriodUs.load(),
+               (unsigned long)frameSuppressor.suppressed());
+#endif
+    if (imuHealth.failureCount() || magHealth.failureCount() ||
+        i2cBusRecoveries)
+      diagPrintf("DIAG: i2c imuFailures=%lu magFailures=%lu "
+                 "busRecoveries=%lu\n",
+                 (unsigned long)imuHealth.failureCount(),
+                 (unsigned long)magHealth.failureCount(),
+                 (unsigned long)i2cBusRecoveries);
+#if IMU_USE_FIFO
+    if (imuFifo.overflowCount() || imuFifo.busErrorCount())
+      diagPrintf("DIAG: fifo overflows=%lu busErrors=%lu\n",
+                 (unsigned long)imuFifo.overflowCount(),
+                 (unsigned long)imuFifo.busErrorCount());
+#endif
+    break;
+  }
+  case REC_PERF:
+    sendPerf(rec);
+    break;
+  case REC_CALIB:
+    for (int i = 0; i < 3; i++) {
+      calib.accOffset[i] = rec.calib.acc[i];
+      calib.gyrOffset[i] = rec.calib.gyr[i];
+    }
+    calib.imuTempC = rec.calib.tempC;
+    calib.flags |= CALIB_HAS_IMU;
+    calibDirty = true;
+    if (rec.calib.saveNow)
+      lastCalibSave = millis() - GYRO_RECAL_SAVE_MS;
+    break;
+  }
+}
+
+// Background bias refreshes are rate-limited to spare the flash
+void saveCalibIfDue() {
+  if (!calibDirty || millis() - lastCalibSave < GYRO_RECAL_SAVE_MS)
+    return;
+  calibDirty = false;
+  lastCalibSave = millis();
+  calibSave(calib);
+}
+
+// A settings sweep is many SETs in a row: store once it has settled
+void saveConfigIfDue() {
+  if (!configDirty || millis() - lastConfigChange < CONFIG_SAVE_DELAY_MS)
+    return;
+  configDirty = false;
+  sendLine(configSave(config) ? "CONFIG,saved" : "CONFIG,ERR,save");
+}
+
+// ── Wi-Fi connection manager ──
+// The event callback runs in the Wi-Fi event task and only records link
+// state; the transport task switches transport and paces reconnects, so
+// nothing ever waits on the radio.
+
+void onWiFiEvent(arduino_event_id_t event, arduino_event_info_t info) {
+  switch (event) {
+  case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+    wifiHasIP = true;
+    break;
+  case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+    wifiHasIP = false;
+    break;
+  case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+    wifiHasIP = false;
+    wifiDisconnectReason = info.wifi_sta_disconnected.reason;
+    wifiDisconnects++;
+    break;
+  default:
+    return;
+  }
+  if (transportTaskHandle)
+    xTaskNotifyGive(transportTaskHandle);
+}
+
+// Boot: returns at once; the connection completes in the background
+void startWiFi() {
   Serial.print("WiFi: Connecting to ");
-  Serial.println(WIFI_SSID);
+  Serial.print(WIFI_SSID);
+  Serial.println(" in the background, streaming on Serial");
 
+  WiFi.onEvent(onWiFiEvent);
+  WiFi.setAutoReconnect(false); // reconnects are paced by wifiService()
   WiFi.mode(WIFI_STA);
   // IP Config restored!
   WiFi.config(staticIP, gateway, subnet);
   WiFi.begin(WIFI_SSID, WIFI_PASS);
+}
 
-  unsigned long start = millis();
-  while (WiFi.status() != WL_CONNECTED && millis() - start < 5000) {
-    delay(100);
-    Serial.print(".");
-  }
-  Serial.println();
+// Transport task: hand over between UDP and serial, retry with backoff
+void wifiService() {
+  static uint32_t seenDisconnects = 0;
+  static uint32_t retryDelayMs = WIFI_RETRY_MIN_MS;
+  static unsigned long retryAt = 0;
+  static bool retryPending = false;
 
-  if (WiFi.status() == WL_CONNECTED) {
+  const bool up = wifiHasIP;
+  if (up && !useWiFi) {
+    // Same port for sending and for host commands (SYNC replies go back to
+    // the sender, see pollCommands)
+    udp.begin(udpPort);
     Serial.print("WiFi: Connected! IP = ");
-    Serial.println(WiFi.localIP());
-    Serial.print("WiFi: Gateway: ");
-    Serial.println(WiFi.gatewayIP());
-    Serial.print("WiFi: Sending UDP to ");
+    Serial.print(WiFi.localIP());
+    Serial.print(", sending UDP to ");
     Serial.print(serverIP);
     Serial.print(":");
-    Serial.println(UDP_PORT);
+    Serial.println(udpPort);
+    useWiFi = true;
+    retryDelayMs = WIFI_RETRY_MIN_MS;
+    retryPending = false;
+    sendLine("TRANSPORT,wifi");
+  } else if (!up && useWiFi) {
+    useWiFi = false;
+    sendLine("TRANSPORT,serial");
+  }
 
-    wifiEverConnected = true;
-    return true;
+  // Every failed attempt or dropped link ends in a DISCONNECTED event
+  const uint32_t disconnects = wifiDisconnects;
+  if (disconnects != seenDisconnects) {
+    seenDisconnects = disconnects;
+    if (!up && !retryPending) {
+      retryPending = true;
+      retryAt = millis() + retryDelayMs;
+      retryDelayMs = retryDelayMs * 2 > WIFI_RETRY_MAX_MS
+                         ? WIFI_RETRY_MAX_MS
+                         : retryDelayMs * 2;
+    }
+  }
+  if (retryPending && !up && (long)(millis() - retryAt) >= 0) {
+    retryPending = false;
+    WiFi.reconnect(); // asynchronous: the outcome arrives as an event
+  }
+}
+
+// Transport task: deep modem sleep while the stream is down to keepalives
+// (HID link up, or still); otherwise the station default
+void applyWiFiPower() {
+  bool quiet = false;
+#if MOTION_SCALING
+  quiet = motionIdle;
+#endif
+#if POINTER_HID
+  quiet = quiet || hidPointer.link() != POINTER_LINK_NONE;
+#endif
+  WiFi.setSleep(quiet ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM);
+}
+
+#if MOTION_SCALING
+// Transport task: Wi-Fi power follows the motion state. Idle streams a
+// keepalive a second, so the radio may skip beacons (host commands then wait
+// up to a listen interval); active wakes every DTIM, the station default,
+// unless a HID link still carries the pointer (applyWiFiPower()).
+void serviceMotion() {
+  static bool announcedIdle = false;
+  const bool idle = motionIdle;
+  if (idle == announcedIdle)
+    return;
+  announcedIdle = idle;
+  applyWiFiPower();
+  sendLine(idle ? "MOTION,idle" : "MOTION,active");
+}
+#endif
+
+#if POINTER_HID
+// Transport task: announce pointer link changes on the stream and move the
+// radio in or out of deep modem sleep
+void servicePointerLink() {
+  static PointerLink announced = POINTER_LINK_NONE;
+  const PointerLink link = hidPointer.link();
+  if (link == announced)
+    return;
+  announced = link;
+  applyWiFiPower();
+  int len = snprintf(lineBuf, sizeof(lineBuf), "POINTER,%s",
+                     pointerLinkName(link));
+  sendLine(lineBuf, len);
+}
+#endif
+
+// ── Device init (setup, and re-init once a lost device ACKs again) ──
+bool imuCalibrated = false;
+bool imuCalibratedFromNvs = false;
+
+// Divider in use: the configured one, or the idle one while still
+uint8_t currentRateDivider() {
+#if MOTION_SCALING
+  if (motion.idle() && MOTION_IDLE_RATE_DIVIDER > sensorConfig.rateDivider)
+    return MOTION_IDLE_RATE_DIVIDER;
+#endif
+  return sensorConfig.rateDivider;
+}
+
+// Rate, DLPF and ranges from sensorConfig: after init(), and on a host or
+// motion change between two samples (offsets are kept)
+bool configureImu() {
+  const uint8_t divider = currentRateDivider();
+  const MPU6500_dlpf dlpf = (MPU6500_dlpf)sensorConfig.dlpf;
+  const MPU6500_accRange accRange =
+      (MPU6500_accRange)configAccRangeCode(sensorConfig);
+  const MPU6500_gyroRange gyrRange =
+      (MPU6500_gyroRange)configGyrRangeCode(sensorConfig);
+  imu.enableGyrDLPF();
+  imu.setGyrDLPF(dlpf);
+  imu.enableAccDLPF(true);
+  imu.setAccDLPF(dlpf);
+  imu.setSampleRateDivider(divider);
+  imu.setAccRange(accRange);
+  imu.setGyrRange(gyrRange);
+  imuPeriodUs = 1000UL * (1 + divider);
+#if IMU_USE_FIFO
+  // Restarts the FIFO and its timestamp cadence at the new rate
+  imuFifo.setOffsets(imu.getAccOffsets(), imu.getGyrOffsets());
+  return imuFifo.begin(Wire, IMU_INT_PIN, divider, accRange, gyrRange);
+#else
+  return true;
+#endif
+}
+
+// Sample rate and gain of the active filter from sensorConfig
+void configureFilter() {
+  filter.begin(1000.0f / (1 + currentRateDivider()));
+#if FUSION_FILTER == FUSION_MADGWICK
+  madgwickFilter.setBeta(sensorConfig.beta);
+#elif FUSION_FILTER == FUSION_MADGWICK_ADAPTIVE
+  adaptiveFilter.setStillBeta(sensorConfig.beta);
+#elif FUSION_FILTER == FUSION_MADGWICK_FIXED
+  fixedFilter.setBeta(sensorConfig.beta);
+#endif
+}
+
+#if MOTION_WOM
+void IRAM_ATTR onImuMotion() {
+  womFired = true;
+  if (sensorTaskHandle) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(sensorTaskHandle, &woken);
+    if (woken)
+      portYIELD_FROM_ISR();
+  }
+}
+
+// Idle: any accel change above MOTION_WOM_MG pulses INT (compared sample to
+// sample by the chip, so gravity does not count)
+void armWakeOnMotion(bool on) {
+  if (on) {
+    imu.setIntPinPolarity(MPU6500_ACT_HIGH);
+    imu.setWakeOnMotionThreshold(MOTION_WOM_MG / 4);
+    imu.enableWakeOnMotion(MPU6500_WOM_ENABLE, MPU6500_WOM_COMP_ENABLE);
+    imu.readAndClearInterrupts();
+    imu.enableInterrupt(MPU6500_WOM_INT);
   } else {
-    Serial.println("WiFi: FAILED — falling back to Serial");
-    Serial.println("WIFI_FAIL");
-    WiFi.disconnect(true);
+    imu.disableInterrupt(MPU6500_WOM_INT);
+    imu.enableWakeOnMotion(MPU6500_WOM_DISABLE, MPU6500_WOM_COMP_DISABLE);
+  }
+}
+#endif
+
+// Sensor task: pick up a host or motion change before the next sample
+void applySensorConfig() {
+#if MOTION_WOM
+  if (womFired.exchange(false) && motion.wake())
+    sensorConfigApply |= CONFIG_APPLY_IMU | CONFIG_APPLY_FILTER;
+#endif
+  const uint8_t apply = sensorConfigApply.exchange(0);
+  if (!apply)
+    return;
+  portENTER_CRITICAL(&configMux);
+  sensorConfig = sensorConfigNext;
+  portEXIT_CRITICAL(&configMux);
+  // A lost IMU takes the new settings when it is re-initialised
+  if ((apply & CONFIG_APPLY_IMU) && imuHealth.ok() && !configureImu())
+    imuHealth.onRead(false, false);
+  if (apply & CONFIG_APPLY_FILTER)
+    configureFilter();
+#if MOTION_SCALING
+  const bool idle = motion.idle();
+#if MOTION_WOM
+  if (idle != motionIdle && imuHealth.ok())
+    armWakeOnMotion(idle);
+#endif
+  if (idle != motionIdle) {
+    motionIdle = idle;
+    if (transportTaskHandle)
+      xTaskNotifyGive(transportTaskHandle);
+  }
+#endif
+}
+
+bool initImu() {
+  // init() resets the chip and clears the library's software offsets
+  xyzFloat accOffsets = imu.getAccOffsets();
+  xyzFloat gyrOffsets = imu.getGyrOffsets();
+  if (!imu.init())
     return false;
+  if (!imuCalibrated) {
+    // Boot, or the first time the IMU shows up: stored offsets if they were
+    // taken near this temperature, otherwise calibrate (hold flat and still)
+    const float tempC = imu.getTemperature();
+    if ((calib.flags & CALIB_HAS_IMU) &&
+        fabsf(tempC - calib.imuTempC) <= CALIB_MAX_TEMP_DELTA_C) {
+      imu.setAccOffsets(xyzFloat(calib.accOffset[0], calib.accOffset[1],
+                                 calib.accOffset[2]));
+      imu.setGyrOffsets(xyzFloat(calib.gyrOffset[0], calib.gyrOffset[1],
+                                 calib.gyrOffset[2]));
+      imuCalibratedFromNvs = true;
+    } else {
+      imu.autoOffsets();
+      publishCalib(true, tempC);
+    }
+    imuCalibrated = true;
+  } else {
+    imu.setAccOffsets(accOffsets);
+    imu.setGyrOffsets(gyrOffsets);
+  }
+  return configureImu();
+}
+
+void initMag() {
+  mag.initialize();
+  // initialize() leaves single-measurement mode at 15 Hz
+  mag.setSampleAveraging(MAG_AVERAGING);
+  mag.setDataRate(MAG_DATA_RATE);
+  mag.setMode(HMC5883L_MODE_CONTINUOUS);
+  magNextUs = micros();
+}
+
+// ── I2C bus recovery ──
+// A slave stopped mid-byte can hold SDA low forever. Clock SCL until it lets
+// go (9 pulses cover a full byte + ACK), issue a STOP, then bring Wire back.
+void recoverI2CBus() {
+  Wire.end();
+  pinMode(I2C_SDA_PIN, INPUT_PULLUP);
+  pinMode(I2C_SCL_PIN, OUTPUT_OPEN_DRAIN);
+  for (int i = 0; i < 9 && digitalRead(I2C_SDA_PIN) == LOW; i++) {
+    digitalWrite(I2C_SCL_PIN, LOW);
+    delayMicroseconds(5);
+    digitalWrite(I2C_SCL_PIN, HIGH);
+    delayMicroseconds(5);
+  }
+  pinMode(I2C_SDA_PIN, OUTPUT_OPEN_DRAIN);
+  digitalWrite(I2C_SDA_PIN, LOW);
+  delayMicroseconds(5);
+  digitalWrite(I2C_SCL_PIN, HIGH);
+  delayMicroseconds(5);
+  digitalWrite(I2C_SDA_PIN, HIGH); // STOP: SDA rises while SCL is high
+  delayMicroseconds(5);
+  Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);
+  Wire.setClock(I2C_CLOCK_HZ);
+  i2cBusRecoveries++;
+}
+
+// One recovery step for a failed device: nothing while it is healthy, at
+// most one probe (+ re-init) per backoff interval otherwise
+void serviceDevice(DeviceHealth &health, uint8_t addr, bool isImu,
+                   unsigned long nowMs) {
+  if (!health.probeDue(nowMs))
+    return;
+  bool up = checkI2CDevice(addr);
+  if (up) {
+    if (isImu)
+      up = initImu();
+    else
+      initMag();
+  }
+  if (health.onProbe(up) >= I2C_RECOVER_AFTER &&
+      nowMs - lastBusRecovery >= I2C_RECOVER_MIN_MS) {
+    lastBusRecovery = nowMs;
+    recoverI2CBus();
+  }
+}
+
+// STATUS goes out when either device changes state (and once at boot); the
+// per-sample flags carry it in between
+void serviceI2CHealth(unsigned long nowMs) {
+  static bool published = false;
+  serviceDevice(imuHealth, MPU6500_ADDR, true, nowMs);
+  serviceDevice(magHealth, HMC5883L_ADDR, false, nowMs);
+
+  const bool imuOk = imuHealth.ok(), magOk = magHealth.ok();
+  if (published && imuOk == imuConnected && magOk == magConnected)
+    return;
+  published = true;
+  imuConnected = imuOk;
+  magConnected = magOk;
+  OutputRecord rec;
+  rec.kind = REC_STATUS;
+  rec.tUs = micros();
+  rec.status.imu = imuOk;
+  rec.status.mag = magOk;
+  publish(rec);
+}
+
+// ── Sensor task: I2C health, acquisition, fusion (core 1) ──
+void sensorTask(void *) {
+  TickType_t lastWake = xTaskGetTickCount();
+  for (;;) {
+#if IMU_USE_FIFO
+    // Woken by the data-ready ISR; the timeout keeps health checks running
+    // if the IMU stops interrupting. Two periods at the current rate (idle
+    // included; applySensorConfig() updates imuPeriodUs) plus tick slack, so
+    // a late edge is not taken for a fault
+    const TickType_t edgeTimeout = pdMS_TO_TICKS(2 * imuPeriodUs / 1000 + 10);
+    const bool woken = ulTaskNotifyTake(pdTRUE, edgeTimeout) > 0;
+#else
+#if MOTION_SCALING
+    if (motion.idle()) {
+      // Slow samples; wake-on-motion cuts the wait short
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(imuPeriodUs / 1000));
+      lastWake = xTaskGetTickCount();
+    } else
+#endif
+      vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(imuPeriodUs / 1000));
+#endif
+    PERF_SCOPE(PERF_SENSOR);
+
+    applySensorConfig();
+
+    // ── I2C health: no bus traffic unless a device has failed ──
+    serviceI2CHealth(millis());
+    if (!imuHealth.ok())
+      continue;
+
+    // ── Sensor read ──
+#if IMU_USE_FIFO
+    if (!woken) {
+      // No data-ready edge for a whole timeout: the IMU stopped sampling
+      imuHealth.onRead(false, false);
+    } else if (imuFifo.pending() >= IMU_FIFO_BATCH) {
+      ImuSample batch[IMU_FIFO_MAX_BATCH];
+      size_t n;
+      const uint32_t busErrors = imuFifo.busErrorCount();
+      {
+        PERF_SCOPE(PERF_IMU_READ);
+        n = imuFifo.drain(batch, IMU_FIFO_MAX_BATCH);
+      }
+      imuHealth.onRead(imuFifo.busErrorCount() == busErrors,
+                       n > 0 && changedSample(batch[n - 1].acc,
+                                              batch[n - 1].gyr));
+      if (n > 0) {
+        // A fresh mag sample goes with the newest IMU sample of the batch
+        pollMag(micros());
+        for (size_t i = 0; i < n; i++)
+          processSample(batch[i].acc, batch[i].gyr,
+                        i == n - 1 ? magCache : magNone, batch[i].tUs);
+        magCache.fresh = false;
+      }
+    }
+#else
+    uint32_t tUs = micros();
+    xyzFloat a, g;
+    {
+      PERF_SCOPE(PERF_IMU_READ);
+      a = imu.getGValues();
+      g = imu.getGyrValues();
+    }
+    // MPU6500_WE doesn't surface bus errors; a failed read decodes the same
+    // stale bytes every time, which the stuck counter catches
+    imuHealth.onRead(true, changedSample(a, g));
+    pollMag(tUs);
+    processSample(a, g, magCache, tUs);
+    magCache.fresh = false;
+#endif
+
+#if PERF_PROFILING
+    if (perfRequested.exchange(false) ||
+        (PERF_REPORT_MS > 0 && millis() - lastPerfReport >= PERF_REPORT_MS)) {
+      lastPerfReport = millis();
+      publishPerf(micros());
+    }
+#endif
+  }
+}
+
+// ── Transport task: drains the ring, owns Wi-Fi (core 0) ──
+void transportTask(void *) {
+#if TELEMETRY_BATCHING
+  // Wake often enough to honour the latency budget on a quiet ring
+  const TickType_t waitTicks =
+      pdMS_TO_TICKS(TELEMETRY_BATCH_BUDGET_US / 2000) > 0
+          ? pdMS_TO_TICKS(TELEMETRY_BATCH_BUDGET_US / 2000)
+          : 1;
+#else
+  const TickType_t waitTicks = pdMS_TO_TICKS(50);
+#endif
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, waitTicks);
+    OutputRecord rec;
+    while (outputRing.pop(rec))
+      sendRecord(rec);
+#if TELEMETRY_BATCHING
+    if (batcher.expired(micros()))
+      flushBatch();
+#endif
+    wifiService();
+#if POINTER_HID
+    servicePointerLink();
+#endif
+#if MOTION_SCALING
+    serviceMotion();
+#endif
+    pollCommands();
+    saveCalibIfDue();
+    saveConfigIfDue();
+  }
+}
+
+#if POINTER_HID
+// ── Pointer task: HID reports on the best link (core 0) ──
+// Woken by the sensor task after each sample. Everything accumulated goes
+// out in one report as soon as the link has a free slot (idle USB endpoint,
+// next BLE connection interval); otherwise the task sleeps until the slot.
+bool pointerPending() {
+  portENTER_CRITICAL(&pointerMux);
+  const bool pending =
+      fabsf(pointer.pendingX()) >= 1.0f || fabsf(pointer.pendingY()) >= 1.0f;
+  portEXIT_CRITICAL(&pointerMux);
+  return pending;
+}
+
+void pointerTask(void *) {
+  TickType_t wait = portMAX_DELAY;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, wait);
+    wait = portMAX_DELAY; // until the next sample
+    if (!pointerPending())
+      continue;
+    const uint32_t now = micros();
+    if (hidPointer.ready(now)) {
+      int8_t dx, dy;
+      portENTER_CRITICAL(&pointerMux);
+      const bool have = pointer.take(dx, dy);
+      portEXIT_CRITICAL(&pointerMux);
+      if (have)
+        hidPointer.send(dx, dy);
+      if (!pointerPending())
+        continue;
+    }
+    // More than one report's worth, or the slot is not open yet
+    const uint32_t slotUs = hidPointer.waitUs(micros());
+    wait = slotUs > 1000 ? pdMS_TO_TICKS((slotUs + 999) / 1000) : 1;
+  }
+}
+#endif
+
+#if FUSION_BENCHMARK
+// Cycles per update for each filter on a fixed, realistic input (device
+// slightly tilted and rotating), plus the share of one core each would use
+// at 1 kHz. Filters are reset afterwards.
+void benchmarkFusion() {
+  const int iterations = 1000;
+  const float cyclesPerMs = ESP.getCpuFreqMHz() * 1000.0f;
+  for (FusionFilter *f : fusionFilters) {
+    f->begin(1000.0f / (1 + IMU_SAMPLE_RATE_DIVIDER));
+    uint32_t start = ESP.getCycleCount();
+    for (int i = 0; i < iterations; i++)
+      f->update(12.0f, -3.0f, 25.0f, 0.05f, 0.17f, 0.98f, 21.0f, -4.0f, -38.0f);
+    uint32_t cyc9 = (ESP.getCycleCount() - start) / iterations;
+    start = ESP.getCycleCount();
+    for (int i = 0; i < iterations; i++)
+      f->updateIMU(12.0f, -3.0f, 25.0f, 0.05f, 0.17f, 0.98f);
+    uint32_t cyc6 = (ESP.getCycleCount() - start) / iterations;
+    f->reset();
+    Serial.printf("FUSION: %-14s 9-axis %5lu cyc (%4.1f%% @1kHz), "
+                  "6-axis %5lu cyc (%4.1f%%)%s\n",
+                  f->name(), (unsigned long)cyc9, 100.0f * cyc9 / cyclesPerMs,
+                  (unsigned long)cyc6, 100.0f * cyc6 / cyclesPerMs,
+                  f == &filter ? "  <- active" : "");
   }
 }
+#endif
 
 void setup() {
   Serial.begin(921600);
@@ -143,10 +1773,21 @@ void setup() {
   Serial.printf("Flash size: %d MB\n", ESP.getFlashChipSize() / (1024 * 1024));
   Serial.println("============================");
 
+  // Last two MAC bytes: unique across a batch of modules, and the same as
+  // the end of the MAC on the label, so a host with several units can tell
+  // which is which
+  const uint64_t mac = ESP.getEfuseMac();
+  deviceId = (uint16_t)((((mac >> 32) & 0xFF) << 8) | ((mac >> 40) & 0xFF));
+  Serial.printf("DEVICE: id %04x\n", deviceId);
+#if TELEMETRY_BATCHING
+  batcher.setDevice(deviceId);
+#endif
+
   Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);
-  Wire.setClock(400000);
+  Wire.setClock(I2C_CLOCK_HZ);
 
-  // Check devices
+  // Check devices. One missing now starts out failed and is picked up by the
+  // sensor task's recovery probes when it appears.
   imuConnected = checkI2CDevice(MPU6500_ADDR);
   magConnected = checkI2CDevice(HMC5883L_ADDR);
 
@@ -155,124 +1796,109 @@ void setup() {
   if (!magConnected)
     Serial.println("ERROR: HMC5883L not found!");
 
+  config = defaultRuntimeConfig();
+  if (configLoad(config))
+    Serial.printf("CONFIG: NVS rate_div=%u dlpf=%u udp=%u.%u.%u.%u:%u\n",
+                  config.rateDivider, config.dlpf, config.serverIp[0],
+                  config.serverIp[1], config.serverIp[2], config.serverIp[3],
+                  config.udpPort);
+#if OUTPUT_RAW
+  if (!rawRangesFit(config)) {
+    // Stored by a non-RAW build
+    Serial.println("CONFIG: stored ranges exceed FRAME_RAW, using defaults");
+    config.accRangeG = IMU_ACC_RANGE_G;
+    config.gyrRangeDps = IMU_GYRO_RANGE_DPS;
+  }
+#endif
+  sensorConfig = sensorConfigNext = config;
+  serverIP = IPAddress(config.serverIp[0], config.serverIp[1],
+                       config.serverIp[2], config.serverIp[3]);
+  udpPort = config.udpPort;
+
+  if (calibLoad(calib)) {
+    Serial.printf("CALIB: NVS imu=%d (%.1f C) mag=%d\n",
+                  (calib.flags & CALIB_HAS_IMU) ? 1 : 0, calib.imuTempC,
+                  (calib.flags & CALIB_HAS_MAG) ? 1 : 0);
+  }
+  if (!(calib.flags & CALIB_HAS_MAG)) {
+    const float ofs[3] = {MAG_OFFSET_X, MAG_OFFSET_Y, MAG_OFFSET_Z};
+    const float scale[3] = {MAG_SCALE_X, MAG_SCALE_Y, MAG_SCALE_Z};
+    for (int i = 0; i < 3; i++) {
+      calib.magOffset[i] = ofs[i];
+      calib.magSoftIron[4 * i] = scale[i]; // diagonal
+    }
+  }
+
   if (imuConnected) {
-    if (!imu.init()) {
+    if (!(calib.flags & CALIB_HAS_IMU))
+      Serial.println("MPU6500: Calibrating...");
+    if (!initImu()) {
       Serial.println("ERROR: MPU6500 init failed!");
       imuConnected = false;
     } else {
-      Serial.println("MPU6500: Calibrating...");
-      imu.autoOffsets();
-      Serial.println("MPU6500: Done.");
-      imu.enableGyrDLPF();
-      imu.setGyrDLPF(MPU6500_DLPF_6);
-      imu.enableAccDLPF(true);
-      imu.setAccDLPF(MPU6500_DLPF_6);
-      imu.setSampleRateDivider(9); // 1kHz / (1+9) = 100Hz
-      imu.setAccRange(MPU6500_ACC_RANGE_4G);
-      imu.setGyrRange(MPU6500_GYRO_RANGE_500);
+      Serial.println(imuCalibratedFromNvs ? "MPU6500: Offsets from NVS."
+                                          : "MPU6500: Calibrated.");
+#if IMU_USE_FIFO
+      Serial.printf("MPU6500: FIFO mode, %.0f Hz, INT on GPIO %d\n",
+                    imuFifo.sampleRateHz(), IMU_INT_PIN);
+#endif
     }
   }
+  if (!imuConnected)
+    imuHealth.fail();
 
   if (magConnected) {
-    mag.initialize();
-    Serial.println("HMC5883L: Initialized.");
+    initMag();
+    Serial.println("HMC5883L: Continuous mode, 75 Hz.");
+  } else {
+    magHealth.fail();
   }
+#if MAG_DRDY_PIN >= 0
+  pinMode(MAG_DRDY_PIN, INPUT_PULLUP); // DRDY pulses low for 250 µs
+  attachInterrupt(digitalPinToInterrupt(MAG_DRDY_PIN), onMagDataReady,
+                  FALLING);
+#endif
 
-  filter.begin(100);
+#if FUSION_BENCHMARK
+  Serial.printf("FUSION: benchmark @ %lu MHz, invSqrt %s\n",
+                (unsigned long)ESP.getCpuFreqMHz(), fusionInvSqrtName());
+  benchmarkFusion();
+#endif
+  configureFilter();
 
-  // Attempt WiFi
-  useWiFi = setupWiFi();
+  // Serial until Wi-Fi is up; wifiService() announces the hand-over
+  startWiFi();
+  sendLine("TRANSPORT,serial");
 
-  // Send transport mode once via the active channel
-  sendLine(String("TRANSPORT,") + (useWiFi ? "wifi" : "serial"));
-}
-
-void loop() {
-  // ── WiFi watchdog ──
-  if (millis() - lastWiFiCheck >= 2000) {
-    lastWiFiCheck = millis();
-
-    if (useWiFi && WiFi.status() != WL_CONNECTED) {
-      useWiFi = false;
-      sendLine("TRANSPORT,serial");
-    } else if (!useWiFi && wifiEverConnected) {
-      if (WiFi.status() == WL_CONNECTED) {
-        useWiFi = true;
-        sendLine("TRANSPORT,wifi");
-      } else {
-        WiFi.begin(WIFI_SSID, WIFI_PASS);
-      }
-    }
-  }
-
-  // ── I2C health ──
-  if (millis() - lastStatusCheck >= 500) {
-    lastStatusCheck = millis();
-    imuConnected = checkI2CDevice(MPU6500_ADDR);
-    magConnected = checkI2CDevice(HMC5883L_ADDR);
-    String status = "STATUS," + String(imuConnected ? 1 : 0) + "," +
-                    String(magConnected ? 1 : 0);
-    sendLine(status);
-  }
-
-  // ── Sensor read ──
-  if (millis() - lastUpdate >= 10) {
-    lastUpdate = millis();
-
-    if (imuConnected) {
-      xyzFloat a = imu.getGValues();
-      xyzFloat g = imu.getGyrValues();
-
-      float mx_ut = 0, my_ut = 0, mz_ut = 0;
-      bool magValid = false;
-      if (magConnected) {
-        int16_t mx_raw = 0, my_raw = 0, mz_raw = 0;
-        mag.getHeading(&mx_raw, &my_raw, &mz_raw);
-        mx_ut = (mx_raw - MAG_OFFSET_X) * MAG_SCALE_X * MAG_UT_PER_LSB;
-        my_ut = (my_raw - MAG_OFFSET_Y) * MAG_SCALE_Y * MAG_UT_PER_LSB;
-        mz_ut = (mz_raw - MAG_OFFSET_Z) * MAG_SCALE_Z * MAG_UT_PER_LSB;
-        // Only valid if not all zeros (would cause div-by-zero in Madgwick)
-        magValid = (mx_raw != 0 || my_raw != 0 || mz_raw != 0);
-      }
+#if POINTER_HID
+  hidPointer.begin(POINTER_USB, POINTER_BLE, POINTER_BLE_NAME,
+                   POINTER_BLE_INTERVAL);
+  Serial.printf("POINTER: HID mouse usb=%d ble=%d (\"%s\")\n", POINTER_USB,
+                POINTER_BLE, POINTER_BLE_NAME);
+  xTaskCreatePinnedToCore(pointerTask, "pointer", POINTER_TASK_STACK, nullptr,
+                          POINTER_TASK_PRIORITY, &pointerTaskHandle,
+                          POINTER_TASK_CORE);
+#endif
 
-      // Use 9-axis update only if mag data is valid, otherwise 6-axis
-      if (magValid) {
-        filter.update(g.x, g.y, g.z, a.x, a.y, a.z, mx_ut, my_ut, mz_ut);
-      } else {
-        filter.updateIMU(g.x, g.y, g.z, a.x, a.y, a.z);
-      }
+  xTaskCreatePinnedToCore(transportTask, "transport", TRANSPORT_TASK_STACK,
+                          nullptr, TRANSPORT_TASK_PRIORITY,
+                          &transportTaskHandle, TRANSPORT_TASK_CORE);
+  xTaskCreatePinnedToCore(sensorTask, "sensor", SENSOR_TASK_STACK, nullptr,
+                          SENSOR_TASK_PRIORITY, &sensorTaskHandle,
+                          SENSOR_TASK_CORE);
+#if IMU_USE_FIFO
+  imuFifo.setNotifyTask(sensorTaskHandle);
+#endif
+#if MOTION_WOM
+  pinMode(MOTION_WOM_PIN, INPUT_PULLDOWN); // quiet if INT is not wired
+  attachInterrupt(digitalPinToInterrupt(MOTION_WOM_PIN), onImuMotion, RISING);
+#endif
 
-      float roll = filter.getRoll();
-      float pitch = filter.getPitch();
-      float yaw = filter.getYaw();
-
-      // Guard against nan (can happen during first few iterations)
-      if (!isnan(roll) && !isnan(pitch) && !isnan(yaw)) {
-        // Apply EMA smoothing
-        if (!emaInitialized) {
-          smoothRoll = roll;
-          smoothPitch = pitch;
-          smoothYaw = yaw;
-          emaInitialized = true;
-        } else {
-          smoothRoll = emaAngle(smoothRoll, roll, EMA_ALPHA);
-          smoothPitch = emaAngle(smoothPitch, pitch, EMA_ALPHA);
-          smoothYaw = emaAngle(smoothYaw, yaw, EMA_ALPHA);
-        }
-
-        String euler = "EULER," + String(smoothRoll, 2) + "," +
-                       String(smoothPitch, 2) + "," + String(smoothYaw, 2);
-        sendLine(euler);
-      }
+  // Baseline for the DIAG heap drift counter
+  heapFreeAtBoot = ESP.getFreeHeap();
+}
 
-      // Periodic diagnostic (every 3 seconds)
-      if (millis() - lastDiag >= 3000) {
-        lastDiag = millis();
-        Serial.printf("DIAG: a=(%.2f,%.2f,%.2f) g=(%.1f,%.1f,%.1f) "
-                      "m=(%.1f,%.1f,%.1f) magValid=%d RPY=(%.1f,%.1f,%.1f)\n",
-                      a.x, a.y, a.z, g.x, g.y, g.z, mx_ut, my_ut, mz_ut,
-                      magValid, roll, pitch, yaw);
-      }
-    }
-  }
-}
\ No newline at end of file
+void loop() {
+  // All work happens in sensorTask / transportTask
+  vTaskDelete(nullptr);
+}
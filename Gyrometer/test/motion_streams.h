@@ -0,0 +1,189 @@
+#pragma once
+// ── Synthetic sensor streams for the native tests and benchmark ──
+// A body-rate profile is integrated in double precision into the true
+// orientation, and each sample carries the readings that orientation
+// produces: gyro (deg/s) with a residual bias and white noise, accel (g)
+// from gravity alone, mag (µT) from a fixed earth field with 60° dip, all
+// in the sensor frame. Mag samples are fresh at the HMC5883L's 75 Hz, as in
+// the firmware's 9-axis / 6-axis split. Noise comes from a seeded generator
+// so every run on every machine sees the same stream.
+
+#include "quaternion.h"
+#include <math.h>
+#include <stdint.h>
+
+enum MotionProfile : uint8_t {
+  MOTION_STILL,    // resting on a desk
+  MOTION_POINTING, // slow ±30° sweeps, like aiming a pointer
+  MOTION_TREMOR,   // small sweeps plus a 9 Hz hand tremor
+  MOTION_SWING,    // fast ±40° swings, ~380 °/s peaks
+  MOTION_PROFILES
+};
+
+inline const char *motionProfileName(MotionProfile p) {
+  static const char *const names[] = {"still", "pointing", "tremor", "swing"};
+  return p < MOTION_PROFILES ? names[p] : "?";
+}
+
+struct MotionSample {
+  float gx, gy, gz;
+  float ax, ay, az;
+  float mx, my, mz;
+  bool magFresh;
+  Quat truth; // sensor → earth, Madgwick convention
+};
+
+class MotionStream {
+public:
+  MotionStream(MotionProfile profile, float rateHz, uint32_t seed = 1,
+               const Quat &start = {1.0f, 0.0f, 0.0f, 0.0f})
+      : profile(profile), dt(1.0 / rateHz), rng(seed ? seed : 1) {
+    q[0] = start.w;
+    q[1] = start.x;
+    q[2] = start.y;
+    q[3] = start.z;
+  }
+
+  void next(MotionSample &s) {
+    // Truth over (t, t + dt] in substeps; the gyro reports the mean rate
+    double mean[3] = {0, 0, 0};
+    const int substeps = 8;
+    const double h = dt / substeps;
+    for (int i = 0; i < substeps; i++) {
+      double w[3];
+      bodyRate(t + (i + 0.5) * h, w);
+      rotate(w, h);
+      for (int k = 0; k < 3; k++)
+        mean[k] += w[k] / substeps;
+    }
+    t += dt;
+
+    const double degPerRad = 57.29577951308232;
+    s.gx = (float)(mean[0] * degPerRad + GYRO_BIAS_X + gauss() * GYRO_NOISE);
+    s.gy = (float)(mean[1] * degPerRad + GYRO_BIAS_Y + gauss() * GYRO_NOISE);
+    s.gz = (float)(mean[2] * degPerRad + GYRO_BIAS_Z + gauss() * GYRO_NOISE);
+
+    double a[3], m[3];
+    const double up[3] = {0.0, 0.0, 1.0};
+    const double field[3] = {EARTH_FIELD_H, 0.0, EARTH_FIELD_V};
+    toSensor(up, a);
+    toSensor(field, m);
+    s.ax = (float)(a[0] + gauss() * ACC_NOISE);
+    s.ay = (float)(a[1] + gauss() * ACC_NOISE);
+    s.az = (float)(a[2] + gauss() * ACC_NOISE);
+    s.mx = (float)(m[0] + gauss() * MAG_NOISE);
+    s.my = (float)(m[1] + gauss() * MAG_NOISE);
+    s.mz = (float)(m[2] + gauss() * MAG_NOISE);
+
+    const long magTick = (long)(t * MAG_RATE_HZ);
+    s.magFresh = magTick != lastMagTick;
+    lastMagTick = magTick;
+    s.truth = {(float)q[0], (float)q[1], (float)q[2], (float)q[3]};
+  }
+
+  static constexpr double GYRO_BIAS_X = 0.05, GYRO_BIAS_Y = -0.03,
+                          GYRO_BIAS_Z = 0.02;          // deg/s (post-calib)
+  static constexpr double GYRO_NOISE = 0.1;            // deg/s RMS
+  static constexpr double ACC_NOISE = 0.004;           // g RMS
+  static constexpr double MAG_NOISE = 0.3;             // µT RMS
+  static constexpr double EARTH_FIELD_H = 25.0;        // µT, north
+  static constexpr double EARTH_FIELD_V = -43.3;       // µT, up
+  static constexpr double MAG_RATE_HZ = 75.0;
+
+private:
+  // rad/s in the sensor frame
+  void bodyRate(double time, double *w) const {
+    const double tau = 6.283185307179586;
+    w[0] = w[1] = w[2] = 0.0;
+    switch (profile) {
+    case MOTION_STILL:
+    case MOTION_PROFILES:
+      break;
+    case MOTION_POINTING:
+      // Angle amplitude A ↔ rate amplitude A·2πf
+      w[0] = 0.52 * tau * 0.40 * cos(tau * 0.40 * time);
+      w[1] = 0.35 * tau * 0.25 * cos(tau * 0.25 * time + 1.0);
+      w[2] = 0.52 * tau * 0.30 * cos(tau * 0.30 * time + 2.0);
+      break;
+    case MOTION_TREMOR:
+      w[0] = 0.17 * tau * 0.30 * cos(tau * 0.30 * time) +
+             0.005 * tau * 9.0 * cos(tau * 9.0 * time);
+      w[1] = 0.005 * tau * 9.0 * cos(tau * 9.0 * time + 0.7);
+      w[2] = 0.17 * tau * 0.20 * cos(tau * 0.20 * time + 1.3) +
+             0.003 * tau * 7.0 * cos(tau * 7.0 * time);
+      break;
+    case MOTION_SWING:
+      w[1] = 0.70 * tau * 1.5 * cos(tau * 1.5 * time);
+      w[2] = 0.70 * tau * 1.2 * cos(tau * 1.2 * time + 0.5);
+      break;
+    }
+  }
+
+  // q ← q ⊗ exp(w·h / 2)
+  void rotate(const double *w, double h) {
+    const double n = sqrt(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]);
+    if (n <= 0)
+      return;
+    const double c = cos(0.5 * n * h), sn = sin(0.5 * n * h) / n;
+    const double r[4] = {c, w[0] * sn, w[1] * sn, w[2] * sn};
+    const double a = q[0], b = q[1], cc = q[2], d = q[3];
+    q[0] = a * r[0] - b * r[1] - cc * r[2] - d * r[3];
+    q[1] = a * r[1] + b * r[0] + cc * r[3] - d * r[2];
+    q[2] = a * r[2] - b * r[3] + cc * r[0] + d * r[1];
+    q[3] = a * r[3] + b * r[2] - cc * r[1] + d * r[0];
+    const double inv = 1.0 / sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] +
+                                  q[3] * q[3]);
+    for (int k = 0; k < 4; k++)
+      q[k] *= inv;
+  }
+
+  // Earth-frame vector into the sensor frame: Rᵀ v
+  void toSensor(const double *v, double *out) const {
+    const double w = q[0], x = q[1], y = q[2], z = q[3];
+    const double r[3][3] = {
+        {1 - 2 * (y * y + z * z), 2 * (x * y - w * z), 2 * (x * z + w * y)},
+        {2 * (x * y + w * z), 1 - 2 * (x * x + z * z), 2 * (y * z - w * x)},
+        {2 * (x * z - w * y), 2 * (y * z + w * x), 1 - 2 * (x * x + y * y)}};
+    for (int i = 0; i < 3; i++)
+      out[i] = r[0][i] * v[0] + r[1][i] * v[1] + r[2][i] * v[2];
+  }
+
+  // xorshift32 + Box-Muller
+  double uniform() {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return (rng + 0.5) / 4294967296.0;
+  }
+  double gauss() {
+    return sqrt(-2.0 * log(uniform())) * cos(6.283185307179586 * uniform());
+  }
+
+  MotionProfile profile;
+  double dt;
+  double t = 0.0;
+  double q[4];
+  uint32_t rng;
+  long lastMagTick = 0;
+};
+
+// ── Error metrics (degrees) ──
+// Full rotation between estimate and truth
+inline float quatAngleDeg(const Quat &a, const Quat &b) {
+  float d = fabsf(quatDot(a, b));
+  return 2.0f * acosf(d < 1.0f ? d : 1.0f) * 57.29578f;
+}
+
+// Tilt only: angle between the two gravity directions in the sensor frame
+// (what a 6-axis filter can observe)
+inline float tiltErrorDeg(const Quat &a, const Quat &b) {
+  const float ax = 2 * (a.x * a.z - a.w * a.y),
+              ay = 2 * (a.w * a.x + a.y * a.z),
+              az = 1 - 2 * (a.x * a.x + a.y * a.y);
+  const float bx = 2 * (b.x * b.z - b.w * b.y),
+              by = 2 * (b.w * b.x + b.y * b.z),
+              bz = 1 - 2 * (b.x * b.x + b.y * b.y);
+  float c = ax * bx + ay * by + az * bz;
+  c = c > 1.0f ? 1.0f : (c < -1.0f ? -1.0f : c);
+  return acosf(c) * 57.29578f;
+}
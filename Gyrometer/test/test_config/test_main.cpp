@@ -0,0 +1,113 @@
+// ── Runtime configuration parser tests ──
+// Runs on the host (pio test -e native) and on the board.
+
+#include "runtime_config.h"
+#include <unity.h>
+
+RuntimeConfig config;
+
+void setUp() {
+  memset(&config, 0, sizeof(config));
+  config.version = CONFIG_VERSION;
+  config.rateDivider = 9;
+  config.dlpf = 6;
+  config.accRangeG = 4;
+  config.gyrRangeDps = 500;
+  config.emaAlpha = 0.15f;
+  config.beta = 0.1f;
+  const uint8_t ip[4] = {192, 168, 1, 100};
+  memcpy(config.serverIp, ip, sizeof(ip));
+  config.udpPort = 4210;
+}
+
+void tearDown() {}
+
+static void test_set_reports_what_to_apply() {
+  TEST_ASSERT_EQUAL(CONFIG_APPLY_IMU | CONFIG_APPLY_FILTER,
+                    configSet(config, "rate_div", "4"));
+  TEST_ASSERT_EQUAL(4, config.rateDivider);
+  TEST_ASSERT_EQUAL(5000, configPeriodUs(config));
+  TEST_ASSERT_EQUAL(CONFIG_APPLY_IMU, configSet(config, "dlpf", "3"));
+  TEST_ASSERT_EQUAL(CONFIG_APPLY_FILTER, configSet(config, "beta", "0.05"));
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.05f, config.beta);
+  TEST_ASSERT_EQUAL(CONFIG_APPLY_FILTER, configSet(config, "predict_ms", "40"));
+  TEST_ASSERT_EQUAL(40, config.predictMs);
+  TEST_ASSERT_EQUAL(CONFIG_APPLY_NET,
+                    configSet(config, "server_ip", "10.0.0.7"));
+  TEST_ASSERT_EQUAL(7, config.serverIp[3]);
+  TEST_ASSERT_EQUAL(CONFIG_APPLY_NET, configSet(config, "udp_port", "5000"));
+  TEST_ASSERT_EQUAL(5000, config.udpPort);
+}
+
+static void test_bad_values_change_nothing() {
+  const RuntimeConfig before = config;
+  const char *const rejected[][2] = {
+      {"rate_div", "256"},     {"rate_div", "4x"},
+      {"dlpf", "8"},           {"acc_range", "6"},
+      {"gyro_range", "750"},   {"ema_alpha", "0"},
+      {"ema_alpha", "nan"},    {"beta", "-1"},
+      {"predict_ms", "101"},   {"predict_ms", "-1"},
+      {"server_ip", "10.0.0"}, {"server_ip", "1.2.3.4.5"},
+      {"server_ip", "1.2.3.256"}, {"udp_port", "0"},
+      {"udp_port", ""},        {"no_such_key", "1"},
+  };
+  for (const auto &r : rejected)
+    TEST_ASSERT_EQUAL_MESSAGE(0, configSet(config, r[0], r[1]), r[0]);
+  TEST_ASSERT_TRUE(memcmp(&before, &config, sizeof(config)) == 0);
+}
+
+static void test_ranges_map_to_library_codes() {
+  const char *const acc[] = {"2", "4", "8", "16"};
+  const char *const gyr[] = {"250", "500", "1000", "2000"};
+  for (int code = 0; code < 4; code++) {
+    configSet(config, "acc_range", acc[code]);
+    configSet(config, "gyro_range", gyr[code]);
+    TEST_ASSERT_EQUAL(code, configAccRangeCode(config));
+    TEST_ASSERT_EQUAL(code, configGyrRangeCode(config));
+  }
+}
+
+static void test_format_round_trips() {
+  configSet(config, "ema_alpha", "0.3");
+  configSet(config, "server_ip", "172.16.0.9");
+  configSet(config, "predict_ms", "25");
+  RuntimeConfig copy;
+  memset(&copy, 0, sizeof(copy));
+  copy.version = CONFIG_VERSION;
+  char line[48];
+  for (uint8_t key = 0; key < CONFIG_KEY_COUNT; key++) {
+    configFormat(config, key, line, sizeof(line));
+    char *value = strchr(line, ',');
+    TEST_ASSERT_TRUE(value != nullptr);
+    *value++ = '\0';
+    TEST_ASSERT_EQUAL_STRING(configKeyName(key), line);
+    TEST_ASSERT_TRUE(configSet(copy, line, value) != 0);
+  }
+  TEST_ASSERT_TRUE(configValid(copy));
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.3f, copy.emaAlpha);
+  TEST_ASSERT_EQUAL(9, copy.serverIp[3]);
+  TEST_ASSERT_EQUAL(25, copy.predictMs);
+  // A blob from another version is not loaded
+  copy.version = CONFIG_VERSION + 1;
+  TEST_ASSERT_FALSE(configValid(copy));
+}
+
+int runUnityTests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_set_reports_what_to_apply);
+  RUN_TEST(test_bad_values_change_nothing);
+  RUN_TEST(test_ranges_map_to_library_codes);
+  RUN_TEST(test_format_round_trips);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+void setup() {
+  delay(2000); // let the monitor attach
+  runUnityTests();
+}
+void loop() {}
+#else
+int main() { return runUnityTests(); }
+#endif
@@ -0,0 +1,172 @@
+// ── Fusion, smoothing and mag correction unit tests ──
+// Runs on the host (pio test -e native) and on the board.
+
+#include "../motion_streams.h"
+#include "fusion.h"
+#include "mag_fit.h"
+#include "quaternion.h"
+#include "smoothing.h"
+#include <stdio.h>
+#include <unity.h>
+
+#define RATE_HZ 100.0f
+
+MadgwickFilter madgwickFilter;
+MahonyFilter mahonyFilter;
+ComplementaryFilter complementaryFilter;
+AdaptiveMadgwickFilter adaptiveFilter;
+FixedMadgwickFilter fixedFilter;
+FusionFilter *const filters[] = {&madgwickFilter, &mahonyFilter,
+                                 &complementaryFilter, &adaptiveFilter,
+                                 &fixedFilter};
+
+void setUp() {
+  for (FusionFilter *f : filters) {
+    f->reset();
+    f->begin(RATE_HZ);
+  }
+}
+
+void tearDown() {}
+
+// Same 9-axis / 6-axis split as processSample()
+static void feed(FusionFilter &f, const MotionSample &s) {
+  if (s.magFresh)
+    f.update(s.gx, s.gy, s.gz, s.ax, s.ay, s.az, s.mx, s.my, s.mz);
+  else
+    f.updateIMU(s.gx, s.gy, s.gz, s.ax, s.ay, s.az);
+}
+
+static void test_ema_angle_wraps() {
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 15.0f, emaAngle(10.0f, 20.0f, 0.5f));
+  // Shortest way round: 170 → -170 is +20°, not -340°
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 175.0f, emaAngle(170.0f, -170.0f, 0.25f));
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, -175.0f, emaAngle(-170.0f, 170.0f, 0.25f));
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 5.0f, emaAngle(355.0f, 5.0f, 1.0f) - 360.0f);
+}
+
+static void test_mag_calibration() {
+  const int16_t raw[3] = {110, -40, 260};
+  const float offset[3] = {10.0f, -20.0f, 60.0f};
+  const float identity[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+  const float skew[9] = {2, 0, 0, 0, 0.5f, 0.25f, 0, 0, 1};
+  float out[3];
+  magApplyCalibration(raw, offset, identity, 0.5f, out);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 50.0f, out[0]);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, -10.0f, out[1]);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 100.0f, out[2]);
+  magApplyCalibration(raw, offset, skew, 1.0f, out);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 200.0f, out[0]);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 40.0f, out[1]); // 0.5·-20 + 0.25·200
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 200.0f, out[2]);
+}
+
+static void test_euler_conventions() {
+  // 90° about z: MadgwickAHRS yaw is offset by 180° into [0, 360)
+  const float h = 0.70710678f;
+  float roll, pitch, yaw;
+  quatToEulerDeg({h, 0.0f, 0.0f, h}, roll, pitch, yaw);
+  TEST_ASSERT_FLOAT_WITHIN(1e-3f, 0.0f, roll);
+  TEST_ASSERT_FLOAT_WITHIN(1e-3f, 0.0f, pitch);
+  TEST_ASSERT_FLOAT_WITHIN(1e-3f, 270.0f, yaw);
+  quatToEulerDeg({h, h, 0.0f, 0.0f}, roll, pitch, yaw);
+  TEST_ASSERT_FLOAT_WITHIN(1e-3f, 90.0f, roll);
+}
+
+static void test_nlerp_close_to_slerp() {
+  const float s = 0.25881905f, c = 0.96592583f; // 30° about x
+  const Quat a = {1, 0, 0, 0}, b = {c, s, 0, 0};
+  for (float t = 0.0f; t <= 1.0f; t += 0.125f)
+    TEST_ASSERT_TRUE(quatAngleDeg(quatNlerp(a, b, t), quatSlerp(a, b, t)) <
+                     0.3f);
+  // q and -q are the same rotation: no detour the long way round
+  const Quat nb = {-b.w, -b.x, -b.y, -b.z};
+  TEST_ASSERT_TRUE(quatAngleDeg(quatNlerp(a, nb, 0.5f), quatSlerp(a, b, 0.5f)) <
+                   0.3f);
+}
+
+static void test_filters_hold_still() {
+  for (FusionFilter *f : filters) {
+    MotionStream stream(MOTION_STILL, RATE_HZ, 7);
+    MotionSample s;
+    for (int i = 0; i < 10 * (int)RATE_HZ; i++) {
+      stream.next(s);
+      feed(*f, s);
+    }
+    TEST_ASSERT_FLOAT_WITHIN_MESSAGE(1.0f, 0.0f,
+                                     quatAngleDeg(f->quaternion(), s.truth),
+                                     f->name());
+  }
+}
+
+static void test_filters_converge_from_tilt() {
+  // Device rests rolled 30° and pitched 15°; every filter starts level
+  const Quat roll30 = {0.96592583f, 0.25881905f, 0, 0};
+  const Quat pitch15 = {0.99144486f, 0, 0.13052619f, 0};
+  const Quat start = quatNormalize(quatMultiply(roll30, pitch15));
+  for (FusionFilter *f : filters) {
+    MotionStream stream(MOTION_STILL, RATE_HZ, 11, start);
+    MotionSample s;
+    for (int i = 0; i < 20 * (int)RATE_HZ; i++) {
+      stream.next(s);
+      feed(*f, s);
+    }
+    TEST_ASSERT_FLOAT_WITHIN_MESSAGE(2.0f, 0.0f,
+                                     tiltErrorDeg(f->quaternion(), s.truth),
+                                     f->name());
+  }
+}
+
+static void test_fixed_point_tracks_float() {
+  MotionStream stream(MOTION_POINTING, RATE_HZ, 3);
+  MotionSample s;
+  float worst = 0.0f;
+  for (int i = 0; i < 20 * (int)RATE_HZ; i++) {
+    stream.next(s);
+    feed(madgwickFilter, s);
+    feed(fixedFilter, s);
+    const float d =
+        quatAngleDeg(madgwickFilter.quaternion(), fixedFilter.quaternion());
+    worst = d > worst ? d : worst;
+  }
+  TEST_ASSERT_TRUE(worst < 0.5f);
+}
+
+static void test_reset_returns_to_identity() {
+  MotionStream stream(MOTION_SWING, RATE_HZ, 5);
+  MotionSample s;
+  for (FusionFilter *f : filters) {
+    for (int i = 0; i < 100; i++) {
+      stream.next(s);
+      feed(*f, s);
+    }
+    f->reset();
+    const Quat q = f->quaternion();
+    TEST_ASSERT_FLOAT_WITHIN_MESSAGE(1e-6f, 1.0f, q.w, f->name());
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, fabsf(q.x) + fabsf(q.y) + fabsf(q.z));
+  }
+}
+
+int runUnityTests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_ema_angle_wraps);
+  RUN_TEST(test_mag_calibration);
+  RUN_TEST(test_euler_conventions);
+  RUN_TEST(test_nlerp_close_to_slerp);
+  RUN_TEST(test_filters_hold_still);
+  RUN_TEST(test_filters_converge_from_tilt);
+  RUN_TEST(test_fixed_point_tracks_float);
+  RUN_TEST(test_reset_returns_to_identity);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+void setup() {
+  delay(2000); // let the monitor attach
+  runUnityTests();
+}
+void loop() {}
+#else
+int main() { return runUnityTests(); }
+#endif
@@ -0,0 +1,115 @@
+// ── Motion scaling unit tests ──
+// Runs on the host (pio test -e native) and on the board.
+
+#include "../motion_streams.h"
+#include "motion_scaling.h"
+#include <unity.h>
+
+#define RATE_HZ 100.0f
+#define PERIOD_US 10000u
+
+void setUp() {}
+void tearDown() {}
+
+static MotionDetector detector() {
+  return MotionDetector(3.0f, 0.05f, 3000000);
+}
+
+static void test_still_device_goes_idle() {
+  MotionDetector d = detector();
+  MotionStream stream(MOTION_STILL, RATE_HZ, 5);
+  MotionSample s;
+  uint32_t t = 0;
+  int changes = 0;
+  for (int i = 0; i < 5 * (int)RATE_HZ; i++, t += PERIOD_US) {
+    stream.next(s);
+    changes += d.add(s.ax, s.ay, s.az, s.gx, s.gy, s.gz, t);
+    // Not before a full idleAfterUs of stillness
+    if (t < 3000000)
+      TEST_ASSERT_FALSE(d.idle());
+  }
+  TEST_ASSERT_TRUE(d.idle());
+  TEST_ASSERT_EQUAL(1, changes);
+}
+
+static void test_pointing_stays_active() {
+  MotionDetector d = detector();
+  MotionStream stream(MOTION_POINTING, RATE_HZ, 6);
+  MotionSample s;
+  uint32_t t = 0;
+  for (int i = 0; i < 10 * (int)RATE_HZ; i++, t += PERIOD_US) {
+    stream.next(s);
+    d.add(s.ax, s.ay, s.az, s.gx, s.gy, s.gz, t);
+    TEST_ASSERT_FALSE(d.idle());
+  }
+}
+
+static void test_one_moving_sample_wakes() {
+  MotionDetector d = detector();
+  uint32_t t = 0;
+  for (int i = 0; i < 400; i++, t += PERIOD_US)
+    d.add(0.0f, 0.0f, 1.0f, 0.1f, -0.2f, 0.1f, t);
+  TEST_ASSERT_TRUE(d.idle());
+  TEST_ASSERT_TRUE(d.add(0.0f, 0.0f, 1.0f, 0.0f, 8.0f, 0.0f, t));
+  TEST_ASSERT_FALSE(d.idle());
+  // A bump with no rotation (set down, picked up) counts as motion too
+  for (int i = 0; i < 400; i++, t += PERIOD_US)
+    d.add(0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, t);
+  TEST_ASSERT_TRUE(d.add(0.1f, 0.0f, 1.1f, 0.0f, 0.0f, 0.0f, t));
+  // Wake-on-motion from outside; a second wake changes nothing
+  for (int i = 0; i < 400; i++, t += PERIOD_US)
+    d.add(0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, t);
+  TEST_ASSERT_TRUE(d.wake());
+  TEST_ASSERT_FALSE(d.wake());
+}
+
+static void test_suppressor_sends_changes_and_keepalive() {
+  FrameSuppressor f(1000000);
+  int16_t v[3] = {100, -200, 300};
+  uint32_t t = 0;
+  TEST_ASSERT_TRUE(f.changed(v, 3, 0, t)); // first sample always goes
+  int sent = 0;
+  for (int i = 0; i < 250; i++) // 2.5 s unchanged
+    sent += f.changed(v, 3, 0, t += PERIOD_US);
+  TEST_ASSERT_EQUAL(2, sent); // keepalives at 1 s and 2 s
+  v[1]++;
+  TEST_ASSERT_TRUE(f.changed(v, 3, 0, t += PERIOD_US));
+  TEST_ASSERT_EQUAL(248, f.suppressed());
+}
+
+static void test_deadband_against_last_sent() {
+  FrameSuppressor f(1000000);
+  int16_t v[4] = {16384, 0, 0, 0};
+  uint32_t t = 0;
+  f.changed(v, 4, 2, t);
+  // Drift of one LSB a sample: within the band twice, then out
+  v[3] = 1;
+  TEST_ASSERT_FALSE(f.changed(v, 4, 2, t += PERIOD_US));
+  v[3] = 2;
+  TEST_ASSERT_FALSE(f.changed(v, 4, 2, t += PERIOD_US));
+  v[3] = 3;
+  TEST_ASSERT_TRUE(f.changed(v, 4, 2, t += PERIOD_US));
+  v[3] = 4;
+  TEST_ASSERT_FALSE(f.changed(v, 4, 2, t += PERIOD_US));
+}
+
+int runUnityTests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_still_device_goes_idle);
+  RUN_TEST(test_pointing_stays_active);
+  RUN_TEST(test_one_moving_sample_wakes);
+  RUN_TEST(test_suppressor_sends_changes_and_keepalive);
+  RUN_TEST(test_deadband_against_last_sent);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+void setup() {
+  delay(2000); // let the monitor attach
+  runUnityTests();
+}
+void loop() {}
+#else
+int main() { return runUnityTests(); }
+#endif
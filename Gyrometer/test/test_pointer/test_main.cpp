@@ -0,0 +1,160 @@
+// ── Pointer engine unit tests ──
+// Runs on the host (pio test -e native) and on the board.
+
+#include "../motion_streams.h"
+#include "pointer_engine.h"
+#include <stdio.h>
+#include <unity.h>
+
+#define RATE_HZ 1000.0f
+#define DT (1.0f / RATE_HZ)
+
+PointerEngine engine;
+
+void setUp() { engine.configure(defaultPointerConfig()); engine.reset(); }
+
+void tearDown() {}
+
+// Feed n samples of a constant rate; returns the counts reported
+static void run(float rx, float ry, int n, long &sx, long &sy) {
+  int8_t dx, dy;
+  for (int i = 0; i < n; i++) {
+    engine.addRate(rx, ry, DT);
+    if (engine.take(dx, dy)) {
+      sx += dx;
+      sy += dy;
+    }
+  }
+}
+
+static void test_lookup_matches_curve() {
+  float worst = 0.0f;
+  for (float s = 0.2f; s < 1000.0f; s *= 1.07f) {
+    const float ref = engine.gainAt(s), lut = engine.gainLookup(s);
+    // Relative error, against lowGain on the ramp out of the dead zone
+    const float low = engine.config().lowGain;
+    const float err = fabsf(lut - ref) / (ref > low ? ref : low);
+    worst = err > worst ? err : worst;
+  }
+  TEST_ASSERT_TRUE(worst < 0.01f);
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, engine.gainLookup(0.0f));
+}
+
+static void test_still_device_does_not_move() {
+  // Gyro noise and residual bias of a device on a desk
+  MotionStream stream(MOTION_STILL, RATE_HZ, 3);
+  MotionSample s;
+  long sx = 0, sy = 0;
+  int8_t dx, dy;
+  for (int i = 0; i < 10 * (int)RATE_HZ; i++) {
+    stream.next(s);
+    engine.addRate(-s.gz, s.gy, DT);
+    if (engine.take(dx, dy)) {
+      sx += abs(dx);
+      sy += abs(dy);
+    }
+  }
+  TEST_ASSERT_EQUAL(0, sx + sy);
+}
+
+static void test_bias_is_tracked_at_rest() {
+  long sx = 0, sy = 0;
+  run(0.4f, -0.3f, 20 * (int)RATE_HZ, sx, sy);
+  TEST_ASSERT_FLOAT_WITHIN(0.02f, 0.4f, engine.biasDps(0));
+  TEST_ASSERT_FLOAT_WITHIN(0.02f, -0.3f, engine.biasDps(1));
+  // Bias is capped: a slow real turn is not absorbed beyond maxBiasDps
+  engine.reset();
+  run(0.9f, 0.0f, 60 * (int)RATE_HZ, sx, sy);
+  TEST_ASSERT_TRUE(engine.biasDps(0) <= defaultPointerConfig().maxBiasDps);
+}
+
+static void test_slow_turn_keeps_fractions() {
+  // 10 °/s for 2 s, well above the dead zone: every fraction of a count adds
+  // up, less what is still inside the filter at the end
+  long sx = 0, sy = 0;
+  run(10.0f, 0.0f, 2 * (int)RATE_HZ, sx, sy);
+  const float expected = engine.gainAt(10.0f) * 10.0f * 2.0f;
+  TEST_ASSERT_FLOAT_WITHIN(0.05f * expected, expected,
+                           sx + engine.pendingX());
+  TEST_ASSERT_EQUAL(0, sy);
+}
+
+static void test_curve_keeps_direction() {
+  long sx = 0, sy = 0;
+  run(120.0f, -90.0f, 500, sx, sy);
+  TEST_ASSERT_TRUE(sx > 0 && sy < 0);
+  TEST_ASSERT_FLOAT_WITHIN(0.03f, -0.75f, (float)sy / sx);
+}
+
+static void test_acceleration_is_monotonic() {
+  float last = 0.0f;
+  for (float s = 2.0f * engine.config().deadZoneDps; s < 600.0f; s *= 1.1f) {
+    const float g = engine.gainLookup(s);
+    TEST_ASSERT_TRUE(g >= last);
+    last = g;
+  }
+  TEST_ASSERT_TRUE(last > 0.9f * engine.config().highGain);
+}
+
+// Path length in counts of a 9 Hz ±6 °/s hand tremor with no intended motion
+static long tremorCounts(float tremorMinHz) {
+  PointerConfig c = defaultPointerConfig();
+  c.tremorMinHz = tremorMinHz;
+  engine.configure(c);
+  engine.reset();
+  long moved = 0;
+  int8_t dx, dy;
+  for (int i = 0; i < 4 * (int)RATE_HZ; i++) {
+    const float t = i * DT;
+    engine.addRate(0.0f, 6.0f * sinf(6.2831853f * 9.0f * t), DT);
+    if (engine.take(dx, dy))
+      moved += abs(dy);
+  }
+  return moved;
+}
+
+static void test_tremor_is_damped() {
+  // Unfiltered the cursor shakes back and forth by a count every half
+  // cycle; filtered the tremor stays mostly inside the dead zone
+  const long raw = tremorCounts(0.0f), filtered = tremorCounts(5.0f);
+  TEST_ASSERT_TRUE(raw > 20);
+  TEST_ASSERT_TRUE(filtered * 4 < raw);
+}
+
+static void test_report_and_backlog_limits() {
+  PointerConfig c = defaultPointerConfig();
+  c.tremorMinHz = 0.0f;
+  engine.configure(c);
+  engine.addRate(2000.0f, 0.0f, 0.05f); // 100° in one sample
+  int8_t dx, dy;
+  long total = 0;
+  while (engine.take(dx, dy)) {
+    TEST_ASSERT_TRUE(dx <= POINTER_REPORT_MAX);
+    total += dx;
+  }
+  TEST_ASSERT_EQUAL((long)POINTER_MAX_BACKLOG, total);
+}
+
+int runUnityTests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_lookup_matches_curve);
+  RUN_TEST(test_still_device_does_not_move);
+  RUN_TEST(test_bias_is_tracked_at_rest);
+  RUN_TEST(test_slow_turn_keeps_fractions);
+  RUN_TEST(test_curve_keeps_direction);
+  RUN_TEST(test_acceleration_is_monotonic);
+  RUN_TEST(test_tremor_is_damped);
+  RUN_TEST(test_report_and_backlog_limits);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+void setup() {
+  delay(2000); // let the monitor attach
+  runUnityTests();
+}
+void loop() {}
+#else
+int main() { return runUnityTests(); }
+#endif
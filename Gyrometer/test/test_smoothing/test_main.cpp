@@ -0,0 +1,98 @@
+// ── Smoothing and latency compensation unit tests ──
+// Runs on the host (pio test -e native) and on the board.
+
+#include "smoothing.h"
+#include <unity.h>
+
+#define RATE_HZ 100.0f
+#define ALPHA 0.15f
+
+void setUp() {}
+void tearDown() {}
+
+// Rotation by deg about a unit axis
+static Quat axisAngle(float x, float y, float z, float deg) {
+  const float h = 0.5f * deg * 0.0174532925f;
+  return {cosf(h), x * sinf(h), y * sinf(h), z * sinf(h)};
+}
+
+// atan2 of the relative rotation: acosf() of a dot product near 1 is too
+// coarse for hundredths of a degree
+static float angleBetweenDeg(const Quat &a, const Quat &b) {
+  const Quat r = quatMultiply(quatConjugate(a), b);
+  const float s = sqrtf(r.x * r.x + r.y * r.y + r.z * r.z);
+  return 2.0f * atan2f(s, fabsf(r.w)) * 57.29578f;
+}
+
+static void test_ema_angle_takes_the_short_way() {
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 2.0f, angleDiff(179.0f, -179.0f));
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, -2.0f, angleDiff(1.0f, 359.0f));
+  // Halfway from 170 to -170 is 180, not 0
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 180.0f, emaAngle(170.0f, -170.0f, 0.5f));
+}
+
+static void test_predict_matches_the_rotation() {
+  const Quat q = axisAngle(1.0f, 0.0f, 0.0f, 30.0f);
+  // 100 deg/s about body z for 0.1 s: a 10 deg turn
+  const Quat p = quatPredict(q, 0.0f, 0.0f, 100.0f, 0.1f);
+  const Quat exact = quatMultiply(q, axisAngle(0.0f, 0.0f, 1.0f, 10.0f));
+  TEST_ASSERT_FLOAT_WITHIN(0.03f, 0.0f, angleBetweenDeg(p, exact));
+  TEST_ASSERT_FLOAT_WITHIN(1e-5f, 1.0f, sqrtf(quatDot(p, p)));
+  // No rate, no horizon: unchanged
+  TEST_ASSERT_EQUAL_FLOAT(q.w, quatPredict(q, 0, 0, 0, 0.1f).w);
+  TEST_ASSERT_EQUAL_FLOAT(q.x, quatPredict(q, 50, 0, 0, 0).x);
+}
+
+static void test_emaLag_horizon_cancels_smoothing_lag() {
+  // Steady 120 deg/s turn about a tilted axis, smoothed like the firmware
+  const float rate = 120.0f, dt = 1.0f / RATE_HZ;
+  const float n = sqrtf(0.09f + 0.16f + 1.0f);
+  const float ax = 0.3f / n, ay = -0.4f / n, az = 1.0f / n;
+  Quat live = {1.0f, 0.0f, 0.0f, 0.0f}, smooth = live;
+  for (int i = 0; i < 200; i++) {
+    live = quatMultiply(live, axisAngle(ax, ay, az, rate * dt));
+    smooth = quatNlerp(smooth, live, ALPHA);
+  }
+  const float lagDeg = emaLagS(ALPHA, dt) * rate;
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, lagDeg, angleBetweenDeg(smooth, live));
+  const Quat p = quatPredict(smooth, rate * ax, rate * ay, rate * az,
+                             emaLagS(ALPHA, dt));
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 0.0f, angleBetweenDeg(p, live));
+}
+
+static void test_euler_predict_wraps() {
+  // Identity reads yaw 180; turn it to about 355 and predict past 360
+  const Quat q = axisAngle(0.0f, 0.0f, 1.0f, 175.0f);
+  float roll = 1.0f, pitch = 2.0f, yaw = 355.0f;
+  eulerPredict(q, 0.0f, 0.0f, 100.0f, 0.1f, roll, pitch, yaw);
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 1.0f, roll);
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 2.0f, pitch);
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 365.0f, yaw);
+  // A roll rate shows up as roll
+  roll = pitch = 0.0f;
+  yaw = 180.0f;
+  eulerPredict({1.0f, 0.0f, 0.0f, 0.0f}, 50.0f, 0.0f, 0.0f, 0.1f, roll, pitch,
+               yaw);
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 5.0f, roll);
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 180.0f, yaw);
+}
+
+int runUnityTests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_ema_angle_takes_the_short_way);
+  RUN_TEST(test_predict_matches_the_rotation);
+  RUN_TEST(test_emaLag_horizon_cancels_smoothing_lag);
+  RUN_TEST(test_euler_predict_wraps);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+void setup() {
+  delay(2000); // let the monitor attach
+  runUnityTests();
+}
+void loop() {}
+#else
+int main() { return runUnityTests(); }
+#endif
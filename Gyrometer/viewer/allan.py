@@ -0,0 +1,326 @@
+#!/usr/bin/env python3
+"""
+Allan deviation, noise density and bias instability of the IMU, from a still
+recording of the characterize firmware (pio run -e characterize) or any other
+FRAME_RAW stream.
+
+    python allan.py still.gycap                               # a capture file
+    python allan.py --port /dev/ttyUSB0 --record still.gycap  # live, report every minute
+    python allan.py still.gycap --csv adev.csv                # the curves, for plotting
+
+One pass over the samples in constant memory, so a recording of many hours
+(several GB) needs no more RAM than a short one. Cluster means are kept in a
+pyramid: level k holds the mean of the last finished cluster of m = b * 2^k
+samples, and every cluster it finishes adds one squared difference to the
+(non-overlapping) Allan variance at tau = m * tau0. Two pyramids, b = 1 and
+b = 3, give two points per octave of tau.
+
+From each curve:
+  - rms at rate: sigma(tau0), the sample-to-sample noise the fusion sees
+  - noise density: sigma(tau) * sqrt(tau) where the curve follows the -1/2
+    slope of white noise; for the gyro also as angle random walk (°/√h)
+  - bias instability: the curve's minimum / 0.664 (IEEE Std 952) and the tau
+    it is reached at. A curve still falling at the longest tau means the
+    recording was too short, and the figure is only an upper bound ('≤').
+
+To choose a setting, record each candidate (CHAR_DLPF, CHAR_RATE_DIVIDER): a
+narrower DLPF lowers the rms at rate but adds the group delay shown in the
+report.
+"""
+
+import argparse
+import csv
+import math
+import time
+
+import capture
+import telemetry
+
+CHANNELS = ('acc x', 'acc y', 'acc z', 'gyro x', 'gyro y', 'gyro z')
+MIN_PAIRS = 8              # differences before a tau is reported (±25 %)
+BIAS_INSTABILITY = 0.664   # flicker floor / bias instability, IEEE Std 952
+WHITE_SLOPE_TOL = 0.25     # |slope + 1/2| that still counts as white noise
+PROGRESS_S = 10.0
+
+# MPU6500 DLPF_CFG / A_DLPF_CFG -> (bandwidth Hz, delay ms), register map
+GYRO_DLPF = {0: (250, 0.97), 1: (184, 2.9), 2: (92, 3.9), 3: (41, 5.9),
+             4: (20, 9.9), 5: (10, 17.85), 6: (5, 33.48), 7: (3600, 0.17)}
+ACC_DLPF = {0: (218.1, 1.88), 1: (218.1, 1.88), 2: (99, 2.88), 3: (44.8, 4.88),
+            4: (21.2, 8.87), 5: (10.2, 16.83), 6: (5.05, 32.48), 7: (420, 1.38)}
+
+
+class AllanPyramid:
+    """Non-overlapping Allan variance at m = base * 2^k samples, O(levels) memory."""
+
+    def __init__(self, channels, base=1):
+        self.channels = channels
+        self.base = base
+        self.cluster = [0.0] * channels   # sum of the base cluster being formed
+        self.cluster_n = 0
+        self.prev = []      # per level: the last finished cluster mean
+        self.half = []      # per level: first half of the next level's cluster
+        self.sq = []        # per level: sum of squared differences per channel
+        self.n = []         # per level: differences summed
+
+    def add(self, v):
+        if self.base > 1:
+            c = self.cluster
+            for i in range(self.channels):
+                c[i] += v[i]
+            self.cluster_n += 1
+            if self.cluster_n < self.base:
+                return
+            v = [x / self.base for x in c]
+            self.cluster = [0.0] * self.channels
+            self.cluster_n = 0
+        k = 0
+        while True:
+            if k == len(self.prev):
+                self.prev.append(None)
+                self.half.append(None)
+                self.sq.append([0.0] * self.channels)
+                self.n.append(0)
+            prev = self.prev[k]
+            if prev is not None:
+                sq = self.sq[k]
+                for i in range(self.channels):
+                    d = v[i] - prev[i]
+                    sq[i] += d * d
+                self.n[k] += 1
+            self.prev[k] = v
+            first = self.half[k]
+            if first is None:
+                self.half[k] = v
+                return
+            # Two finished clusters make one at the next level
+            self.half[k] = None
+            v = [(a + b) * 0.5 for a, b in zip(first, v)]
+            k += 1
+
+    def points(self, tau0):
+        """[(tau s, differences, [sigma per channel])] with MIN_PAIRS or more."""
+        return [(self.base * (1 << k) * tau0, n, [math.sqrt(s / (2 * n)) for s in self.sq[k]])
+                for k, n in enumerate(self.n) if n >= MIN_PAIRS]
+
+
+class Characterizer:
+    """Sensor noise statistics over one device's FRAME_RAW samples."""
+
+    def __init__(self, device=None):
+        self.device = device        # sender ID; None: the first one seen
+        self.pyramids = (AllanPyramid(len(CHANNELS), 1), AllanPyramid(len(CHANNELS), 3))
+        self.samples = 0
+        self.dropped = 0
+        self.last_seq = None
+        self.last_t_us = None
+        self.elapsed_us = 0
+        self.stream = None          # CHAR line: (rate Hz, dlpf, ±g, ±°/s)
+        self.temp = None            # (min, max) °C from TEMP lines
+        self.stat = None            # STAT line: (FIFO overflows, I2C errors)
+
+    def feed(self, items):
+        for item in items:
+            if isinstance(item, telemetry.Frame):
+                if item.type == telemetry.FRAME_RAW:
+                    self._sample(item)
+            elif isinstance(item, str):
+                self._line(item)
+
+    def _sample(self, f):
+        if self.device is None:
+            self.device = f.device
+        elif f.device != self.device:
+            return
+        if self.last_seq is not None:
+            gap = (f.seq - self.last_seq) & 0xFFFF
+            if gap == 0 or gap >= 0x8000:
+                return              # repeat, or out of order
+            self.dropped += gap - 1
+            self.elapsed_us += (f.t_us - self.last_t_us) & 0xFFFFFFFF
+        self.last_seq = f.seq
+        self.last_t_us = f.t_us
+        v = f.raw[0:6]
+        for p in self.pyramids:
+            p.add(v)
+        self.samples += 1
+
+    def _line(self, line):
+        parts = line.strip().split(',')
+        try:
+            if parts[0] == 'CHAR' and len(parts) == 5:
+                self.stream = tuple(int(p) for p in parts[1:])
+            elif parts[0] == 'TEMP' and len(parts) == 2:
+                t = float(parts[1])
+                self.temp = (t, t) if self.temp is None else (min(self.temp[0], t),
+                                                              max(self.temp[1], t))
+            elif parts[0] == 'STAT' and len(parts) == 3:
+                self.stat = (int(parts[1]), int(parts[2]))
+        except ValueError:
+            pass
+
+    @property
+    def tau0(self):
+        """Sample period from the device clock (dropped samples included)."""
+        steps = self.samples - 1 + self.dropped
+        return self.elapsed_us / 1e6 / steps if steps > 0 and self.elapsed_us else None
+
+    def curves(self):
+        """Per channel: [(tau, sigma)] sorted by tau; and the rows for --csv."""
+        tau0 = self.tau0
+        if tau0 is None:
+            return None, []
+        rows = sorted(pt for p in self.pyramids for pt in p.points(tau0))
+        curves = [[(tau, sigmas[c]) for tau, _, sigmas in rows] for c in range(len(CHANNELS))]
+        return curves, rows
+
+
+def analyse(curve):
+    """(rms at rate, noise density or None, bias instability, its tau, reached)."""
+    taus = [t for t, _ in curve]
+    sig = [s for _, s in curve]
+    i_min = min(range(len(sig)), key=sig.__getitem__)
+    white = []
+    for j in range(i_min):
+        if sig[j] <= 0 or sig[j + 1] <= 0:
+            continue
+        slope = math.log(sig[j + 1] / sig[j]) / math.log(taus[j + 1] / taus[j])
+        if abs(slope + 0.5) <= WHITE_SLOPE_TOL:
+            white += [sig[j] * math.sqrt(taus[j]), sig[j + 1] * math.sqrt(taus[j + 1])]
+    density = sorted(white)[len(white) // 2] if white else None
+    return sig[0], density, sig[i_min] / BIAS_INSTABILITY, taus[i_min], i_min < len(sig) - 1
+
+
+def fmt_channel(name, stats):
+    rms, density, bias, tau, reached = stats
+    le = '' if reached else '≤'
+    if name.startswith('gyro'):
+        nd = (f"{density:.4f} °/s/√Hz ({density * 60:.2f} °/√h)" if density is not None
+              else 'no white-noise region')
+        return (f"  {name:<7} {rms:9.4f} °/s   {nd:<28} "
+                f"{le}{bias * 3600:.2f} °/h at {tau:.3g} s")
+    nd = f"{density * 1e6:.0f} µg/√Hz" if density is not None else 'no white-noise region'
+    return (f"  {name:<7} {rms * 1e3:9.3f} mg    {nd:<28} "
+            f"{le}{bias * 1e6:.1f} µg at {tau:.3g} s")
+
+
+def report(ch, label, crc_errors=0):
+    tau0 = ch.tau0
+    if tau0 is None or ch.samples < 2 * MIN_PAIRS:
+        print(f"{label}: {ch.samples} FRAME_RAW samples, not enough to analyse")
+        return
+    span_s = ch.elapsed_us / 1e6
+    span = f"{span_s / 3600:.2f} h" if span_s >= 3600 else f"{span_s:.0f} s"
+    device = 'v1' if ch.device is None else telemetry.device_name(ch.device)
+    print(f"{label}: {ch.samples} samples over {span} at {1 / tau0:.1f} Hz, device {device} "
+          f"({ch.dropped} dropped, {crc_errors} CRC errors)")
+    if ch.stream:
+        rate, dlpf, acc_g, gyr_dps = ch.stream
+        g_bw, g_ms = GYRO_DLPF.get(dlpf, (0, 0))
+        a_bw, a_ms = ACC_DLPF.get(dlpf, (0, 0))
+        print(f"  stream: {rate} Hz, DLPF {dlpf} (gyro {g_bw:g} Hz / {g_ms:g} ms, "
+              f"accel {a_bw:g} Hz / {a_ms:g} ms), ±{acc_g} g, ±{gyr_dps} °/s")
+    extra = []
+    if ch.temp:
+        extra.append(f"{ch.temp[0]:.1f}–{ch.temp[1]:.1f} °C")
+    if ch.stat and any(ch.stat):
+        extra.append(f"{ch.stat[0]} FIFO overflows, {ch.stat[1]} I2C errors")
+    if ch.dropped > ch.samples // 1000:
+        extra.append("more than 0.1 % dropped: long-tau figures are suspect")
+    if extra:
+        print('  ' + '; '.join(extra))
+    curves, _ = ch.curves()
+    print(f"  {'channel':<7} {'rms at rate':>13}   {'noise density':<28} bias instability")
+    for name, curve in zip(CHANNELS, curves):
+        print(fmt_channel(name, analyse(curve)))
+
+
+def write_csv(path, ch):
+    _, rows = ch.curves()
+    with open(path, 'w', newline='') as f:
+        w = csv.writer(f)
+        w.writerow(('tau_s', 'pairs') + tuple(c.replace(' ', '_') for c in CHANNELS))
+        for tau, n, sigmas in rows:
+            w.writerow([f'{tau:.6g}', n] + [f'{s:.6g}' for s in sigmas])
+
+
+def run_capture(path, ch):
+    decoder = telemetry.StreamDecoder()
+    bad = 0
+    next_progress = time.monotonic() + PROGRESS_S
+    for _, source, data in capture.read_capture(path):
+        if source == capture.SOURCE_SERIAL:
+            ch.feed(decoder.feed(data))
+        elif data and data[0] == telemetry.MAGIC:
+            frames = telemetry.decode_frames(data)
+            if frames is None:
+                bad += 1
+            else:
+                ch.feed(frames)
+        else:
+            ch.feed([data.decode('utf-8', errors='ignore')])
+        if time.monotonic() >= next_progress:
+            next_progress += PROGRESS_S
+            print(f"  ... {ch.samples} samples", flush=True)
+    return bad + decoder.crc_errors
+
+
+def run_serial(args, ch):
+    import serial
+    ser = serial.Serial(args.port, args.baud, timeout=0.1)
+    ser.reset_input_buffer()
+    decoder = telemetry.StreamDecoder()
+    recorder = capture.CaptureWriter(args.record) if args.record else None
+    start = time.monotonic()
+    next_report = start + args.report_s
+    print(f"Reading {args.port} at {args.baud} baud" +
+          (f", recording to {args.record}" if recorder else "") + " (Ctrl-C to stop)")
+    try:
+        while not args.seconds or time.monotonic() - start < args.seconds:
+            data = ser.read(max(1, ser.in_waiting))
+            if not data:
+                continue
+            if recorder:
+                recorder.write(data, source=capture.SOURCE_SERIAL)
+            ch.feed(decoder.feed(data))
+            if time.monotonic() >= next_report:
+                next_report += args.report_s
+                report(ch, args.port, decoder.crc_errors)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        ser.close()
+        if recorder:
+            recorder.close()
+    return decoder.crc_errors
+
+
+def main():
+    parser = argparse.ArgumentParser(description='IMU noise characterization (Allan deviation)')
+    parser.add_argument('capture', nargs='?', help='Capture file (server.py --record / --record below)')
+    parser.add_argument('--port', help='Read a device live instead (characterize firmware)')
+    parser.add_argument('--baud', type=int, default=921600)
+    parser.add_argument('--record', metavar='FILE', help='With --port: also save a capture')
+    parser.add_argument('--seconds', type=float, default=0, help='With --port: stop after this long')
+    parser.add_argument('--report-s', type=float, default=60.0, help='With --port: report interval')
+    parser.add_argument('--device', type=lambda v: int(v, 16), default=None,
+                        help='Sender ID (hex) to analyse (default: the first)')
+    parser.add_argument('--csv', metavar='FILE', help='Write tau and sigma per channel')
+    args = parser.parse_args()
+    if bool(args.capture) == bool(args.port):
+        parser.error('give a capture file or --port')
+
+    ch = Characterizer(args.device)
+    if args.port:
+        bad = run_serial(args, ch)
+        label = args.port
+    else:
+        bad = run_capture(args.capture, ch)
+        label = args.capture
+    report(ch, label, bad)
+    if args.csv and ch.tau0:
+        write_csv(args.csv, ch)
+        print(f"  curves -> {args.csv}")
+
+
+if __name__ == '__main__':
+    main()
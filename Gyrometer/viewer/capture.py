@@ -0,0 +1,101 @@
+"""
+Append-only capture of everything the device sends, for replay.py and the
+Air_Pointer simulation's --replay mode.
+
+The file keeps the bytes exactly as they arrived (UDP datagrams and serial
+read chunks) with their host receive times, so a replay exercises the same
+decode path as a live session and is bit-for-bit deterministic.
+
+    magic  b'GYCAP1\\n'
+    record dt_us u32 (since the previous record) | source u8 | len u16 | data
+
+A crash leaves at most one truncated record at the end, which the reader
+drops.
+"""
+
+import struct
+import threading
+import time
+
+import latency
+
+MAGIC = b'GYCAP1\n'
+SOURCE_UDP = 0       # one datagram per record
+SOURCE_SERIAL = 1    # a chunk of the serial byte stream
+RECORD = struct.Struct('<IBH')
+MAX_DT_US = 0xFFFFFFFF
+
+
+class CaptureWriter:
+    """Thread-safe (UDP and serial readers share one file)."""
+
+    FLUSH_INTERVAL_S = 1.0
+
+    def __init__(self, path):
+        self.path = path
+        self.f = open(path, 'ab')
+        if self.f.tell() == 0:
+            self.f.write(MAGIC)
+        self.lock = threading.Lock()
+        self.last_us = None
+        self.last_flush = time.monotonic()
+        self.records = 0
+        self.bytes = 0
+
+    def write(self, data, t_recv_us=None, source=SOURCE_UDP):
+        if not data:
+            return
+        t = latency.now_us() if t_recv_us is None else t_recv_us
+        with self.lock:
+            dt = 0 if self.last_us is None else min(MAX_DT_US, max(0, t - self.last_us))
+            self.last_us = t
+            # Serial chunks can exceed a record; split them (dt 0 after the first)
+            for off in range(0, len(data), 0xFFFF):
+                chunk = data[off:off + 0xFFFF]
+                self.f.write(RECORD.pack(dt, source, len(chunk)))
+                self.f.write(chunk)
+                dt = 0
+                self.records += 1
+                self.bytes += len(chunk)
+            now = time.monotonic()
+            if now - self.last_flush >= self.FLUSH_INTERVAL_S:
+                self.f.flush()
+                self.last_flush = now
+
+    def close(self):
+        with self.lock:
+            self.f.close()
+
+
+def read_capture(path):
+    """Yields (t_us since the first record, source, bytes) in order."""
+    with open(path, 'rb') as f:
+        if f.read(len(MAGIC)) != MAGIC:
+            raise ValueError(f'{path}: not a capture file')
+        t = 0
+        while True:
+            head = f.read(RECORD.size)
+            if len(head) < RECORD.size:
+                return
+            dt, source, length = RECORD.unpack(head)
+            data = f.read(length)
+            if len(data) < length:
+                return
+            t += dt
+            yield t, source, data
+
+
+def paced(records, speed=1.0):
+    """
+    Re-times (t_us, source, data) records to the wall clock at `speed`x
+    (speed <= 0: as fast as possible).
+    """
+    start = None
+    for t, source, data in records:
+        if speed > 0:
+            if start is None:
+                start = time.monotonic() - t / 1e6 / speed
+            wait = start + t / 1e6 / speed - time.monotonic()
+            if wait > 0:
+                time.sleep(wait)
+        yield t, source, data
@@ -0,0 +1,412 @@
+"""
+Per-device state for server.py. Each unit streaming to the host gets its
+own DeviceSession, so several sensors in one room each keep their own
+decoder, host fusion filter, clock sync and link statistics.
+
+A device is keyed by the sender ID in its binary frame headers
+(telemetry.device_name). Text lines carry no ID. They belong to the device
+last seen on the same link: the UDP source address or the serial port.
+Firmware that never sends a version 2 frame (ASCII output, old builds) is
+keyed by its link instead (endpoint_name).
+
+Sessions live in a Shard; shards.py runs one per worker process. Sessions
+emit nothing themselves. Every result is a message appended to the shard's
+outbox, which the main process turns into Socket.IO traffic:
+
+    ('orient', device, kind, values, seq, t_host_us, covers)
+    ('emit', device, event, data)
+    ('send', device, line)          command for the device (SYNC probes)
+    ('link', device, endpoint)      the device now streams on endpoint
+    ('gone', device)                nothing heard for SESSION_TIMEOUT_S
+
+Orientation is coalesced per device between two take() calls: the newest
+sample wins and `covers` counts the samples it stands for. dispatch.py does
+the same per display tick. t_host_us is when the sample was taken, on the
+host clock (latency.now_us). It is None until the clocks are synced.
+
+An endpoint is ('udp', host, port) or ('serial', port_name).
+"""
+
+import math
+import time
+
+import dispatch
+import host_fusion
+import latency
+import telemetry
+
+TICK_S = 1.0              # clock-sync probe and latency_stats per device
+SESSION_TIMEOUT_S = 15.0  # idle devices still send a keepalive every second
+
+# Lines that are only boot / debug output
+QUIET_PREFIXES = ('=', 'WiFi', 'MPU', 'HMC', 'ERROR', 'DIAG', 'DEVICE')
+DEVICE_LINE = 'DEVICE: id '   # firmware boot banner with the sender ID
+KNOWN_PREFIXES = ('EULER', 'QUAT', 'STATUS', 'TRANSPORT', 'PERF', 'SYNC',
+                  'POINTER', 'CONFIG', 'MOTION')
+
+
+def endpoint_name(endpoint):
+    """'udp:<host>:<port>' or 'serial:<port>', the key of a device without an ID."""
+    return ':'.join(str(p) for p in endpoint)
+
+
+class DeviceSession:
+    """Everything server.py used to keep in globals, for one device."""
+
+    def __init__(self, key, shard):
+        self.key = key
+        self.shard = shard
+        self.endpoint = None
+        self.last_heard = time.monotonic()
+        self.clock_sync = latency.ClockSync()
+        self.link_stats = latency.LinkStats()   # device sample → server receive
+        self.host_filter = None                 # first FRAME_RAW packet
+        self.latest = None                      # (kind, values, seq, t_host_us)
+        self.covers = 0
+        self.last_frame_flags = None
+        self.perf_clock = {'mhz': 240, 'period_us': 10000}  # "PERF,clock" line
+        self.perf_report = {}                                # stage -> stats in µs
+        self.euler_count = 0
+        self.status_count = 0
+        self.frame_count = 0
+        self.last_log_time = 0
+
+    # ── Output (see the module docstring) ──
+    def emit(self, event, data):
+        self.shard.out.append(('emit', self.key, event, data))
+
+    def send(self, line):
+        self.shard.out.append(('send', self.key, line))
+
+    def heard(self, endpoint):
+        self.last_heard = time.monotonic()
+        if endpoint != self.endpoint:
+            self.endpoint = endpoint
+            self.shard.out.append(('link', self.key, endpoint))
+
+    def orientation(self, kind, values, frame=None, t_recv=None, covers=1):
+        t_host = None
+        if frame is not None:
+            lat = self.clock_sync.latency_us(frame.t_us, t_recv)
+            if lat is not None:
+                t_host = t_recv - lat
+        if self.latest is None:
+            self.shard.dirty.append(self)
+        self.latest = (kind, values, None if frame is None else frame.seq, t_host)
+        self.covers += covers
+
+    def flush(self):
+        kind, values, seq, t_host = self.latest
+        self.shard.out.append(('orient', self.key, kind, values, seq, t_host, self.covers))
+        self.latest = None
+        self.covers = 0
+
+    def log(self, text):
+        print(f"[{self.key}] {text}")
+
+    # ── Input ──
+    def packet(self, data, t_recv):
+        """One UDP datagram: a binary frame, a batch, or a text line."""
+        if data and data[0] == telemetry.MAGIC:
+            frames = telemetry.decode_frames(data)
+            if frames is not None:
+                self.frames(frames, t_recv)
+            else:
+                self.log(f"[ERROR] Bad frame ({len(data)} bytes): {data[:24].hex()}")
+            return
+        line = data.decode('utf-8', errors='ignore').strip()
+        if line:
+            self.line(line, t_recv)
+
+    def frames(self, frames, t_recv):
+        """Samples that arrived together, in order; raw runs go to host fusion."""
+        raw = []
+        for frame in frames:
+            if frame.type == telemetry.FRAME_RAW:
+                raw.append(frame)
+                continue
+            if raw:
+                self._raw(raw, t_recv)
+                raw = []
+            self._frame(frame, t_recv)
+        if raw:
+            self._raw(raw, t_recv)
+
+    def _frame(self, frame, t_recv):
+        self.link_stats.add(frame.seq, self.clock_sync.latency_us(frame.t_us, t_recv))
+
+        status_flags = frame.flags & (telemetry.STATUS_IMU_OK | telemetry.STATUS_MAG_OK)
+        if status_flags != self.last_frame_flags:
+            self.last_frame_flags = status_flags
+            self.emit('device_status', {'imu': frame.imu_ok, 'mag': frame.mag_ok})
+
+        if frame.type == telemetry.FRAME_QUAT:
+            self._quat(frame.quat, frame, t_recv)
+            return
+        if frame.type != telemetry.FRAME_EULER:
+            return
+        roll, pitch, yaw = frame.roll, frame.pitch, frame.yaw
+        self.orientation(dispatch.ORIENT_EULER, (roll, pitch, yaw), frame, t_recv)
+        self.frame_count += 1
+        now = time.time()
+        if now - self.last_log_time >= 5:
+            self.log(f"[INFO] FRAME received: {self.frame_count} total | seq={frame.seq} | "
+                     f"roll={roll:.2f} pitch={pitch:.2f} yaw={yaw:.2f}")
+            self.last_log_time = now
+
+    def _raw(self, frames, t_recv):
+        """
+        Host fusion over a packet of FRAME_RAW samples; only the newest
+        orientation is published (the others just feed the filter).
+        """
+        for frame in frames:
+            self._frame(frame, t_recv)
+        if self.host_filter is None:
+            self.host_filter = host_fusion.MadgwickBatch(self.shard.beta)
+        t_us, flags, acc, gyr, mag = host_fusion.raw_arrays(frames)
+        quats = self.host_filter.update(t_us, flags, acc, gyr, mag)[-1:]
+        if self.shard.predict_s:
+            quats = host_fusion.predict(quats, gyr[-1:], self.shard.predict_s)
+        self._quat(tuple(quats[0].tolist()), frames[-1], t_recv, covers=len(frames))
+
+    def _quat(self, q, frame=None, t_recv=None, covers=1):
+        """Forward a quaternion sample; the browser does the Euler conversion."""
+        if any(math.isnan(v) or math.isinf(v) for v in q):
+            return
+        self.orientation(dispatch.ORIENT_QUAT, q, frame, t_recv, covers)
+        self.frame_count += 1
+        now = time.time()
+        if now - self.last_log_time >= 5:
+            roll, pitch, yaw = telemetry.quat_to_euler(q)
+            self.log(f"[INFO] QUAT received: {self.frame_count} total | "
+                     f"roll={roll:.2f} pitch={pitch:.2f} yaw={yaw:.2f}")
+            self.last_log_time = now
+
+    def line(self, line, t_recv):
+        """One text line from either serial or UDP."""
+        if not line.startswith(KNOWN_PREFIXES):
+            if not line.startswith(QUIET_PREFIXES):
+                self.log(f"[WARN] Unknown line: {repr(line[:80])}")
+            return
+        parts = line.split(',')
+
+        if parts[0] == 'EULER':
+            if len(parts) != 4:
+                self.log(f"[ERROR] EULER wrong field count ({len(parts)}): {repr(line[:80])}")
+                return
+            try:
+                roll, pitch, yaw = (float(p) for p in parts[1:])
+            except ValueError as e:
+                self.log(f"[ERROR] Bad EULER parse: {repr(line)} -> {e}")
+                return
+            # Reject nan/inf values
+            if any(math.isnan(v) or math.isinf(v) for v in (roll, pitch, yaw)):
+                return
+            self.orientation(dispatch.ORIENT_EULER, (roll, pitch, yaw))
+            self.euler_count += 1
+            now = time.time()
+            if now - self.last_log_time >= 5:
+                self.log(f"[INFO] EULER received: {self.euler_count} total | STATUS: {self.status_count} | "
+                         f"roll={roll:.2f} pitch={pitch:.2f} yaw={yaw:.2f}")
+                self.last_log_time = now
+
+        elif parts[0] == 'QUAT':
+            if len(parts) != 5:
+                self.log(f"[ERROR] QUAT wrong field count ({len(parts)}): {repr(line[:80])}")
+                return
+            try:
+                q = tuple(float(p) for p in parts[1:])
+            except ValueError as e:
+                self.log(f"[ERROR] Bad QUAT parse: {repr(line)} -> {e}")
+                return
+            self._quat(q)
+
+        elif parts[0] == 'STATUS':
+            if len(parts) == 3:
+                try:
+                    imu_ok = int(parts[1]) == 1
+                    mag_ok = int(parts[2]) == 1
+                except ValueError:
+                    self.log(f"[ERROR] Bad STATUS parse: {repr(line)}")
+                    return
+                self.emit('device_status', {'imu': imu_ok, 'mag': mag_ok})
+                self.status_count += 1
+
+        elif parts[0] == 'TRANSPORT':
+            if len(parts) == 2:
+                mode = parts[1].strip()
+                self.log(f"Transport mode: {mode}")
+                self.emit('transport_mode', {'mode': mode})
+
+        elif parts[0] == 'POINTER':
+            if len(parts) == 2:
+                self.log(f"Pointer link: {parts[1].strip()}")
+                self.emit('pointer_link', {'link': parts[1].strip()})
+
+        elif parts[0] == 'MOTION':
+            # Device dropped to its idle rate (or came back): sparse frames
+            # are expected while idle, not a link problem
+            if len(parts) == 2:
+                self.log(f"Device motion: {parts[1].strip()}")
+                self.emit('motion_state', {'state': parts[1].strip()})
+
+        elif parts[0] == 'PERF':
+            self._perf(parts)
+
+        elif parts[0] == 'CONFIG':
+            # CONFIG,<key>,<value> | CONFIG,ERR,<key> | CONFIG,saved
+            if len(parts) == 3 and parts[1] == 'ERR':
+                self.log(f"Device config: rejected {parts[2]}")
+                self.emit('device_config', {'error': parts[2]})
+            elif len(parts) == 3:
+                self.emit('device_config', {'key': parts[1], 'value': parts[2]})
+            elif len(parts) == 2:
+                self.log(f"Device config: {parts[1]}")
+
+        elif parts[0] == 'SYNC':
+            self.clock_sync.on_reply(parts, t_recv)
+
+    def _perf(self, parts):
+        """
+        PERF,clock,<mhz>,<period_us> starts a report; each PERF,<stage>,<count>,
+        <min>,<mean>,<p99>,<max> line is in CPU cycles. 'send' closes the report.
+        """
+        try:
+            if parts[1] == 'clock' and len(parts) == 4:
+                self.perf_clock['mhz'] = int(parts[2]) or 240
+                self.perf_clock['period_us'] = int(parts[3])
+                self.perf_report.clear()
+                return
+            if len(parts) != 7:
+                self.log(f"[ERROR] PERF wrong field count ({len(parts)}): {repr(','.join(parts)[:80])}")
+                return
+            count, *cycles = (int(p) for p in parts[2:])
+        except ValueError:
+            self.log(f"[ERROR] Bad PERF parse: {repr(','.join(parts)[:80])}")
+            return
+        mhz = self.perf_clock['mhz']
+        self.perf_report[parts[1]] = dict(count=count, **{k: c / mhz for k, c in zip(('min', 'mean', 'p99', 'max'), cycles)})
+        if parts[1] == 'send':
+            budget = self.perf_clock['period_us']
+            self.log(f"[PERF] µs per call, sample budget {budget} µs")
+            for stage, st in self.perf_report.items():
+                self.log(f"[PERF]   {stage:<9} n={st['count']:<6} min={st['min']:8.1f} mean={st['mean']:8.1f} "
+                         f"p99={st['p99']:8.1f} max={st['max']:8.1f}")
+            self.emit('perf_data', {'budget_us': budget, 'stages': dict(self.perf_report)})
+
+    # ── Once every TICK_S ──
+    def tick(self):
+        """Clock-sync probe on the device's link and the latency_stats report."""
+        self.send(self.clock_sync.make_probe())
+        cs = self.clock_sync
+        self.emit('latency_stats', {
+            'synced': cs.synced,
+            'rtt_ms': None if cs.rtt_us is None else cs.rtt_us / 1000.0,
+            'transport': self.endpoint[0] if self.endpoint else None,
+            'device': cs.device,
+            'link': self.link_stats.snapshot(),
+        })
+
+
+class Shard:
+    """The sessions of every device routed to one worker."""
+
+    def __init__(self, beta=0.1, predict_s=0.0):
+        self.beta = beta          # host fusion gain for new sessions
+        self.predict_s = predict_s  # host fusion latency compensation, 0 = off
+        self.sessions = {}        # device key -> DeviceSession
+        self.bound = {}           # serial endpoint -> device key last seen on it
+        self.decoders = {}        # serial endpoint -> StreamDecoder
+        self.out = []
+        self.dirty = []           # sessions holding an orientation for take()
+
+    def session(self, key, endpoint):
+        s = self.sessions.get(key)
+        if s is None:
+            s = self.sessions[key] = DeviceSession(key, self)
+            print(f"[INFO] Device {key} on {endpoint_name(endpoint)}")
+        s.heard(endpoint)
+        return s
+
+    def feed(self, t_recv, endpoint, key, data):
+        """
+        One read handed over by the ingest thread. A UDP datagram comes with
+        its device key (the router knows it from the header or the source
+        address); a serial chunk does not (key None) and data None means that
+        serial link was (re)opened or lost.
+        """
+        if endpoint[0] != 'serial':
+            self.session(key, endpoint).packet(data, t_recv)
+            return
+        if data is None:
+            self.decoders.pop(endpoint, None)
+            self.bound.pop(endpoint, None)
+            return
+        decoder = self.decoders.get(endpoint)
+        if decoder is None:
+            decoder = self.decoders[endpoint] = telemetry.StreamDecoder()
+        frames = []
+        for item in decoder.feed(data):
+            if isinstance(item, str):
+                self._serial_frames(endpoint, frames, t_recv)
+                frames = []
+                if item.startswith(DEVICE_LINE):
+                    # Boot banner: bind the port before the first frame
+                    try:
+                        self._bind(endpoint, telemetry.device_name(int(item[len(DEVICE_LINE):], 16)))
+                    except ValueError:
+                        pass
+                if endpoint in self.bound or item.startswith(KNOWN_PREFIXES):
+                    self._serial_session(endpoint, None).line(item, t_recv)
+                elif not item.startswith(QUIET_PREFIXES):
+                    # Boot output of a device not known yet: no session for it
+                    print(f"[WARN] {endpoint_name(endpoint)}: Unknown line: {repr(item[:80])}")
+            else:
+                frames.append(item)
+        self._serial_frames(endpoint, frames, t_recv)
+
+    def _bind(self, endpoint, key):
+        """Text on this serial port is from device `key` from now on."""
+        if self.bound.get(endpoint) != key:
+            self.bound[endpoint] = key
+            self.close(endpoint_name(endpoint))   # its lines until now
+
+    def _serial_session(self, endpoint, device):
+        if device is not None:
+            self._bind(endpoint, telemetry.device_name(device))
+        key = self.bound.get(endpoint) or endpoint_name(endpoint)
+        return self.session(key, endpoint)
+
+    def _serial_frames(self, endpoint, frames, t_recv):
+        """Frames from one serial chunk, split into runs from the same device."""
+        start = 0
+        for i in range(1, len(frames) + 1):
+            if i == len(frames) or frames[i].device != frames[start].device:
+                self._serial_session(endpoint, frames[start].device).frames(frames[start:i], t_recv)
+                start = i
+
+    def close(self, key):
+        s = self.sessions.pop(key, None)
+        if s is None:
+            return
+        if s.latest is not None:
+            self.dirty.remove(s)
+        self.out.append(('gone', key))
+        print(f"[INFO] Device {key} gone")
+
+    def tick(self):
+        """Per-device timers; sessions not heard from in a while are closed."""
+        now = time.monotonic()
+        for key, s in list(self.sessions.items()):
+            if now - s.last_heard > SESSION_TIMEOUT_S:
+                self.close(key)
+            else:
+                s.tick()
+
+    def take(self):
+        """Messages since the last call, newest orientation per device last."""
+        for s in self.dirty:
+            s.flush()
+        self.dirty = []
+        out, self.out = self.out, []
+        return out
@@ -0,0 +1,137 @@
+"""
+Single Socket.IO dispatcher between the readers and the browsers.
+
+Readers (the shard collector, see shards.py) only hand samples over; one
+thread does every emit. Each device has its own Socket.IO room, named by its
+key in devices.py. A browser joins the room of the device it shows.
+
+  - Orientation samples are coalesced per device: the newest one wins and
+    goes out at most `rate_hz` times a second (the display refresh), as one
+    binary 'orient' packet to that device's room, however fast the device
+    streams. A sample that arrives after a quiet period is sent at once.
+  - Other events (device_status, transport_mode, perf_data, latency_stats,
+    devices) go out in order through a bounded queue, to a device's room or
+    to everyone. If the queue ever fills, the oldest are dropped and counted.
+
+One packet per device per tick costs the same whatever the device rate, and
+python-engineio gives each client its own send queue, so a slow viewer does
+not hold up the others.
+
+'orient' payload (little-endian, 36 bytes):
+    kind u8 (1 = euler, 2 = quat) | flags u8 | seq u16 | coalesced u16
+    | slot u16 | ts f64 (server wall clock at emit, ms)
+    | age_ms f32 (sample -> emit) | v0..v3 f32 (roll, pitch, yaw, NaN or
+    w, x, y, z)
+flags: ORIENT_HAS_SEQ (binary telemetry), ORIENT_HAS_AGE (clocks synced).
+`coalesced` is how many samples since the previous packet were folded into
+this one, so the browser does not count them as drops. `slot` is the
+device's number in the 'devices' list, for a browser in several rooms.
+"""
+
+import collections
+import math
+import struct
+import threading
+import time
+
+import latency
+
+ORIENT_EULER = 1
+ORIENT_QUAT = 2
+ORIENT_HAS_SEQ = 1 << 0
+ORIENT_HAS_AGE = 1 << 1
+ORIENT = struct.Struct('<BBHHHdf4f')
+
+CONTROL_QUEUE = 1024
+
+
+class Dispatcher:
+    def __init__(self, socketio, rate_hz=60.0):
+        self.socketio = socketio
+        self.period = 1.0 / rate_hz
+        self.cond = threading.Condition()
+        # room -> [(kind, values, seq, t_host_us), covers, replaced, slot];
+        # replaced counts the samples overwritten since the last emit
+        self.latest = {}
+        self.control = collections.deque(maxlen=CONTROL_QUEUE)
+        self.last_emit = 0.0
+        self.running = False
+        self.stats = {'samples': 0, 'emitted': 0, 'coalesced': 0, 'control_dropped': 0}
+
+    # ── Producer side (any thread) ──
+    def orientation(self, kind, values, seq=None, t_host_us=None, covers=1, room=None, slot=0):
+        """
+        Newest orientation of the device in `room`. `covers` > 1 when it
+        stands for a run of samples already folded together upstream;
+        t_host_us is the sample time on the host clock (latency.now_us).
+        """
+        with self.cond:
+            self.stats['samples'] += covers
+            pending = self.latest.get(room)
+            if pending is None:
+                self.latest[room] = [(kind, values, seq, t_host_us), covers, 0, slot]
+            else:
+                pending[2] += pending[1]
+                pending[0], pending[1], pending[3] = (kind, values, seq, t_host_us), covers, slot
+            self.cond.notify()
+
+    def emit(self, event, data, room=None):
+        """room None: every browser."""
+        with self.cond:
+            if len(self.control) == self.control.maxlen:
+                self.stats['control_dropped'] += 1
+            self.control.append((event, data, room))
+            self.cond.notify()
+
+    # ── Dispatcher thread ──
+    def start(self):
+        self.running = True
+        threading.Thread(target=self._run, name='dispatch', daemon=True).start()
+
+    def stop(self):
+        with self.cond:
+            self.running = False
+            self.cond.notify()
+
+    def _run(self):
+        while True:
+            with self.cond:
+                while self.running and not self.control and not self.latest:
+                    self.cond.wait()
+                if not self.running:
+                    return
+                control = list(self.control)
+                self.control.clear()
+                samples = ()
+                if self.latest:
+                    wait = self.last_emit + self.period - time.monotonic()
+                    if wait <= 0:
+                        samples = list(self.latest.items())
+                        self.latest = {}
+                    elif not control:
+                        # Throttled: sleep to the next slot (new control
+                        # events wake us early and go out first)
+                        self.cond.wait(wait)
+                        continue
+            for event, data, room in control:
+                self.socketio.emit(event, data, to=room)
+            if samples:
+                self.last_emit = time.monotonic()
+            for room, (sample, covers, replaced, slot) in samples:
+                replaced += covers - 1
+                self.socketio.emit('orient', self._pack(sample, replaced, slot), to=room)
+                self.stats['emitted'] += 1
+                self.stats['coalesced'] += replaced
+
+    def _pack(self, sample, replaced, slot):
+        kind, values, seq, t_host = sample
+        flags = 0
+        age_ms = math.nan
+        if seq is not None:
+            flags |= ORIENT_HAS_SEQ
+        if t_host is not None:
+            flags |= ORIENT_HAS_AGE
+            age_ms = (latency.now_us() - t_host) / 1000.0
+        v = tuple(values) + (math.nan,) * (4 - len(values))
+        return ORIENT.pack(kind, flags, (seq or 0) & 0xFFFF, min(replaced, 0xFFFF),
+                           slot & 0xFFFF, time.time() * 1000.0, age_ms, *v)
@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+"""
+Stand-in for a room full of Gyrometers, to load-test server.py's multi-device
+ingest without hardware. Each simulated device streams version 2 QUAT
+frames, with its own sender ID, from its own UDP socket, the way the
+firmware does, and answers SYNC probes so the latency panel works.
+
+    python fleet_sim.py --devices 36 --rate 200
+    python fleet_sim.py --devices 4 --host 192.168.1.100 --seconds 60
+
+Device k turns about its own axis at its own speed, so the viewer shows which
+is which. Sender IDs start at --first-id (hex).
+"""
+
+import argparse
+import math
+import socket
+import time
+
+import latency
+import telemetry
+
+
+class SimDevice:
+    def __init__(self, index, device_id, target):
+        self.id = device_id
+        self.target = target
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.setblocking(False)
+        self.seq = 0
+        self.clock_offset = index * 1_000_003      # device clocks never agree
+        self.rate = 20.0 + 7.0 * index             # deg/s
+        axis = (math.sin(index), math.cos(index), 0.5)
+        n = math.sqrt(sum(a * a for a in axis))
+        self.axis = tuple(a / n for a in axis)
+
+    def device_us(self):
+        return (latency.now_us() + self.clock_offset) & 0xFFFFFFFF
+
+    def send(self, t_s):
+        half = math.radians(self.rate * t_s) / 2
+        s = math.sin(half)
+        q = (math.cos(half), self.axis[0] * s, self.axis[1] * s, self.axis[2] * s)
+        values = tuple(int(round(v * 16384)) for v in q)
+        frame = telemetry.encode_frame(telemetry.FRAME_QUAT, values, self.seq,
+                                       self.device_us(), device=self.id)
+        self.seq = (self.seq + 1) & 0xFFFF
+        self.sock.sendto(frame, self.target)
+
+    def answer_probes(self):
+        """SYNC,<id>,<host_us> -> SYNC,<id>,<host_us>,<device_us>,<age_mean>,<age_max>,<drops>"""
+        while True:
+            try:
+                data, _ = self.sock.recvfrom(256)
+            except (BlockingIOError, InterruptedError):
+                return
+            except OSError:
+                return        # e.g. port unreachable before the server is up
+            parts = data.decode('utf-8', errors='ignore').strip().split(',')
+            if parts[0] == 'SYNC' and len(parts) == 3:
+                reply = f"SYNC,{parts[1]},{parts[2]},{self.device_us()},0,0,0"
+                self.sock.sendto(reply.encode(), self.target)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Simulated devices for server.py')
+    parser.add_argument('--devices', type=int, default=8)
+    parser.add_argument('--rate', type=float, default=200.0, help='Frames per second per device')
+    parser.add_argument('--host', default='127.0.0.1', help='server.py host')
+    parser.add_argument('--udp-port', type=int, default=4210)
+    parser.add_argument('--first-id', type=lambda v: int(v, 16), default=0x1000)
+    parser.add_argument('--seconds', type=float, default=0, help='Stop after this long (0: run until ^C)')
+    args = parser.parse_args()
+
+    target = (args.host, args.udp_port)
+    fleet = [SimDevice(k, (args.first_id + k) & 0xFFFF, target) for k in range(args.devices)]
+    period = 1.0 / args.rate
+    start = time.monotonic()
+    next_t = start
+    sent = late = 0
+    print(f"{args.devices} devices x {args.rate:g} Hz -> {target[0]}:{target[1]} "
+          f"(IDs {telemetry.device_name(fleet[0].id)}..{telemetry.device_name(fleet[-1].id)})")
+    try:
+        while not args.seconds or next_t - start < args.seconds:
+            wait = next_t - time.monotonic()
+            if wait > 0:
+                time.sleep(wait)
+            elif wait < -period:
+                late += 1
+            t = next_t - start
+            for dev in fleet:
+                dev.send(t)
+                dev.answer_probes()
+            sent += len(fleet)
+            next_t += period
+    except KeyboardInterrupt:
+        pass
+    elapsed = time.monotonic() - start
+    print(f"sent {sent} frames in {elapsed:.1f} s ({sent / max(elapsed, 1e-6):.0f}/s, "
+          f"{late} ticks more than a period late)")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,191 @@
+"""
+Host-side fusion for firmware built with OUTPUT_RAW=1: the device only
+samples, FRAME_RAW batches arrive here and the filter runs on the server.
+
+Whole packets are handled at once. Decoding, unit conversion, timestamps and
+accel/mag normalisation are NumPy array operations over the packet; only the
+gradient-descent recurrence itself (each step depends on the previous
+quaternion) walks the samples, on plain Python floats.
+
+    fusion = host_fusion.MadgwickBatch(beta=0.1)
+    quats = fusion.update(*host_fusion.raw_arrays(frames))   # (N, 4)
+
+predict() turns the output ahead by the gyro rate to hide downstream lag
+(server.py --predict-ms; replay.py --latency measures what it buys).
+
+The maths is the firmware's Madgwick kernel (include/fusion_kernel.h), so a
+recording can be replayed through both and compared sample by sample.
+"""
+
+import math
+
+import numpy as np
+
+import telemetry
+
+MAX_DT_S = 0.1      # larger gaps (drops, reconnects) integrate as this
+
+
+def raw_arrays(frames):
+    """
+    FRAME_RAW Frames -> (t_us, flags, acc, gyr, mag): int64 (N,), uint8 (N,)
+    and three float64 (N, 3) arrays in g, deg/s and µT.
+    """
+    n = len(frames)
+    t_us = np.fromiter((f.t_us for f in frames), dtype=np.int64, count=n)
+    flags = np.fromiter((f.flags for f in frames), dtype=np.uint8, count=n)
+    raw = np.array([f.raw for f in frames], dtype=np.float64).reshape(n, 9)
+    return t_us, flags, raw[:, 0:3], raw[:, 3:6], raw[:, 6:9]
+
+
+def _unit_rows(v):
+    """Row-normalised copy of v and a mask of rows that were non-zero."""
+    norm = np.sqrt(np.einsum('ij,ij->i', v, v))
+    ok = norm > 0
+    out = np.zeros_like(v)
+    out[ok] = v[ok] / norm[ok, None]
+    return out, ok
+
+
+class MadgwickBatch:
+    """Madgwick AHRS over packets of raw samples (9-axis on fresh mag)."""
+
+    name = 'madgwick'
+
+    def __init__(self, beta=0.1, default_rate_hz=1000.0):
+        self.beta = beta
+        self.default_dt = 1.0 / default_rate_hz
+        self.reset()
+
+    def reset(self):
+        self.q = (1.0, 0.0, 0.0, 0.0)
+        self.last_t_us = None
+        self.samples = 0
+
+    def _dt(self, t_us):
+        """Per-sample dt in seconds from the wrapping 32-bit µs stamps."""
+        prev = np.empty_like(t_us)
+        prev[1:] = t_us[:-1]
+        prev[0] = t_us[0] - int(self.default_dt * 1e6) if self.last_t_us is None else self.last_t_us
+        dt = ((t_us - prev) & 0xFFFFFFFF) * 1e-6
+        dt[(dt <= 0) | (dt > MAX_DT_S)] = self.default_dt
+        self.last_t_us = int(t_us[-1])
+        return dt
+
+    def update(self, t_us, flags, acc, gyr, mag):
+        """Runs every sample of the packet; returns the (N, 4) quaternions."""
+        n = len(t_us)
+        if n == 0:
+            return np.empty((0, 4))
+        dt = self._dt(np.asarray(t_us, dtype=np.int64))
+        gyr = np.radians(gyr)
+        acc_n, acc_ok = _unit_rows(np.asarray(acc, dtype=np.float64))
+        mag_n, mag_ok = _unit_rows(np.asarray(mag, dtype=np.float64))
+        use_mag = mag_ok & ((np.asarray(flags) & telemetry.STATUS_MAG_FUSED) != 0)
+
+        # Flatten to Python scalars once; the loop below is pure float maths
+        rows = zip(dt.tolist(), gyr.tolist(), acc_n.tolist(), acc_ok.tolist(),
+                   mag_n.tolist(), use_mag.tolist())
+        out = np.empty((n, 4))
+        q0, q1, q2, q3 = self.q
+        beta = self.beta
+        for k, (h, (gx, gy, gz), (ax, ay, az), a_ok, (mx, my, mz), m_ok) in enumerate(rows):
+            # Rate of change of quaternion from gyroscope
+            qd0 = 0.5 * (-q1 * gx - q2 * gy - q3 * gz)
+            qd1 = 0.5 * (q0 * gx + q2 * gz - q3 * gy)
+            qd2 = 0.5 * (q0 * gy - q1 * gz + q3 * gx)
+            qd3 = 0.5 * (q0 * gz + q1 * gy - q2 * gx)
+
+            if a_ok:
+                if m_ok:
+                    s0, s1, s2, s3 = _gradient_marg(q0, q1, q2, q3, ax, ay, az, mx, my, mz)
+                else:
+                    s0, s1, s2, s3 = _gradient_imu(q0, q1, q2, q3, ax, ay, az)
+                sn = math.sqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3)
+                if sn > 0:
+                    b = beta / sn
+                    qd0 -= b * s0
+                    qd1 -= b * s1
+                    qd2 -= b * s2
+                    qd3 -= b * s3
+
+            q0 += qd0 * h
+            q1 += qd1 * h
+            q2 += qd2 * h
+            q3 += qd3 * h
+            r = 1.0 / math.sqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3)
+            q0 *= r
+            q1 *= r
+            q2 *= r
+            q3 *= r
+            out[k] = (q0, q1, q2, q3)
+
+        self.q = (q0, q1, q2, q3)
+        self.samples += n
+        return out
+
+
+def predict(quats, gyr, horizon_s):
+    """
+    Latency compensation, the firmware's quatPredict() (include/smoothing.h):
+    (N, 4) quaternions turned ahead by the (N, 3) body rates in deg/s for
+    horizon_s, one first-order step renormalised.
+    """
+    k = 0.5 * math.radians(horizon_s)
+    w, x, y, z = np.asarray(quats, dtype=np.float64).T
+    a, b, c = (np.asarray(gyr, dtype=np.float64) * k).T
+    out = np.stack((w - x * a - y * b - z * c,
+                    w * a + x + y * c - z * b,
+                    w * b - x * c + y + z * a,
+                    w * c + x * b - y * a + z), axis=1)
+    return out / np.sqrt(np.einsum('ij,ij->i', out, out))[:, None]
+
+
+def _gradient_imu(q0, q1, q2, q3, ax, ay, az):
+    _2q0, _2q1, _2q2, _2q3 = 2 * q0, 2 * q1, 2 * q2, 2 * q3
+    _4q0, _4q1, _4q2 = 4 * q0, 4 * q1, 4 * q2
+    _8q1, _8q2 = 8 * q1, 8 * q2
+    q0q0, q1q1, q2q2, q3q3 = q0 * q0, q1 * q1, q2 * q2, q3 * q3
+    s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay
+    s1 = (_4q1 * q3q3 - _2q3 * ax + 4 * q0q0 * q1 - _2q0 * ay - _4q1 +
+          _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az)
+    s2 = (4 * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 +
+          _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az)
+    s3 = 4 * q1q1 * q3 - _2q1 * ax + 4 * q2q2 * q3 - _2q2 * ay
+    return s0, s1, s2, s3
+
+
+def _gradient_marg(q0, q1, q2, q3, ax, ay, az, mx, my, mz):
+    _2q0mx, _2q0my, _2q0mz = 2 * q0 * mx, 2 * q0 * my, 2 * q0 * mz
+    _2q1mx = 2 * q1 * mx
+    _2q0, _2q1, _2q2, _2q3 = 2 * q0, 2 * q1, 2 * q2, 2 * q3
+    _2q0q2, _2q2q3 = 2 * q0 * q2, 2 * q2 * q3
+    q0q0, q0q1, q0q2, q0q3 = q0 * q0, q0 * q1, q0 * q2, q0 * q3
+    q1q1, q1q2, q1q3 = q1 * q1, q1 * q2, q1 * q3
+    q2q2, q2q3, q3q3 = q2 * q2, q2 * q3, q3 * q3
+
+    # Reference direction of Earth's magnetic field
+    hx = (mx * q0q0 - _2q0my * q3 + _2q0mz * q2 + mx * q1q1 + _2q1 * my * q2 +
+          _2q1 * mz * q3 - mx * q2q2 - mx * q3q3)
+    hy = (_2q0mx * q3 + my * q0q0 - _2q0mz * q1 + _2q1mx * q2 - my * q1q1 +
+          my * q2q2 + _2q2 * mz * q3 - my * q3q3)
+    _2bx = math.sqrt(hx * hx + hy * hy)
+    _2bz = (-_2q0mx * q2 + _2q0my * q1 + mz * q0q0 + _2q1mx * q3 - mz * q1q1 +
+            _2q2 * my * q3 - mz * q2q2 + mz * q3q3)
+    _4bx, _4bz = 2 * _2bx, 2 * _2bz
+
+    ex = _2bx * (0.5 - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx
+    ey = _2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my
+    ez = _2bx * (q0q2 + q1q3) + _2bz * (0.5 - q1q1 - q2q2) - mz
+    fx = 2 * q1q3 - _2q0q2 - ax
+    fy = 2 * q0q1 + _2q2q3 - ay
+    fz = 1 - 2 * q1q1 - 2 * q2q2 - az
+    s0 = (-_2q2 * fx + _2q1 * fy - _2bz * q2 * ex +
+          (-_2bx * q3 + _2bz * q1) * ey + _2bx * q2 * ez)
+    s1 = (_2q3 * fx + _2q0 * fy - 4 * q1 * fz + _2bz * q3 * ex +
+          (_2bx * q2 + _2bz * q0) * ey + (_2bx * q3 - _4bz * q1) * ez)
+    s2 = (-_2q0 * fx + _2q3 * fy - 4 * q2 * fz + (-_4bx * q2 - _2bz * q0) * ex +
+          (_2bx * q1 + _2bz * q3) * ey + (_2bx * q0 - _4bz * q2) * ez)
+    s3 = (_2q1 * fx + _2q2 * fy + (-_4bx * q3 + _2bz * q1) * ex +
+          (-_2bx * q0 + _2bz * q2) * ey + _2bx * q1 * ez)
+    return s0, s1, s2, s3
@@ -0,0 +1,200 @@
+"""
+One non-blocking event loop for every device transport.
+
+A single thread waits in a selector on the UDP socket and the serial ports
+and hands each read straight to its callback, which routes it to the worker
+that decodes it (shards.py). Nothing polls on a timeout.
+
+Reads go into one preallocated buffer per transport (recvfrom_into /
+os.readv) and the callback gets a memoryview of the bytes just read. That
+view is only valid until the callback returns; anything that keeps data must
+copy it (StreamDecoder and CaptureWriter do).
+
+After each round of reads the on_flush callbacks run, so a callback can
+collect reads and hand them on in one batch (shards.py).
+
+Serial ports that a selector cannot watch (Windows) are polled every
+POLL_INTERVAL_S instead. A lost port is closed and retried every
+RECONNECT_S, as the old reader thread did.
+"""
+
+import os
+import selectors
+import socket
+import threading
+import time
+
+import serial
+
+import latency
+
+UDP_BUFFER = 2048
+UDP_RCVBUF = 1 << 20
+SERIAL_BUFFER = 4096
+POLL_INTERVAL_S = 0.002
+RECONNECT_S = 2.0
+
+
+class SerialLink:
+    def __init__(self, port_name, baud_rate, on_data, on_link):
+        self.port_name = port_name
+        self.baud_rate = baud_rate
+        self.on_data = on_data        # (view, t_recv_us)
+        self.on_link = on_link        # (Serial or None) on connect / loss
+        self.ser = None
+        self.fd = None                # None while polled
+        self.retry_at = 0.0
+        self.buf = bytearray(SERIAL_BUFFER)
+        self.view = memoryview(self.buf)
+
+
+class Ingest:
+    def __init__(self):
+        self.sel = selectors.DefaultSelector()
+        self.links = []
+        self.flushes = []
+        self.running = False
+        self.thread = None
+
+    def add_udp(self, udp_port, on_datagram):
+        """on_datagram(sock, view, addr, t_recv_us) for every packet."""
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        # Room for a GC pause or a slow emit at 1 kHz before the kernel drops
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, UDP_RCVBUF)
+        sock.bind(('0.0.0.0', udp_port))
+        sock.setblocking(False)
+        buf = bytearray(UDP_BUFFER)
+        self.sel.register(sock, selectors.EVENT_READ,
+                          lambda: self._read_udp(sock, buf, on_datagram))
+        print(f"UDP: Listening on port {udp_port}")
+        return sock
+
+    def add_serial(self, port_name, baud_rate, on_data, on_link):
+        """on_data(view, t_recv_us) per read chunk; on_link(ser or None)."""
+        self.links.append(SerialLink(port_name, baud_rate, on_data, on_link))
+
+    def on_flush(self, callback):
+        """callback() after every round of reads."""
+        self.flushes.append(callback)
+
+    def start(self):
+        self.running = True
+        self.thread = threading.Thread(target=self.run, name='ingest', daemon=True)
+        self.thread.start()
+
+    def stop(self):
+        self.running = False
+
+    def run(self):
+        while self.running:
+            now = time.monotonic()
+            timeout = 1.0
+            for link in self.links:
+                if link.ser is None:
+                    if now >= link.retry_at:
+                        self._open(link)
+                    if link.ser is None:
+                        timeout = min(timeout, max(0.0, link.retry_at - now))
+                if link.ser is not None and link.fd is None:
+                    timeout = min(timeout, POLL_INTERVAL_S)
+            if self.sel.get_map():
+                events = self.sel.select(timeout)
+            else:
+                time.sleep(timeout)   # select() on nothing fails on Windows
+                events = ()
+            for key, _ in events:
+                key.data()
+            for link in self.links:
+                if link.ser is not None and link.fd is None:
+                    self._poll_serial(link)
+            for flush in self.flushes:
+                flush()
+        for link in self.links:
+            if link.ser is not None:
+                self._close(link)
+
+    # ── UDP ──
+    def _read_udp(self, sock, buf, on_datagram):
+        view = memoryview(buf)
+        while True:              # drain everything queued since the wakeup
+            try:
+                n, addr = sock.recvfrom_into(buf)
+            except (BlockingIOError, InterruptedError):
+                return
+            except OSError as e:
+                # e.g. ICMP port unreachable echoed back on Windows
+                print(f"UDP error: {e}")
+                return
+            try:
+                on_datagram(sock, view[:n], addr, latency.now_us())
+            except Exception as e:
+                print(f"UDP error: {e}")
+
+    # ── Serial ──
+    def _open(self, link):
+        try:
+            ser = serial.Serial(link.port_name, link.baud_rate, timeout=0)
+            # Flush any garbage in the buffer after connecting
+            ser.reset_input_buffer()
+        except serial.SerialException as e:
+            print(f"Serial: Waiting for {link.port_name}... ({e})")
+            link.retry_at = time.monotonic() + RECONNECT_S
+            return
+        print(f"Serial: Connected to {link.port_name} at {link.baud_rate} baud")
+        link.ser = ser
+        link.fd = None
+        if os.name == 'posix':
+            try:
+                link.fd = ser.fileno()
+                self.sel.register(link.fd, selectors.EVENT_READ,
+                                  lambda: self._read_serial(link))
+            except (AttributeError, OSError, ValueError):
+                link.fd = None
+        link.on_link(ser)
+
+    def _close(self, link):
+        if link.fd is not None:
+            self.sel.unregister(link.fd)
+            link.fd = None
+        try:
+            link.ser.close()
+        except Exception:
+            pass
+        link.ser = None
+        link.on_link(None)
+
+    def _lost(self, link):
+        print(f"Serial: Lost connection to {link.port_name}, reconnecting...")
+        self._close(link)
+        link.retry_at = time.monotonic() + RECONNECT_S
+
+    def _read_serial(self, link):
+        try:
+            n = os.readv(link.fd, [link.buf])
+        except (BlockingIOError, InterruptedError):
+            return
+        except OSError:
+            self._lost(link)
+            return
+        if n == 0:
+            # Readable with no data: the device went away (USB unplugged)
+            self._lost(link)
+            return
+        self._deliver(link, link.view[:n])
+
+    def _poll_serial(self, link):
+        try:
+            waiting = link.ser.in_waiting
+            data = link.ser.read(min(waiting, SERIAL_BUFFER)) if waiting else b''
+        except Exception:
+            self._lost(link)
+            return
+        if data:
+            self._deliver(link, data)
+
+    def _deliver(self, link, data):
+        try:
+            link.on_data(data, latency.now_us())
+        except Exception as e:
+            print(f"Serial: error handling data from {link.port_name}: {e}")
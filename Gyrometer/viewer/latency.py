@@ -0,0 +1,139 @@
+"""
+End-to-end latency bookkeeping for Gyrometer telemetry, shared by server.py
+and the Air_Pointer simulation.
+
+Clock sync: the host sends "SYNC,<id>,<host_us>" over the link the device is
+streaming on; the firmware answers immediately with
+
+    SYNC,<id>,<host_us>,<device_us>,<age_mean_us>,<age_max_us>,<ring_drops>
+
+where age_* is how long samples waited between acquisition and hand-off to
+the transport (device hop) since the previous reply. The device→host clock
+offset comes from the probe with the smallest round trip in a short window,
+which bounds the error by half that RTT plus crystal drift over the window.
+
+Frame t_us is the sample acquisition time on the device clock (32-bit µs,
+wraps every ~71 min), so once synced every frame yields its
+sample→host-receive latency directly.
+"""
+
+import collections
+import time
+
+U32 = 1 << 32
+
+
+def now_us():
+    """Host monotonic clock in µs (the reference for all latency figures)."""
+    return time.monotonic_ns() // 1000
+
+
+def _signed32(v):
+    v &= U32 - 1
+    return v - U32 if v >= U32 // 2 else v
+
+
+def _percentile(sorted_vals, q):
+    if not sorted_vals:
+        return None
+    k = min(len(sorted_vals) - 1, int(q * len(sorted_vals)))
+    return sorted_vals[k]
+
+
+class ClockSync:
+    """Device-clock offset estimate from SYNC probes (min-RTT filter)."""
+
+    WINDOW = 10        # probes considered for the offset
+    TIMEOUT_US = 2_000_000
+
+    def __init__(self):
+        self.next_id = 0
+        self.pending = {}                    # id -> host send time
+        self.probes = collections.deque(maxlen=self.WINDOW)  # (rtt, offset)
+        self.offset = None                   # device_us - host_us (mod 2^32)
+        self.rtt_us = None
+        self.device = {}                     # last device-hop counters
+
+    @property
+    def synced(self):
+        return self.offset is not None
+
+    def make_probe(self):
+        """Returns the SYNC line to send now."""
+        t0 = now_us()
+        probe_id = self.next_id
+        self.next_id = (self.next_id + 1) & 0xFFFF
+        # Forget probes whose reply never came
+        for pid in [p for p, t in self.pending.items() if t0 - t > self.TIMEOUT_US]:
+            del self.pending[pid]
+        self.pending[probe_id] = t0
+        return f"SYNC,{probe_id},{t0}"
+
+    def on_reply(self, parts, t_recv=None):
+        """
+        parts: the reply line split on ','. Returns True if it matched a
+        pending probe.
+        """
+        t1 = now_us() if t_recv is None else t_recv
+        if len(parts) < 4:
+            return False
+        try:
+            probe_id, t0, dev_us = int(parts[1]), int(parts[2]), int(parts[3])
+            extra = [int(p) for p in parts[4:7]]
+        except ValueError:
+            return False
+        if self.pending.pop(probe_id, None) != t0:
+            return False
+        rtt = t1 - t0
+        offset = (dev_us - (t0 + rtt // 2)) % U32
+        self.probes.append((rtt, offset))
+        self.rtt_us, self.offset = min(self.probes)
+        if len(extra) == 3:
+            self.device = {'age_mean_us': extra[0], 'age_max_us': extra[1],
+                           'ring_drops': extra[2]}
+        return True
+
+    def latency_us(self, t_us, t_recv):
+        """Sample→receive latency for a frame stamped t_us on the device."""
+        if self.offset is None:
+            return None
+        return _signed32(t_recv + self.offset - t_us)
+
+
+class LinkStats:
+    """Latency distribution, drops (sequence gaps) and RFC 3550 jitter."""
+
+    def __init__(self, history=1000):
+        self.lat = collections.deque(maxlen=history)
+        self.received = 0
+        self.drops = 0
+        self.last_seq = None
+        self.last_transit = None
+        self.jitter_us = 0.0
+
+    def add(self, seq, latency_us):
+        self.received += 1
+        if self.last_seq is not None:
+            gap = (seq - self.last_seq) & 0xFFFF
+            if 1 < gap < 0x8000:          # ignore duplicates / reordering
+                self.drops += gap - 1
+        self.last_seq = seq
+        if latency_us is None:
+            return
+        if self.last_transit is not None:
+            self.jitter_us += (abs(latency_us - self.last_transit) - self.jitter_us) / 16.0
+        self.last_transit = latency_us
+        self.lat.append(latency_us)
+
+    def snapshot(self):
+        """Summary in milliseconds (None where there is no data yet)."""
+        vals = sorted(self.lat)
+        ms = lambda v: None if v is None else round(v / 1000.0, 2)
+        return {
+            'received': self.received,
+            'drops': self.drops,
+            'p50_ms': ms(_percentile(vals, 0.50)),
+            'p95_ms': ms(_percentile(vals, 0.95)),
+            'max_ms': ms(vals[-1] if vals else None),
+            'jitter_ms': round(self.jitter_us / 1000.0, 2),
+        }
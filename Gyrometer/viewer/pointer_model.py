@@ -0,0 +1,59 @@
+"""
+Tilt → pointer mapping of the Air_Pointer simulation, without the UI, so
+replay.py can run it over captures and the simulation draws exactly what the
+benchmark measures.
+
+Each sample is pushed with add(); step() runs once per display frame: the
+mean of the last few samples sets the velocity, the target is clamped to the
+screen and the drawn position eases towards it.
+"""
+
+from collections import deque
+
+SMOOTHING_SAMPLES = 5
+GAIN = 0.1          # pixels per degree per frame, times the sensitivity
+MARGIN = 50
+LERP = 0.2
+
+
+class PointerModel:
+    def __init__(self, width, height, sensitivity_x=10.0, sensitivity_y=10.0,
+                 smoothing=SMOOTHING_SAMPLES):
+        self.width = width
+        self.height = height
+        self.sensitivity_x = sensitivity_x
+        self.sensitivity_y = sensitivity_y
+        self.pitch_buffer = deque(maxlen=smoothing)
+        self.roll_buffer = deque(maxlen=smoothing)
+        self.pitch = 0.0
+        self.roll = 0.0
+        self.recenter()
+
+    def recenter(self):
+        self.x = self.width // 2
+        self.y = self.height // 2
+        self.target_x = self.x
+        self.target_y = self.y
+
+    def add(self, pitch, roll):
+        self.pitch_buffer.append(pitch)
+        self.roll_buffer.append(roll)
+
+    @property
+    def has_data(self):
+        return bool(self.pitch_buffer)
+
+    def step(self, gain=GAIN):
+        """One display frame from the smoothed samples; returns (dx, dy)."""
+        if self.pitch_buffer:
+            self.pitch = sum(self.pitch_buffer) / len(self.pitch_buffer)
+            self.roll = sum(self.roll_buffer) / len(self.roll_buffer)
+        return self.move(self.roll * self.sensitivity_x * gain,
+                         -self.pitch * self.sensitivity_y * gain)
+
+    def move(self, dx, dy):
+        self.target_x = max(MARGIN, min(self.width - MARGIN, self.target_x + dx))
+        self.target_y = max(MARGIN, min(self.height - MARGIN, self.target_y + dy))
+        self.x += (self.target_x - self.x) * LERP
+        self.y += (self.target_y - self.y) * LERP
+        return dx, dy
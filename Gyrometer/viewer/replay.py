@@ -0,0 +1,321 @@
+#!/usr/bin/env python3
+"""
+Replay a server.py --record capture through the host pipeline, faster than
+real time, to benchmark it and compare runs.
+
+    python replay.py session.gycap                      # throughput report
+    python replay.py session.gycap --beta 0.05 --beta 0.2   # compare filters
+    python replay.py session.gycap --trace a.csv        # save the output
+    python replay.py session.gycap --compare a.csv      # diff against it
+    python replay.py session.gycap --device a1b2        # one of several units
+    python replay.py raw.gycap --latency --predict-ms 30     # latency compensation
+
+Each run decodes the capture (telemetry.py), fuses FRAME_RAW packets
+(host_fusion.py; device-fused EULER/QUAT frames pass through) and drives the
+Air_Pointer simulation's mapping (pointer_model.py) with one display frame per
+1/60 s of capture time, so the result depends only on the capture. The trace
+has one row per display frame.
+
+--latency measures the firmware's latency compensation (PREDICT_HORIZON_MS,
+include/smoothing.h) on a FRAME_RAW capture: the host-fused orientation is the
+live reference, the firmware's quaternion EMA and gyro-rate prediction run
+over it, and the report gives the shift that best lines each output up with
+the reference (its effective lag) and its error from the live orientation.
+--ema 1 leaves out the smoothing, as server.py --predict-ms does.
+
+To watch a capture instead, use the simulation:
+    python Air_Pointer/simulation/air_mouse_simulation.py --replay session.gycap
+"""
+
+import argparse
+import csv
+import time
+
+import numpy as np
+
+import capture
+import host_fusion
+import pointer_model
+import telemetry
+
+FRAME_US = 1_000_000 // 60
+WIDTH, HEIGHT = 1200, 800          # the simulation window
+TRACE_FIELDS = ('t_ms', 'roll', 'pitch', 'yaw', 'x', 'y')
+
+
+def decode(path, device=None):
+    """
+    Capture -> [(t_us, [Frame, ...])] per received packet/chunk, for one
+    device: sender ID `device`, or the first one in the capture. Also returns
+    the bad frame count and every sender ID seen (None: version 1 frames).
+    """
+    decoder = telemetry.StreamDecoder()
+    packets = []
+    bad = 0
+    seen = []
+    for t, source, data in capture.read_capture(path):
+        if source == capture.SOURCE_SERIAL:
+            frames = [i for i in decoder.feed(data) if isinstance(i, telemetry.Frame)]
+        elif data and data[0] == telemetry.MAGIC:
+            frames = telemetry.decode_frames(data)
+            if frames is None:
+                bad += 1
+                continue
+        else:
+            continue        # text line
+        for f in frames:
+            if f.device not in seen:
+                seen.append(f.device)
+        if seen and device is None:
+            device = seen[0]
+        frames = [f for f in frames if f.device == device]
+        if frames:
+            packets.append((t, frames))
+    return packets, bad + decoder.crc_errors, seen
+
+
+class Pipeline:
+    """Fusion + pointer mapping over decoded packets, with per-stage timing."""
+
+    def __init__(self, beta):
+        self.beta = beta
+        self.fusion = None
+        self.pointer = pointer_model.PointerModel(WIDTH, HEIGHT)
+        self.trace = []
+        self.samples = 0
+        self.t_fusion = 0.0
+        self.t_pointer = 0.0
+
+    def _euler(self, frames):
+        """Packet -> [(roll, pitch, yaw)] in sample order."""
+        raw = [f for f in frames if f.type == telemetry.FRAME_RAW]
+        if raw:
+            if self.fusion is None:
+                self.fusion = host_fusion.MadgwickBatch(self.beta)
+            quats = self.fusion.update(*host_fusion.raw_arrays(raw)).tolist()
+            return [telemetry.quat_to_euler(q) for q in quats]
+        out = []
+        for f in frames:
+            if f.type == telemetry.FRAME_QUAT:
+                out.append(telemetry.quat_to_euler(f.quat))
+            elif f.type == telemetry.FRAME_EULER:
+                out.append((f.roll, f.pitch, f.yaw))
+        return out
+
+    def run(self, packets):
+        next_frame = None
+        euler = (0.0, 0.0, 0.0)
+        for t, frames in packets:
+            t0 = time.perf_counter()
+            angles = self._euler(frames)
+            t1 = time.perf_counter()
+            if next_frame is None:
+                next_frame = t + FRAME_US
+            while t >= next_frame:
+                self.pointer.step()
+                self.trace.append((next_frame / 1000.0, *euler,
+                                   self.pointer.x, self.pointer.y))
+                next_frame += FRAME_US
+            for euler in angles:
+                self.pointer.add(euler[1], euler[0])
+            self.t_fusion += t1 - t0
+            self.t_pointer += time.perf_counter() - t1
+            self.samples += len(angles)
+
+
+def write_trace(path, trace):
+    with open(path, 'w', newline='') as f:
+        w = csv.writer(f)
+        w.writerow(TRACE_FIELDS)
+        w.writerows((f'{v:.4f}' for v in row) for row in trace)
+
+
+def read_trace(path):
+    with open(path, newline='') as f:
+        rows = csv.reader(f)
+        next(rows)
+        return [tuple(float(v) for v in row) for row in rows]
+
+
+def compare(a, b):
+    """Largest per-column difference over the common length (roll and yaw wrap)."""
+    n = min(len(a), len(b))
+    worst = [0.0] * (len(TRACE_FIELDS) - 1)
+    for ra, rb in zip(a[:n], b[:n]):
+        for k in range(1, len(TRACE_FIELDS)):
+            d = abs(ra[k] - rb[k])
+            if TRACE_FIELDS[k] in ('roll', 'yaw'):
+                d = min(d, 360.0 - d)
+            worst[k - 1] = max(worst[k - 1], d)
+    return n, dict(zip(TRACE_FIELDS[1:], worst))
+
+
+def fmt_diff(n, worst):
+    return f"{n} frames, max |Δ| " + ' '.join(f"{k}={v:.3f}" for k, v in worst.items())
+
+
+# ── Latency compensation ──
+EMA_ALPHA = 0.15      # firmware default (src/main.cpp)
+MAX_LAG_S = 0.25      # shifts searched either way
+
+
+def ema_nlerp(quats, alpha):
+    """The firmware's quaternion EMA: quatNlerp() towards every sample."""
+    out = np.empty_like(quats)
+    s0, s1, s2, s3 = quats[0].tolist()
+    u = 1.0 - alpha
+    for k, (q0, q1, q2, q3) in enumerate(quats.tolist()):
+        a = alpha if s0 * q0 + s1 * q1 + s2 * q2 + s3 * q3 >= 0 else -alpha
+        s0, s1, s2, s3 = u * s0 + a * q0, u * s1 + a * q1, u * s2 + a * q2, u * s3 + a * q3
+        r = 1.0 / (s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3) ** 0.5
+        s0, s1, s2, s3 = s0 * r, s1 * r, s2 * r, s3 * r
+        out[k] = (s0, s1, s2, s3)
+    return out
+
+
+def angle_deg(a, b):
+    """Rotation between matching rows of two (N, 4) quaternion arrays."""
+    d = np.abs(np.einsum('ij,ij->i', a, b)).clip(max=1.0)
+    return np.degrees(2.0 * np.arccos(d))
+
+
+def effective_lag(out, ref, period_s):
+    """
+    The shift in seconds that best lines out up with ref (out[i] ~ ref[i - k];
+    negative: out leads), to a fraction of a sample.
+    """
+    kmax = min(int(MAX_LAG_S / period_s), (len(out) - 3) // 2)
+    n = len(out)
+    err = np.array([np.mean(angle_deg(out[kmax:n - kmax], ref[kmax - k:n - kmax - k]) ** 2)
+                    for k in range(-kmax, kmax + 1)])
+    i = int(np.argmin(err))
+    frac = 0.0
+    if 0 < i < len(err) - 1:
+        # Vertex of the parabola through the minimum and its neighbours
+        den = err[i - 1] - 2 * err[i] + err[i + 1]
+        frac = 0.5 * (err[i - 1] - err[i + 1]) / den if den > 0 else 0.0
+    return (i - kmax + frac) * period_s
+
+
+def ema_lag_s(alpha, period_s):
+    """Steady-state lag of the EMA, the firmware's emaLagS()."""
+    return (1.0 - alpha) / alpha * period_s
+
+
+def latency_report(packets, beta, alpha, horizons_ms=None):
+    """
+    (sample period s, rows of (horizon ms, lag s, rms °, p95 °)) against the
+    live orientation; the first row is without prediction. Default horizons:
+    half and all of the EMA lag.
+    """
+    frames = [f for _, fs in packets for f in fs if f.type == telemetry.FRAME_RAW]
+    if len(frames) < 100:
+        return None
+    t_us, flags, acc, gyr, mag = host_fusion.raw_arrays(frames)
+    ref = host_fusion.MadgwickBatch(beta).update(t_us, flags, acc, gyr, mag)
+    steps = (np.diff(t_us) & 0xFFFFFFFF) * 1e-6
+    period_s = float(np.median(steps[(steps > 0) & (steps < host_fusion.MAX_DT_S)]))
+    smooth = ema_nlerp(ref, alpha) if alpha < 1.0 else ref
+    if not horizons_ms:
+        lag_ms = ema_lag_s(alpha, period_s) * 1000.0
+        horizons_ms = [round(lag_ms / 2, 1), round(lag_ms, 1)]
+    rows = []
+    for h in [0.0] + [h for h in horizons_ms if h]:
+        out = host_fusion.predict(smooth, gyr, h / 1000.0) if h else smooth
+        err = angle_deg(out, ref)
+        rows.append((h, effective_lag(out, ref, period_s),
+                     float(np.sqrt(np.mean(err ** 2))), float(np.percentile(err, 95))))
+    return period_s, rows
+
+
+def print_latency(packets, beta, alpha, horizons_ms):
+    result = latency_report(packets, beta, alpha, horizons_ms)
+    if result is None:
+        print("  --latency needs a FRAME_RAW capture (firmware built with OUTPUT_RAW=1)")
+        return
+    period_s, rows = result
+    print(f"  latency: EMA {alpha:g} at {1 / period_s:.0f} Hz "
+          f"(expected lag {ema_lag_s(alpha, period_s) * 1000:.1f} ms), reference beta={beta:g}")
+    print(f"    {'predict':>8} {'lag ms':>8} {'saved ms':>9} {'err rms°':>9} {'err p95°':>9}")
+    base = rows[0][1]
+    for h, lag, rms, p95 in rows:
+        label = f"{h:g} ms" if h else 'off'
+        saved = f"{(base - lag) * 1000:9.1f}" if h else f"{'—':>9}"
+        print(f"    {label:>8} {lag * 1000:8.1f} {saved} {rms:9.2f} {p95:9.2f}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Replay a capture through the host pipeline')
+    parser.add_argument('capture', help='File written by server.py --record')
+    parser.add_argument('--beta', type=float, action='append',
+                        help='Madgwick gain for raw captures (repeat to compare)')
+    parser.add_argument('--repeat', type=int, default=1,
+                        help='Run each pipeline N times and report the best')
+    parser.add_argument('--trace', metavar='CSV', help='Write the (first) run\'s output')
+    parser.add_argument('--compare', metavar='CSV', help='Diff the output against a saved trace')
+    parser.add_argument('--device', type=lambda v: int(v, 16), default=None,
+                        help='Sender ID (hex) in a capture of several devices (default: the first)')
+    parser.add_argument('--latency', action='store_true',
+                        help='Measure latency compensation instead of throughput (FRAME_RAW captures)')
+    parser.add_argument('--ema', type=float, default=EMA_ALPHA,
+                        help='Output EMA gain for --latency (1: no smoothing)')
+    parser.add_argument('--predict-ms', type=float, action='append',
+                        help='Prediction horizon for --latency (repeat to compare; '
+                             'default: half and all of the EMA lag)')
+    args = parser.parse_args()
+    betas = args.beta or [0.1]
+    if not 0.0 < args.ema <= 1.0:
+        parser.error('--ema must be in (0, 1]')
+
+    t0 = time.perf_counter()
+    packets, bad, seen = decode(args.capture, args.device)
+    t_decode = time.perf_counter() - t0
+    if len(seen) > 1:
+        name = lambda d: 'v1' if d is None else telemetry.device_name(d)
+        chosen = args.device if args.device is not None else seen[0]
+        print(f"{args.capture}: {len(seen)} devices ({', '.join(name(d) for d in seen)}), "
+              f"replaying {name(chosen)}")
+    n_frames = sum(len(frames) for _, frames in packets)
+    if not packets:
+        print(f"{args.capture}: no telemetry frames")
+        return
+    span_s = max(1e-6, (packets[-1][0] - packets[0][0]) / 1e6)
+    print(f"{args.capture}: {len(packets)} packets, {n_frames} frames "
+          f"over {span_s:.1f} s ({bad} bad)")
+    print(f"  decode   {t_decode * 1e6 / n_frames:8.2f} µs/frame  "
+          f"{n_frames / t_decode:10.0f} frames/s")
+
+    if args.latency:
+        print_latency(packets, betas[0], args.ema, args.predict_ms)
+        return
+
+    runs = []
+    for beta in betas:
+        best = None
+        for _ in range(max(1, args.repeat)):
+            p = Pipeline(beta)
+            p.run(packets)
+            if best is None or p.t_fusion + p.t_pointer < best.t_fusion + best.t_pointer:
+                best = p
+        runs.append(best)
+        total = best.t_fusion + best.t_pointer + t_decode
+        label = f"beta={beta:g}" if best.fusion else "device fusion"
+        print(f"  {label}: {best.samples} samples, {len(best.trace)} display frames")
+        print(f"    fusion  {best.t_fusion * 1e6 / max(1, best.samples):8.2f} µs/sample")
+        print(f"    pointer {best.t_pointer * 1e6 / max(1, best.samples):8.2f} µs/sample")
+        print(f"    total   {best.samples / total:10.0f} samples/s, "
+              f"{span_s / total:.0f}x real time")
+
+    for other in runs[1:]:
+        n, worst = compare(runs[0].trace, other.trace)
+        print(f"  beta={runs[0].beta:g} vs beta={other.beta:g}: {fmt_diff(n, worst)}")
+    if args.compare:
+        n, worst = compare(read_trace(args.compare), runs[0].trace)
+        print(f"  vs {args.compare}: {fmt_diff(n, worst)}")
+    if args.trace:
+        write_trace(args.trace, runs[0].trace)
+        print(f"  trace -> {args.trace}")
+
+
+if __name__ == '__main__':
+    main()
@@ -1,24 +1,38 @@
 from flask import Flask, render_template
-from flask_socketio import SocketIO
+from flask_socketio import SocketIO, join_room, leave_room
 import serial
 import threading
-import socket
 import time
 import argparse
 import sys
 import glob
 
+import capture
+import dispatch
+import host_fusion
+import ingest
+import latency
+import shards
+
 app = Flask(__name__)
 app.config['TEMPLATES_AUTO_RELOAD'] = True
 app.jinja_env.auto_reload = True
 socketio = SocketIO(app, cors_allowed_origins='*', async_mode='threading')
 
-# Global state
-current_euler = [0.0, 0.0, 0.0]  # roll, pitch, yaw
-running = True
-euler_count = 0
-status_count = 0
-last_log_time = 0
+# ── Every emit goes through one dispatcher thread (see dispatch.py) ──
+dispatcher = dispatch.Dispatcher(socketio)
+
+# ── Devices, decoded and fused in worker processes (see shards.py) ──
+pool = None
+devices_lock = threading.Lock()
+known_devices = {}     # key -> {'device', 'slot', 'transport', 'endpoint'}
+device_slots = {}      # key -> number in the 'orient' packet, kept across reconnects
+device_links = {}      # key -> endpoint the device last streamed on
+udp_sock = None
+serial_links = {}      # port name -> open Serial
+
+# ── --record: everything received, for replay.py (see capture.py) ──
+recorder = None
 
 def serial_scanner():
     """Scans for available serial ports."""
@@ -49,121 +63,120 @@ def serial_scanner():
             pass
     return result
 
-def process_line(line):
-    """Process a data line from either serial or UDP."""
-    global current_euler, euler_count, status_count, last_log_time
-    line = line.strip()
-    if not line:
-        return
-
-    # Log unrecognized lines for debugging
-    if not (line.startswith('EULER') or line.startswith('STATUS') or line.startswith('TRANSPORT')):
-        if not line.startswith('=') and not line.startswith('WiFi') and not line.startswith('MPU') and not line.startswith('HMC') and not line.startswith('ERROR') and not line.startswith('DIAG'):
-            print(f"[WARN] Unknown line: {repr(line[:80])}")
-        return
-
-    if line.startswith('EULER'):
-        parts = line.split(',')
-        if len(parts) == 4:
-            try:
-                roll = float(parts[1])
-                pitch = float(parts[2])
-                yaw = float(parts[3])
-                # Reject nan/inf values
-                import math
-                if any(math.isnan(v) or math.isinf(v) for v in (roll, pitch, yaw)):
-                    return
-                current_euler = [roll, pitch, yaw]
-                socketio.emit('euler_data', {'roll': roll, 'pitch': pitch, 'yaw': yaw})
-                euler_count += 1
-                # Log stats every 5 seconds
-                now = time.time()
-                if now - last_log_time >= 5:
-                    print(f"[INFO] EULER received: {euler_count} total | STATUS: {status_count} | roll={roll:.2f} pitch={pitch:.2f} yaw={yaw:.2f}")
-                    last_log_time = now
-            except ValueError as e:
-                print(f"[ERROR] Bad EULER parse: {repr(line)} -> {e}")
+def device_list():
+    with devices_lock:
+        return sorted(known_devices.values(), key=lambda d: d['slot'])
+
+def on_shard_output(messages):
+    """Results from the shards, in order (collector thread; see devices.py)."""
+    changed = False
+    for msg in messages:
+        kind, key = msg[0], msg[1]
+        if kind == 'orient':
+            _, _, okind, values, seq, t_host, covers = msg
+            dispatcher.orientation(okind, values, seq, t_host, covers, room=key,
+                                   slot=device_slots.get(key, 0))
+        elif kind == 'emit':
+            event, data = msg[2], msg[3]
+            if event == 'latency_stats':
+                data['dispatch'] = dict(dispatcher.stats, shard_dropped=sum(pool.dropped))
+            dispatcher.emit(event, data, room=key)
+        elif kind == 'send':
+            send_to_device(key, msg[2])
+        elif kind == 'link':
+            endpoint = msg[2]
+            device_links[key] = endpoint
+            with devices_lock:
+                slot = device_slots.setdefault(key, len(device_slots))
+                known_devices[key] = {'device': key, 'slot': slot, 'transport': endpoint[0],
+                                      'endpoint': ':'.join(str(p) for p in endpoint[1:])}
+            changed = True
+        elif kind == 'gone':
+            device_links.pop(key, None)
+            with devices_lock:
+                known_devices.pop(key, None)
+            changed = True
+    if changed:
+        dispatcher.emit('devices', device_list())
+
+# ── Ingest callbacks (run on the ingest thread, see ingest.py) ──
+def on_datagram(sock, data, addr, t_recv):
+    """One UDP packet from an ESP32 over WiFi."""
+    if recorder:
+        recorder.write(data, t_recv, capture.SOURCE_UDP)
+    pool.udp(data, addr, t_recv)
+
+def serial_callbacks(port_name):
+    """(on_data, on_link) for one serial port."""
+    def on_data(data, t_recv):
+        # A chunk of the stream, which mixes text lines with binary frames
+        if recorder:
+            recorder.write(data, t_recv, capture.SOURCE_SERIAL)
+        pool.serial(port_name, data, t_recv)
+
+    def on_link(ser):
+        # Connected (ser) or lost (None): either way the stream starts over
+        if ser is None:
+            serial_links.pop(port_name, None)
         else:
-            print(f"[ERROR] EULER wrong field count ({len(parts)}): {repr(line[:80])}")
-
-    elif line.startswith('STATUS'):
-        parts = line.split(',')
-        if len(parts) == 3:
-            try:
-                imu_ok = int(parts[1]) == 1
-                mag_ok = int(parts[2]) == 1
-                socketio.emit('device_status', {'imu': imu_ok, 'mag': mag_ok})
-                status_count += 1
-            except ValueError:
-                print(f"[ERROR] Bad STATUS parse: {repr(line)}")
-
-    elif line.startswith('TRANSPORT'):
-        parts = line.split(',')
-        if len(parts) == 2:
-            mode = parts[1].strip()
-            print(f"Transport mode: {mode}")
-            socketio.emit('transport_mode', {'mode': mode})
-
-def serial_reader(port_name, baud_rate):
-    """Read data from serial port with auto-reconnect."""
-    global running
-    ser = None
-
-    while running:
-        # Connect / reconnect
-        if ser is None or not ser.is_open:
-            try:
-                ser = serial.Serial(port_name, baud_rate, timeout=0.1)
-                print(f"Serial: Connected to {port_name} at {baud_rate} baud")
-                # Flush any garbage in the buffer after connecting
-                ser.reset_input_buffer()
-            except serial.SerialException as e:
-                print(f"Serial: Waiting for {port_name}... ({e})")
-                time.sleep(2)
-                continue
-
-        # Read loop
-        try:
-            line = ser.readline().decode('utf-8', errors='ignore').strip()
-            if line:
-                process_line(line)
-        except Exception:
-            print(f"Serial: Lost connection to {port_name}, reconnecting...")
-            try:
-                ser.close()
-            except Exception:
-                pass
-            ser = None
-            time.sleep(2)
-            continue
-
-        time.sleep(0.001)
-
-    if ser and ser.is_open:
-        ser.close()
-
-def udp_listener(udp_port):
-    """Listen for UDP packets from ESP32 WiFi."""
-    global running
-    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
-    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
-    sock.bind(('0.0.0.0', udp_port))
-    sock.settimeout(1.0)
-    print(f"UDP: Listening on port {udp_port}")
-
-    while running:
-        try:
-            data, addr = sock.recvfrom(1024)
-            line = data.decode('utf-8', errors='ignore').strip()
-            if line:
-                process_line(line)
-        except socket.timeout:
-            continue
-        except Exception as e:
-            print(f"UDP error: {e}")
-            time.sleep(0.5)
-
-    sock.close()
+            serial_links[port_name] = ser
+        pool.serial(port_name, None, latency.now_us())
+    return on_data, on_link
+
+def send_to_device(key, line):
+    """Send a command line on the link the device last streamed on."""
+    endpoint = device_links.get(key)
+    try:
+        if endpoint is None:
+            return False
+        if endpoint[0] == 'udp' and udp_sock:
+            udp_sock.sendto(line.encode(), endpoint[1:])
+        elif endpoint[0] == 'serial' and endpoint[1] in serial_links:
+            serial_links[endpoint[1]].write((line + '\n').encode())
+        else:
+            return False
+    except Exception as e:
+        print(f"[WARN] Could not send {line.split(',')[0]} to {key}: {e}")
+        return False
+    return True
+
+@socketio.on('clock_ping')
+def clock_ping(data):
+    """Browser clock probe: echo its send time with the server wall clock."""
+    return {'t0': data.get('t0'), 'ts': time.time() * 1000.0}
+
+@socketio.on('list_devices')
+def list_devices(data=None):
+    """Devices streaming now; the list is also broadcast as 'devices' on change."""
+    return device_list()
+
+@socketio.on('join_device')
+def join_device(data):
+    """Subscribe this browser to one device's events (its room)."""
+    key = str(data.get('device', ''))
+    join_room(key)
+    return {'ok': key in known_devices}
+
+@socketio.on('leave_device')
+def leave_device(data):
+    leave_room(str(data.get('device', '')))
+    return {'ok': True}
+
+@socketio.on('device_command')
+def device_command(data):
+    """CONFIG / SET,<key>,<value> / DEFAULTS for one device ('device' may be
+    left out while only one is connected); it answers with CONFIG lines,
+    relayed to its room as 'device_config'."""
+    line = str(data.get('line', '')).strip()
+    if line.split(',')[0] not in ('CONFIG', 'SET', 'DEFAULTS'):
+        return {'ok': False, 'error': 'unknown command'}
+    key = data.get('device')
+    if key is None:
+        connected = device_list()
+        if len(connected) != 1:
+            return {'ok': False, 'error': 'device required'}
+        key = connected[0]['device']
+    return {'ok': send_to_device(str(key), line)}
 
 @app.route('/')
 def index():
@@ -171,38 +184,65 @@ def index():
 
 if __name__ == '__main__':
     parser = argparse.ArgumentParser(description='Web-based Orientation Viewer')
-    parser.add_argument('--port', type=str, default=None,
-                        help='Serial port (e.g., COM3 or /dev/ttyUSB0)')
+    parser.add_argument('--port', type=str, action='append', default=None,
+                        help='Serial port (e.g., COM3 or /dev/ttyUSB0); repeat for several devices')
     parser.add_argument('--baud', type=int, default=921600, help='Baud rate')
     parser.add_argument('--web-port', type=int, default=5001, help='Web server port')
     parser.add_argument('--udp-port', type=int, default=4210, help='UDP listen port')
+    parser.add_argument('--fusion-beta', type=float, default=host_fusion.MadgwickBatch().beta,
+                        help='Madgwick gain for host fusion (OUTPUT_RAW firmware)')
+    parser.add_argument('--predict-ms', type=float, default=0.0,
+                        help='Turn host-fused orientation ahead by the gyro rate for this long '
+                             '(latency compensation; measure with replay.py --latency)')
+    parser.add_argument('--workers', type=int, default=shards.DEFAULT_WORKERS,
+                        help='Decode / fusion worker processes, devices split between them '
+                             '(0: one thread, no extra processes)')
     parser.add_argument('--no-serial', action='store_true',
                         help='WiFi-only mode (skip serial)')
+    parser.add_argument('--record', type=str, default=None, metavar='FILE',
+                        help='Append everything received to a capture file (see replay.py)')
+    parser.add_argument('--emit-hz', type=float, default=60.0,
+                        help='Max orientation updates per second per device to browsers (newest wins)')
     args = parser.parse_args()
+    pool = shards.ShardPool(on_shard_output, args.workers, args.fusion_beta,
+                            args.predict_ms / 1000.0)
+    pool.start()
+    print(f"Workers: {len(pool.inboxes)} shard(s)" + ("" if args.workers else " on one thread"))
+    dispatcher.period = 1.0 / args.emit_hz
+    dispatcher.start()
+    if args.record:
+        recorder = capture.CaptureWriter(args.record)
+        print(f"Recording to {args.record}")
 
     web_port = args.web_port
 
-    # ── Start UDP listener (always) ──
-    udp_thread = threading.Thread(target=udp_listener, args=(args.udp_port,), daemon=True)
-    udp_thread.start()
+    # ── One ingest loop for UDP (always) and serial; routes to the shards ──
+    engine = ingest.Ingest()
+    udp_sock = engine.add_udp(args.udp_port, on_datagram)
+    engine.on_flush(pool.flush)
 
-    # ── Start serial reader (unless --no-serial) ──
+    # ── Serial ports (unless --no-serial) ──
     if not args.no_serial:
-        target_port = args.port
-        if target_port is None:
+        target_ports = args.port or []
+        if not target_ports:
             print("Serial: Scanning ports...")
             ports = serial_scanner()
             if ports:
                 preferred = [p for p in ports if 'usb' in p.lower()]
-                target_port = preferred[0] if preferred else ports[0]
-                print(f"Serial: Auto-selected {target_port}")
+                target_ports = [preferred[0] if preferred else ports[0]]
+                print(f"Serial: Auto-selected {target_ports[0]}")
             else:
                 print("Serial: No ports found (WiFi-only)")
 
-        if target_port:
-            serial_thread = threading.Thread(
-                target=serial_reader, args=(target_port, args.baud), daemon=True)
-            serial_thread.start()
+        for port_name in target_ports:
+            engine.add_serial(port_name, args.baud, *serial_callbacks(port_name))
+    engine.start()
 
     print(f"Starting Flask server at http://0.0.0.0:{web_port}")
-    socketio.run(app, host='0.0.0.0', port=web_port, allow_unsafe_werkzeug=True)
+    try:
+        socketio.run(app, host='0.0.0.0', port=web_port, allow_unsafe_werkzeug=True)
+    finally:
+        engine.stop()
+        pool.stop()
+        if recorder:
+            recorder.close()
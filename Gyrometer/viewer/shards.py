@@ -0,0 +1,147 @@
+"""
+Worker processes for multi-device ingest (server.py).
+
+The ingest thread (ingest.py) only routes. Each UDP datagram goes to the
+shard that owns its device, picked from the sender ID in the frame header
+(telemetry.peek_device) without decoding the frame. A shard holds the
+DeviceSessions (devices.py) of its devices. Decode and host fusion for one
+busy sensor therefore run beside the others and never hold them up.
+
+  - Reads are batched per selector wakeup (flush()) and handed over through
+    one bounded queue per shard. A shard that falls behind drops whole
+    batches (counted in `dropped`) rather than block the ingest thread, so
+    only its own devices lose samples.
+  - Shards send their results back in batches on one shared queue. A
+    collector thread in the main process passes each batch to `handle`.
+    server.py turns them into dispatcher calls and device commands.
+  - Each shard runs its own per-device timers: clock-sync probes,
+    latency_stats and session timeout, every devices.TICK_S.
+
+Text lines carry no ID. A UDP line goes with the device last seen at the
+same source address. A serial port is routed as a whole and the shard splits
+it by device, because only the stream decoder can find the frames in it.
+
+workers=0 runs a single shard on a thread instead: the same code path in
+one process, handy under a debugger.
+"""
+
+import multiprocessing
+import os
+import queue
+import signal
+import threading
+import time
+import zlib
+
+import devices
+import telemetry
+
+SHARD_QUEUE = 256        # batches waiting per shard before it drops
+DEFAULT_WORKERS = max(1, min(8, (os.cpu_count() or 2) - 1))
+
+
+def run_shard(inbox, outbox, beta, predict_s):
+    """Shard loop, in a worker process or (workers=0) a thread."""
+    shard = devices.Shard(beta, predict_s)
+    next_tick = time.monotonic() + devices.TICK_S
+    while True:
+        try:
+            batch = inbox.get(timeout=max(0.0, next_tick - time.monotonic()))
+        except queue.Empty:
+            batch = ()
+        if batch is None:
+            return
+        for item in batch:
+            try:
+                shard.feed(*item)
+            except Exception as e:
+                print(f"[ERROR] {devices.endpoint_name(item[1])}: {e}")
+        if time.monotonic() >= next_tick:
+            shard.tick()
+            next_tick += devices.TICK_S
+        out = shard.take()
+        if out:
+            outbox.put(out)
+
+
+def _worker_main(inbox, outbox, beta, predict_s):
+    signal.signal(signal.SIGINT, signal.SIG_IGN)   # the server shuts us down
+    run_shard(inbox, outbox, beta, predict_s)
+
+
+class ShardPool:
+    def __init__(self, handle, workers=DEFAULT_WORKERS, beta=0.1, predict_s=0.0):
+        """handle(messages) on the collector thread (see devices.py)."""
+        self.handle = handle
+        self.inboxes = []
+        if workers > 0:
+            # spawn everywhere: forking a process that already runs threads is
+            # unsafe, and macOS / Windows have nothing else
+            ctx = multiprocessing.get_context('spawn')
+            self.outbox = ctx.Queue()
+            for i in range(workers):
+                inbox = ctx.Queue(SHARD_QUEUE)
+                ctx.Process(target=_worker_main, args=(inbox, self.outbox, beta, predict_s),
+                            name=f'shard-{i}', daemon=True).start()
+                self.inboxes.append(inbox)
+        else:
+            self.outbox = queue.Queue()
+            inbox = queue.Queue(SHARD_QUEUE)
+            threading.Thread(target=run_shard, args=(inbox, self.outbox, beta, predict_s),
+                             name='shard', daemon=True).start()
+            self.inboxes.append(inbox)
+        self.pending = [[] for _ in self.inboxes]
+        self.dropped = [0] * len(self.inboxes)   # reads lost to a full shard queue
+        self.routes = {}     # UDP source address -> (sender ID, key, shard, endpoint)
+
+    def start(self):
+        threading.Thread(target=self._collect, name='shard-collect', daemon=True).start()
+
+    def stop(self):
+        for inbox in self.inboxes:
+            try:
+                inbox.put_nowait(None)
+            except queue.Full:
+                pass
+
+    def shard_of(self, key):
+        return zlib.crc32(key.encode()) % len(self.inboxes)
+
+    # ── Routing (ingest thread) ──
+    def udp(self, data, addr, t_recv):
+        """Queue one datagram for its device's shard."""
+        device = telemetry.peek_device(data)
+        route = self.routes.get(addr)
+        if route is None or (device is not None and device != route[0]):
+            endpoint = ('udp',) + tuple(addr[:2])
+            key = (telemetry.device_name(device) if device is not None
+                   else devices.endpoint_name(endpoint))
+            route = self.routes[addr] = (device, key, self.shard_of(key), endpoint)
+        _, key, shard, endpoint = route
+        self.pending[shard].append((t_recv, endpoint, key, bytes(data)))
+
+    def serial(self, port_name, data, t_recv):
+        """Queue a serial chunk; data None when the port opened or was lost."""
+        endpoint = ('serial', port_name)
+        shard = self.shard_of(devices.endpoint_name(endpoint))
+        self.pending[shard].append((t_recv, endpoint, None, None if data is None else bytes(data)))
+
+    def flush(self):
+        """After every round of reads: hand each shard its batch."""
+        for i, batch in enumerate(self.pending):
+            if not batch:
+                continue
+            try:
+                self.inboxes[i].put_nowait(batch)
+            except queue.Full:
+                self.dropped[i] += len(batch)
+            self.pending[i] = []
+
+    # ── Collector thread ──
+    def _collect(self):
+        while True:
+            messages = self.outbox.get()
+            try:
+                self.handle(messages)
+            except Exception as e:
+                print(f"[ERROR] Shard output: {e}")
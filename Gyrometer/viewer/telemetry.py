@@ -0,0 +1,259 @@
+"""
+Binary telemetry decoding for the Gyrometer firmware.
+Mirrors Gyrometer/include/telemetry.h — keep the two in sync.
+
+Frame layout (little-endian):
+    magic u8 (0xA5) | version u8 | type u8 | flags u8 | seq u16 | t_us u32
+    | device u16 | payload | crc16 u16
+(CRC-16/CCITT-FALSE over everything before it). Version 1 frames, from older
+firmware and captures, have no device field; they decode with device None.
+
+FRAME_BATCH payload: sample_type u8 | count u8 | count x (dt_us u16 | flags u8
+| sample payload). Sample k has seq = seq + k and t_us = t_us + dt_us.
+
+FRAME_RAW carries calibrated accel (g), gyro (deg/s) and mag (µT) for host
+fusion (host_fusion.py); STATUS_MAG_FUSED then marks a fresh mag reading.
+"""
+
+import binascii
+import math
+import struct
+
+MAGIC = 0xA5
+VERSION = 2
+VERSION_NO_DEVICE = 1
+
+FRAME_EULER = 1
+FRAME_QUAT = 2
+FRAME_RAW = 3
+FRAME_BATCH = 0x10
+
+STATUS_IMU_OK = 1 << 0
+STATUS_MAG_OK = 1 << 1
+STATUS_MAG_FUSED = 1 << 2
+
+HEADER = struct.Struct('<BBBBHIH')
+HEADER_V1 = struct.Struct('<BBBBHI')
+HEADERS = {VERSION: HEADER, VERSION_NO_DEVICE: HEADER_V1}
+DEVICE = struct.Struct('<H')
+CRC = struct.Struct('<H')
+
+# type -> payload struct
+PAYLOADS = {
+    FRAME_EULER: struct.Struct('<hhh'),
+    FRAME_QUAT: struct.Struct('<hhhh'),
+    FRAME_RAW: struct.Struct('<9h'),
+}
+RAW_ACC_SCALE = 8192.0   # LSB per g
+RAW_GYR_SCALE = 64.0     # LSB per deg/s
+RAW_MAG_SCALE = 16.0     # LSB per µT
+FRAME_SIZES = {v: {t: h.size + p.size + CRC.size for t, p in PAYLOADS.items()}
+               for v, h in HEADERS.items()}
+BATCH_INFO = struct.Struct('<BB')
+BATCH_SAMPLE = struct.Struct('<HB')
+BATCH_MAX_SAMPLES = 32
+MAX_FRAME_SIZE = (HEADER.size + BATCH_INFO.size + CRC.size +
+                  BATCH_MAX_SAMPLES * (BATCH_SAMPLE.size + max(p.size for p in PAYLOADS.values())))
+
+
+class Frame:
+    """One decoded telemetry sample."""
+    __slots__ = ('type', 'flags', 'seq', 't_us', 'device', 'roll', 'pitch', 'yaw', 'quat', 'raw')
+
+    def __init__(self, ftype, flags, seq, t_us, device=None):
+        self.type = ftype
+        self.flags = flags
+        self.seq = seq
+        self.t_us = t_us
+        self.device = device  # sender ID, None for version 1 frames
+        self.roll = self.pitch = self.yaw = None
+        self.quat = None
+        self.raw = None      # (ax, ay, az, gx, gy, gz, mx, my, mz)
+
+    @property
+    def imu_ok(self):
+        return bool(self.flags & STATUS_IMU_OK)
+
+    @property
+    def mag_ok(self):
+        return bool(self.flags & STATUS_MAG_OK)
+
+
+def quat_to_euler(q):
+    """
+    (w, x, y, z) -> (roll, pitch, yaw) in degrees, using the same conventions
+    as the firmware's Madgwick filter (yaw in [0, 360)).
+    """
+    w, x, y, z = q
+    sp = max(-1.0, min(1.0, -2.0 * (x * z - w * y)))
+    roll = math.degrees(math.atan2(w * x + y * z, 0.5 - x * x - y * y))
+    pitch = math.degrees(math.asin(sp))
+    yaw = math.degrees(math.atan2(x * y + w * z, 0.5 - y * y - z * z)) + 180.0
+    return roll, pitch, yaw
+
+
+def device_name(device):
+    """How a sender ID is shown and keyed: the last MAC bytes, as hex."""
+    return f'{device:04x}'
+
+
+def peek_device(buf):
+    """
+    Sender ID of the frame at the start of buf, without checking it (routing
+    before decode). None for text, version 1 frames and short buffers.
+    """
+    if len(buf) < HEADER.size or buf[0] != MAGIC or buf[1] != VERSION:
+        return None
+    return buf[10] | buf[11] << 8
+
+
+def frame_size(buf, offset=0):
+    """
+    Expected size of the frame starting at buf[offset]. Returns None if this is
+    not a frame, 0 if more bytes are needed to tell.
+    """
+    avail = len(buf) - offset
+    if avail < 3 or buf[offset] != MAGIC:
+        return None if avail >= 3 else 0
+    header = HEADERS.get(buf[offset + 1])
+    if header is None:
+        return None
+    ftype = buf[offset + 2]
+    if ftype == FRAME_BATCH:
+        if avail < header.size + BATCH_INFO.size:
+            return 0
+        stype, count = BATCH_INFO.unpack_from(buf, offset + header.size)
+        payload = PAYLOADS.get(stype)
+        if payload is None or not 0 < count <= BATCH_MAX_SAMPLES:
+            return None
+        return (header.size + BATCH_INFO.size + CRC.size +
+                count * (BATCH_SAMPLE.size + payload.size))
+    return FRAME_SIZES[buf[offset + 1]].get(ftype)
+
+
+def _fill(frame, values):
+    if frame.type == FRAME_EULER:
+        frame.roll = values[0] / 100.0
+        frame.pitch = values[1] / 100.0
+        frame.yaw = (values[2] / 100.0) % 360.0  # same range as the ASCII stream
+    elif frame.type == FRAME_QUAT:
+        frame.quat = tuple(v / 16384.0 for v in values)
+    elif frame.type == FRAME_RAW:
+        frame.raw = (tuple(v / RAW_ACC_SCALE for v in values[0:3]) +
+                     tuple(v / RAW_GYR_SCALE for v in values[3:6]) +
+                     tuple(v / RAW_MAG_SCALE for v in values[6:9]))
+    return frame
+
+
+def _check(buf, offset):
+    """Returns the frame size if a complete, CRC-valid frame is at offset."""
+    size = frame_size(buf, offset)
+    if not size or len(buf) - offset < size:
+        return None
+    end = offset + size - CRC.size
+    (crc,) = CRC.unpack_from(buf, end)
+    if binascii.crc_hqx(bytes(buf[offset:end]), 0xFFFF) != crc:
+        return None
+    return size
+
+
+def decode_frames(buf, offset=0):
+    """
+    Decode the frame at buf[offset] into a list of per-sample Frames (one for
+    a plain frame, count for a batch). Returns None if malformed.
+    """
+    if _check(buf, offset) is None:
+        return None
+    version = buf[offset + 1]
+    _, _, ftype, flags, seq, t_us = HEADER_V1.unpack_from(buf, offset)
+    device = None
+    pos = offset + HEADER_V1.size
+    if version != VERSION_NO_DEVICE:
+        (device,) = DEVICE.unpack_from(buf, pos)
+        pos += DEVICE.size
+    if ftype != FRAME_BATCH:
+        return [_fill(Frame(ftype, flags, seq, t_us, device), PAYLOADS[ftype].unpack_from(buf, pos))]
+
+    stype, count = BATCH_INFO.unpack_from(buf, pos)
+    pos += BATCH_INFO.size
+    payload = PAYLOADS[stype]
+    frames = []
+    for k in range(count):
+        dt_us, sflags = BATCH_SAMPLE.unpack_from(buf, pos)
+        pos += BATCH_SAMPLE.size
+        frame = Frame(stype, sflags, (seq + k) & 0xFFFF, (t_us + dt_us) & 0xFFFFFFFF, device)
+        frames.append(_fill(frame, payload.unpack_from(buf, pos)))
+        pos += payload.size
+    return frames
+
+
+def decode_frame(buf, offset=0):
+    """Decode a single-sample frame at buf[offset]. Returns a Frame or None."""
+    frames = decode_frames(buf, offset)
+    if not frames or len(frames) != 1:
+        return None
+    return frames[0]
+
+
+def encode_frame(ftype, values, seq, t_us, flags=STATUS_IMU_OK | STATUS_MAG_OK, device=0):
+    """
+    Single-sample frame from already-quantised int16 values, like the
+    firmware's encodeFrame(); for tools that stand in for a device.
+    """
+    body = (HEADER.pack(MAGIC, VERSION, ftype, flags, seq & 0xFFFF, t_us & 0xFFFFFFFF, device) +
+            PAYLOADS[ftype].pack(*values))
+    return body + CRC.pack(binascii.crc_hqx(body, 0xFFFF))
+
+
+class StreamDecoder:
+    """
+    Splits a byte stream (serial) that interleaves text lines with binary
+    frames. feed() returns a list of str lines and Frame objects in order.
+    """
+
+    def __init__(self):
+        self.buf = bytearray()
+        self.crc_errors = 0
+
+    def feed(self, data):
+        self.buf += data
+        out = []
+        buf = self.buf
+        i = 0
+        n = len(buf)
+        while i < n:
+            if buf[i] == MAGIC:
+                size = frame_size(buf, i)
+                if size is None:
+                    i += 1     # stray 0xA5 inside text
+                    continue
+                if size == 0 or n - i < size:
+                    break      # wait for the rest of the frame
+                frames = decode_frames(buf, i)
+                if frames is None:
+                    self.crc_errors += 1
+                    i += 1
+                    continue
+                out.extend(frames)
+                i += size
+            else:
+                nl = buf.find(b'\n', i)
+                magic = buf.find(bytes((MAGIC,)), i)
+                if magic != -1 and (nl == -1 or magic < nl):
+                    # Frame starts mid-line; flush the text before it
+                    text = buf[i:magic].decode('utf-8', errors='ignore').strip()
+                    if text:
+                        out.append(text)
+                    i = magic
+                    continue
+                if nl == -1:
+                    break
+                text = buf[i:nl].decode('utf-8', errors='ignore').strip()
+                if text:
+                    out.append(text)
+                i = nl + 1
+        del buf[:i]
+        # Never let garbage without newlines grow without bound
+        if len(buf) > 4096:
+            del buf[:-MAX_FRAME_SIZE]
+        return out